@@ -0,0 +1,663 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "../li.h"
+
+/*
+================================================
+                  li benchmark
+
+bench_li [-r rounds] [-o results.li] [-c baseline.li] file...
+
+Parses, writes, searches, clones and frees every file,
+the best time of the rounds is reported. Results are
+saved as a li file and compared with a saved baseline.
+On Linux the hardware counters of the best round are
+reported per byte and per node when perf events are
+allowed (see /proc/sys/kernel/perf_event_paranoid).
+================================================
+*/
+
+#define NUM_PHASES      5
+
+static const char *phaseNames[NUM_PHASES] = {
+    "parse", "write", "find", "clone", "free"
+};
+
+#define NUM_COUNTERS    5
+
+static const char *counterNames[NUM_COUNTERS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses"
+};
+
+typedef struct {
+    uint64_t    ns;         /* best time */
+    uint64_t    allocs;     /* allocations of one round */
+    uint64_t    allocBytes;
+    uint64_t    counters[NUM_COUNTERS]; /* of the best round */
+} phase_t;
+
+typedef struct {
+    const char  *name;
+    uint64_t    nodes;      /* nodes of the tree */
+    uint64_t    bytes;      /* written size */
+    uint64_t    treeBytes;  /* live bytes of the parsed tree */
+    uint64_t    rssKb;      /* peak RSS of the process so far */
+    phase_t     phases[NUM_PHASES];
+} result_t;
+
+/*
+================================================
+               counting allocator
+================================================
+*/
+
+typedef struct {
+    uint64_t    allocs;
+    uint64_t    bytes;
+    uint64_t    live;
+} count_t;
+
+static liAlloc_t    *baseAlc;
+static count_t      counts;
+
+/* the size is kept in front of the block */
+#define HEADER_SIZE     16
+
+static void *CountAlloc( size_t size, lityid_t type ) {
+    char *p = (char*)baseAlc->alloc( size + HEADER_SIZE, type );
+    if( !p ) {
+        return NULL;
+    }
+    *(size_t*)p = size;
+    counts.allocs++;
+    counts.bytes += size;
+    counts.live += size;
+    return p + HEADER_SIZE;
+}
+
+static void *CountRealloc( void *ptr, size_t size, lityid_t type ) {
+    char *p;
+    if( !ptr ) {
+        return CountAlloc( size, type );
+    }
+    p = (char*)ptr - HEADER_SIZE;
+    counts.live -= *(size_t*)p;
+    p = (char*)baseAlc->realloc( p, size + HEADER_SIZE, type );
+    if( !p ) {
+        return NULL;
+    }
+    *(size_t*)p = size;
+    counts.allocs++;
+    counts.bytes += size;
+    counts.live += size;
+    return p + HEADER_SIZE;
+}
+
+static void CountFree( void *ptr ) {
+    char *p;
+    if( !ptr ) {
+        return;
+    }
+    p = (char*)ptr - HEADER_SIZE;
+    counts.live -= *(size_t*)p;
+    baseAlc->free( p );
+}
+
+static liAlloc_t countAlc = { CountAlloc, CountRealloc, CountFree };
+
+
+
+/*
+================================================
+               hardware counters
+================================================
+*/
+
+/* counter descriptors (-1 - not available) */
+static int counterFds[NUM_COUNTERS] = { -1, -1, -1, -1, -1 };
+static int numCounters = 0;
+
+#if defined(__linux__)
+/*
+============
+OpenCounter
+============
+*/
+static int OpenCounter( uint32_t type, uint64_t config ) {
+    struct perf_event_attr attr;
+    
+    memset( &attr, 0, sizeof(attr) );
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+}
+
+#define CACHE_READ_MISS(c)  ((c) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/*
+============
+OpenCounters
+============
+*/
+static void OpenCounters( void ) {
+    int i;
+    
+    counterFds[0] = OpenCounter( PERF_TYPE_HARDWARE, 
+            PERF_COUNT_HW_CPU_CYCLES );
+    counterFds[1] = OpenCounter( PERF_TYPE_HARDWARE, 
+            PERF_COUNT_HW_INSTRUCTIONS );
+    counterFds[2] = OpenCounter( PERF_TYPE_HW_CACHE, 
+            CACHE_READ_MISS( PERF_COUNT_HW_CACHE_L1D ) );
+    counterFds[3] = OpenCounter( PERF_TYPE_HW_CACHE, 
+            CACHE_READ_MISS( PERF_COUNT_HW_CACHE_LL ) );
+    counterFds[4] = OpenCounter( PERF_TYPE_HARDWARE, 
+            PERF_COUNT_HW_BRANCH_MISSES );
+    for( i = 0; i < NUM_COUNTERS; i++ ) {
+        if( counterFds[i] >= 0 ) {
+            numCounters++;
+        }
+    }
+}
+
+/*
+============
+StartCounters
+============
+*/
+static void StartCounters( void ) {
+    int i;
+    
+    for( i = 0; i < NUM_COUNTERS; i++ ) {
+        if( counterFds[i] >= 0 ) {
+            ioctl( counterFds[i], PERF_EVENT_IOC_RESET, 0 );
+            ioctl( counterFds[i], PERF_EVENT_IOC_ENABLE, 0 );
+        }
+    }
+}
+
+/*
+============
+StopCounters
+============
+*/
+static void StopCounters( uint64_t *values ) {
+    int i;
+    
+    for( i = 0; i < NUM_COUNTERS; i++ ) {
+        values[i] = 0;
+        if( counterFds[i] >= 0 ) {
+            ioctl( counterFds[i], PERF_EVENT_IOC_DISABLE, 0 );
+            if( read( counterFds[i], &values[i], sizeof(uint64_t) ) != 
+                    (ssize_t)sizeof(uint64_t) ) {
+                values[i] = 0;
+            }
+        }
+    }
+}
+
+/*
+============
+CloseCounters
+============
+*/
+static void CloseCounters( void ) {
+    int i;
+    
+    for( i = 0; i < NUM_COUNTERS; i++ ) {
+        if( counterFds[i] >= 0 ) {
+            close( counterFds[i] );
+            counterFds[i] = -1;
+        }
+    }
+}
+#else
+static void OpenCounters( void ) {
+}
+
+static void StartCounters( void ) {
+}
+
+static void StopCounters( uint64_t *values ) {
+    memset( values, 0, NUM_COUNTERS * sizeof(uint64_t) );
+}
+
+static void CloseCounters( void ) {
+}
+#endif
+
+
+
+/*
+================================================
+                  null output
+================================================
+*/
+
+static uint64_t nullBytes;
+
+static liFile_t NullOpen( const char *name, char mode ) {
+    return (liFile_t)&nullBytes;
+}
+
+static void NullClose( liFile_t f ) {
+}
+
+static ssize_t NullRead( void *dst, size_t size, liFile_t f ) {
+    return 0;
+}
+
+static ssize_t NullWrite( const void *src, size_t size, liFile_t f ) {
+    nullBytes += size;
+    return (ssize_t)size;
+}
+
+static liIO_t nullIO = {
+    NullOpen, NullClose, NullRead, NullWrite, NULL, NULL
+};
+
+
+
+/*
+================================================
+                  benchmark
+================================================
+*/
+
+/*
+============
+Now
+============
+*/
+static uint64_t Now( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+============
+FindPattern
+
+Keys of the first nodes down to three levels
+============
+*/
+static void FindPattern( liObj_t *o, char *pattern, size_t size ) {
+    size_t n = 0;
+    int level;
+
+    pattern[0] = 0;
+    for( level = 0; o && o->key && level < 3; level++ ) {
+        if( n + slen(o->key) + 2 > size ) {
+            break;
+        }
+        if( n ) {
+            pattern[n++] = '.';
+        }
+        memcpy( pattern + n, sstr(o->key), slen(o->key) );
+        n += slen(o->key);
+        pattern[n] = 0;
+        o = o->firstChild;
+    }
+}
+
+/*
+============
+Phase
+============
+*/
+static void PhaseBegin( count_t *c, uint64_t *t ) {
+    *c = counts;
+    StartCounters();
+    *t = Now();
+}
+
+static void PhaseEnd( phase_t *p, count_t *c, uint64_t t, int round ) {
+    uint64_t ns = Now() - t;
+    uint64_t values[NUM_COUNTERS];
+    
+    StopCounters( values );
+    if( !round || ns < p->ns ) {
+        p->ns = ns;
+        memcpy( p->counters, values, sizeof(values) );
+    }
+    p->allocs = counts.allocs - c->allocs;
+    p->allocBytes = counts.bytes - c->bytes;
+}
+
+/*
+============
+CountNodes
+============
+*/
+static uint64_t CountNodes( liObj_t *o ) {
+    uint64_t n = 0;
+    
+    for( ; o; o = o->next ) {
+        n += 1 + CountNodes( o->firstChild );
+    }
+    return n;
+}
+
+/*
+============
+BenchFile
+============
+*/
+static int BenchFile( const char *name, int rounds, result_t *r ) {
+    liFindData_t find;
+    struct rusage ru;
+    char pattern[256];
+    char errbuf[1024];
+    liObj_t **clones = NULL;
+    liObj_t *o, *it;
+    uint64_t t;
+    count_t c;
+    size_t num, i;
+    licode_t code;
+    int round;
+
+    memset( r, 0, sizeof(*r) );
+    r->name = name;
+
+    for( round = 0; round < rounds; round++ ) {
+        /* parse */
+        o = NULL;
+        PhaseBegin( &c, &t );
+        code = LiReadEx( NULL, &o, name, 0, errbuf, sizeof(errbuf) );
+        PhaseEnd( &r->phases[0], &c, t, round );
+        if( code != LI_OK ) {
+            printf( "error: %s: %s\n", name, errbuf );
+            return 0;
+        }
+        if( !o ) {
+            printf( "error: %s is empty\n", name );
+            return 0;
+        }
+        r->treeBytes = counts.live - c.live;
+        r->nodes = CountNodes( o );
+
+        /* write */
+        nullBytes = 0;
+        PhaseBegin( &c, &t );
+        LiWriteEx( &nullIO, o, "null", 0 );
+        PhaseEnd( &r->phases[1], &c, t, round );
+        r->bytes = nullBytes;
+
+        /* find */
+        FindPattern( o, pattern, sizeof(pattern) );
+        num = 0;
+        PhaseBegin( &c, &t );
+        if( pattern[0] ) {
+            code = LiFindFirst( &find, o, pattern );
+            while( code == LI_OK ) {
+                num++;
+                code = LiFindNext( &find );
+            }
+            LiFindClose( &find );
+        }
+        PhaseEnd( &r->phases[2], &c, t, round );
+
+        /* clone the top-level nodes */
+        for( num = 0, it = o; it; it = it->next ) {
+            num++;
+        }
+        clones = (liObj_t**)malloc( num * sizeof(liObj_t*) );
+        PhaseBegin( &c, &t );
+        for( i = 0, it = o; it; it = it->next ) {
+            clones[i++] = LiClone( it );
+        }
+        PhaseEnd( &r->phases[3], &c, t, round );
+        for( i = 0; i < num; i++ ) {
+            LiFree( clones[i] );
+        }
+        free( clones );
+
+        /* free */
+        PhaseBegin( &c, &t );
+        LiFree( o );
+        PhaseEnd( &r->phases[4], &c, t, round );
+    }
+
+    getrusage( RUSAGE_SELF, &ru );
+    r->rssKb = (uint64_t)ru.ru_maxrss;
+    return 1;
+}
+
+/*
+============
+PrintResult
+============
+*/
+static void PrintResult( result_t *r ) {
+    const phase_t *p;
+    int i;
+
+    printf( "%s: %llu bytes, %llu nodes, tree %llu bytes, "
+            "peak rss %llu KB\n",
+            r->name, (unsigned long long)r->bytes,
+            (unsigned long long)r->nodes,
+            (unsigned long long)r->treeBytes,
+            (unsigned long long)r->rssKb );
+    for( i = 0; i < NUM_PHASES; i++ ) {
+        p = r->phases + i;
+        printf( "  %-6s %10.3f ms %10.1f MB/s %10llu allocs %12llu bytes\n",
+                phaseNames[i], (double)p->ns / 1e6,
+                p->ns ? (double)r->bytes / ((double)p->ns / 1e9) / 1e6 : 0.0,
+                (unsigned long long)p->allocs,
+                (unsigned long long)p->allocBytes );
+    }
+    if( !numCounters ) {
+        return;
+    }
+    
+    printf( "  %-6s %9s %9s %9s %9s %9s %9s %9s\n", "", "cyc/B", "ins/B",
+            "IPC", "cyc/node", "L1d/node", "LLC/node", "brm/node" );
+    for( i = 0; i < NUM_PHASES; i++ ) {
+        const uint64_t *v = r->phases[i].counters;
+        double bytes = r->bytes ? (double)r->bytes : 1.0;
+        double nodes = r->nodes ? (double)r->nodes : 1.0;
+        printf( "  %-6s %9.2f %9.2f %9.2f %9.1f %9.3f %9.3f %9.3f\n",
+                phaseNames[i], (double)v[0] / bytes, (double)v[1] / bytes,
+                v[0] ? (double)v[1] / (double)v[0] : 0.0,
+                (double)v[0] / nodes, (double)v[2] / nodes,
+                (double)v[3] / nodes, (double)v[4] / nodes );
+    }
+}
+
+
+
+/*
+================================================
+              results and baseline
+================================================
+*/
+
+/*
+============
+AddUint
+============
+*/
+static void AddUint( liObj_t *parent, const char *key, uint64_t v ) {
+    liObj_t *o = LiUint( v );
+    LiSetKey( o, key );
+    LiInsertLastChild( parent, o );
+}
+
+/*
+============
+SaveResults
+============
+*/
+static void SaveResults( const char *name, result_t *res, int num ) {
+    liObj_t *list = NULL;
+    liObj_t *r, *o, *p;
+    int i, k, c;
+
+    for( i = 0; i < num; i++ ) {
+        r = LiObj();
+        LiSetKey( r, "result" );
+        o = LiStr( res[i].name );
+        LiSetKey( o, "file" );
+        LiInsertLastChild( r, o );
+        AddUint( r, "bytes", res[i].bytes );
+        AddUint( r, "nodes", res[i].nodes );
+        AddUint( r, "tree", res[i].treeBytes );
+        AddUint( r, "rss", res[i].rssKb );
+        for( k = 0; k < NUM_PHASES; k++ ) {
+            p = LiObj();
+            LiSetKey( p, phaseNames[k] );
+            AddUint( p, "ns", res[i].phases[k].ns );
+            AddUint( p, "allocs", res[i].phases[k].allocs );
+            AddUint( p, "bytes", res[i].phases[k].allocBytes );
+            for( c = 0; c < NUM_COUNTERS && numCounters; c++ ) {
+                AddUint( p, counterNames[c], res[i].phases[k].counters[c] );
+            }
+            LiInsertLastChild( r, p );
+        }
+        if( list ) {
+            LiInsertLast( list, r );
+        } else {
+            list = r;
+        }
+    }
+
+    if( list ) {
+        if( LiWrite( list, name ) != LI_OK ) {
+            printf( "error: can't write %s\n", name );
+        }
+        LiFree( list );
+    }
+}
+
+/*
+============
+Child
+============
+*/
+static liObj_t *Child( liObj_t *o, const char *key ) {
+    for( o = o->firstChild; o; o = o->next ) {
+        if( o->key && LiSCmp( o->key, key ) ) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+/*
+============
+CompareBaseline
+============
+*/
+static void CompareBaseline( const char *name, result_t *res, int num ) {
+    liObj_t *base = NULL;
+    liObj_t *it, *file, *p, *ns;
+    char errbuf[1024];
+    double d;
+    int i, k;
+
+    if( LiReadEx( NULL, &base, name, 0, errbuf, sizeof(errbuf) ) != LI_OK ) {
+        printf( "error: baseline %s: %s\n", name, errbuf );
+        return;
+    }
+
+    printf( "\ncompared with %s (time, + is slower)\n", name );
+    for( i = 0; i < num; i++ ) {
+        for( it = base; it; it = it->next ) {
+            file = Child( it, "file" );
+            if( file && file->type == LI_VTSTR &&
+                    LiSCmp( file->vstr, res[i].name ) ) {
+                break;
+            }
+        }
+        if( !it ) {
+            printf( "%s: not in the baseline\n", res[i].name );
+            continue;
+        }
+        printf( "%s:", res[i].name );
+        for( k = 0; k < NUM_PHASES; k++ ) {
+            p = Child( it, phaseNames[k] );
+            ns = p ? Child( p, "ns" ) : NULL;
+            if( !ns || !ns->vuint ) {
+                continue;
+            }
+            d = ((double)res[i].phases[k].ns - (double)ns->vuint) /
+                    (double)ns->vuint * 100.0;
+            printf( " %s %+.1f%%", phaseNames[k], d );
+        }
+        printf( "\n" );
+    }
+
+    if( base ) {
+        LiFree( base );
+    }
+}
+
+int main( int argc, char **argv ) {
+    const char *save = NULL;
+    const char *baseline = NULL;
+    result_t *res;
+    int rounds = 5;
+    int num = 0;
+    int i;
+
+    res = (result_t*)malloc( (size_t)argc * sizeof(result_t) );
+    for( i = 1; i < argc; i++ ) {
+        if( strcmp( argv[i], "-r" ) == 0 && i + 1 < argc ) {
+            rounds = atoi( argv[++i] );
+        } else if( strcmp( argv[i], "-o" ) == 0 && i + 1 < argc ) {
+            save = argv[++i];
+        } else if( strcmp( argv[i], "-c" ) == 0 && i + 1 < argc ) {
+            baseline = argv[++i];
+        } else {
+            argv[num++ + 1] = argv[i];
+        }
+    }
+    if( !num || rounds < 1 ) {
+        printf( "usage: bench_li [-r rounds] [-o results.li] "
+                "[-c baseline.li] file...\n" );
+        free( res );
+        return 1;
+    }
+
+    OpenCounters();
+    if( !numCounters ) {
+        printf( "hardware counters are not available\n" );
+    }
+    baseAlc = LiGetAllocator();
+    LiSetAllocator( &countAlc );
+    for( i = 0; i < num; i++ ) {
+        if( !BenchFile( argv[i + 1], rounds, res + i ) ) {
+            free( res );
+            return 1;
+        }
+        PrintResult( res + i );
+    }
+    LiSetAllocator( baseAlc );
+    CloseCounters();
+
+    if( save ) {
+        SaveResults( save, res, num );
+    }
+    if( baseline ) {
+        CompareBaseline( baseline, res, num );
+    }
+    free( res );
+    return 0;
+}
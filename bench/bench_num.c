@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../liutil.h"
+
+#define NUM_VALUES      (1 << 16)
+#define NUM_ROUNDS      200
+
+/*
+============
+RefToStr
+
+Reference: one div/mod per digit into a temporary
+array, then reversed
+============
+*/
+static size_t RefToStr( uint64_t val, char *str, int base ) {
+    static const char alpha[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    char *p = str;
+    uint8_t digits[64];
+    int dig = 0;
+    
+    do {
+        digits[dig++] = (uint8_t)(val % base);
+        val /= base;
+    } while( val );
+    do {
+        *p++ = alpha[ digits[--dig] ];
+    } while( dig > 0 );
+    *p = 0;
+    
+    return StrLen( str );
+}
+
+/*
+============
+NextRand
+============
+*/
+static uint64_t NextRand( uint64_t *state ) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static uint64_t values[NUM_VALUES];
+
+/*
+============
+Bench
+============
+*/
+static double Bench( size_t (*fn)(uint64_t,char*,int), int base,
+        size_t *total ) {
+    char buf[80];
+    clock_t start = clock();
+    int r, i;
+    
+    *total = 0;
+    for( r = 0; r < NUM_ROUNDS; r++ ) {
+        for( i = 0; i < NUM_VALUES; i++ ) {
+            *total += fn( values[i], buf, base );
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main( int argc, char **argv ) {
+    static const int bases[] = { 10, 16, 8, 2 };
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    char a[80], b[80];
+    size_t ta, tb;
+    double da, db;
+    int i, k;
+    
+    /* mix of short and long numbers */
+    for( i = 0; i < NUM_VALUES; i++ ) {
+        values[i] = NextRand( &state ) >> (NextRand( &state ) % 64);
+    }
+    values[0] = 0;
+    values[1] = UINT64_MAX;
+    
+    /* check the kernels against the reference */
+    for( k = 0; k < 4; k++ ) {
+        for( i = 0; i < NUM_VALUES; i++ ) {
+            size_t la = RefToStr( values[i], a, bases[k] );
+            size_t lb = UInt64ToStr( values[i], b, bases[k] );
+            if( la != lb || StrLen( b ) != lb || memcmp( a, b, la ) ) {
+                printf( "mismatch: base %d [%s] [%s]\n", bases[k], a, b );
+                return 1;
+            }
+        }
+    }
+    
+    printf( "%-6s %12s %12s %8s\n", "base", "ref ns/op", "new ns/op",
+            "speedup" );
+    for( k = 0; k < 4; k++ ) {
+        da = Bench( RefToStr, bases[k], &ta );
+        db = Bench( UInt64ToStr, bases[k], &tb );
+        printf( "%-6d %12.2f %12.2f %7.2fx\n", bases[k],
+                da * 1e9 / ((double)NUM_VALUES * NUM_ROUNDS),
+                db * 1e9 / ((double)NUM_VALUES * NUM_ROUNDS),
+                db > 0 ? da / db : 0.0 );
+    }
+    
+    return 0;
+}
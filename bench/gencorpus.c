@@ -0,0 +1,303 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+================================================
+               li corpus generator
+
+gencorpus <shape> <size> <file> [seed]
+
+shape   deep, wide, strings, numbers, example
+size    bytes with an optional K, M or G suffix
+
+The same shape, size and seed give the same file.
+================================================
+*/
+
+typedef struct {
+    FILE        *f;
+    uint64_t    size;       /* bytes written */
+    uint64_t    rand;       /* xorshift state */
+} gen_t;
+
+/*
+============
+NextRand
+============
+*/
+static uint64_t NextRand( gen_t *g ) {
+    uint64_t x = g->rand;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return g->rand = x;
+}
+
+/*
+============
+Put
+============
+*/
+static void Put( gen_t *g, const char *fmt, ... ) {
+    va_list args;
+    int n;
+
+    va_start( args, fmt );
+    n = vfprintf( g->f, fmt, args );
+    va_end( args );
+    if( n > 0 ) {
+        g->size += (uint64_t)n;
+    }
+}
+
+/*
+============
+Indent
+============
+*/
+static void Indent( gen_t *g, int level ) {
+    while( level-- > 0 ) {
+        Put( g, "    " );
+    }
+}
+
+/*
+============
+PutText
+
+Random words, quotes and backslashes escaped
+============
+*/
+static void PutText( gen_t *g, int len ) {
+    static const char chars[] =
+            "abcdefghijklmnopqrstuvwxyz    ABCDEFGHIJ0123456789.,-_/\"\\";
+    char buf[512];
+    int i, n = 0;
+    char c;
+
+    for( i = 0; i < len && n < (int)sizeof(buf) - 2; i++ ) {
+        c = chars[NextRand( g ) % (sizeof(chars) - 1)];
+        if( c == '"' || c == '\\' ) {
+            buf[n++] = '\\';
+        }
+        buf[n++] = c;
+    }
+    buf[n] = 0;
+    Put( g, "\"%s\"", buf );
+}
+
+/*
+============
+GenDeep
+
+Chains of nested objects up to 512 levels deep,
+up to 32 in files below 1 MB
+============
+*/
+static void GenDeep( gen_t *g, uint64_t size ) {
+    int maxDepth = size < (1 << 20) ? 32 : 512;
+    uint64_t n = 0;
+    int depth, i;
+
+    while( g->size < size ) {
+        depth = 8 + (int)(NextRand( g ) % (maxDepth - 7));
+        for( i = 0; i < depth; i++ ) {
+            Indent( g, i );
+            Put( g, "d%d = {\n", i % 8 );
+        }
+        Indent( g, depth );
+        Put( g, "leaf = %llu\n", (unsigned long long)n++ );
+        for( i = depth - 1; i >= 0; i-- ) {
+            Indent( g, i );
+            Put( g, "}\n" );
+        }
+    }
+}
+
+/*
+============
+GenWide
+
+Objects of 1000..100000 keyed children
+============
+*/
+static void GenWide( gen_t *g, uint64_t size ) {
+    uint64_t n = 0;
+    int width, i;
+
+    while( g->size < size ) {
+        width = 1000 + (int)(NextRand( g ) % 99001);
+        Put( g, "wide = {\n" );
+        for( i = 0; i < width && g->size < size; i++ ) {
+            Put( g, "    k%d = %llu\n", i, (unsigned long long)n++ );
+        }
+        Put( g, "}\n" );
+    }
+}
+
+/*
+============
+GenStrings
+============
+*/
+static void GenStrings( gen_t *g, uint64_t size ) {
+    int i, num;
+
+    while( g->size < size ) {
+        num = 1 + (int)(NextRand( g ) % 4);
+        Put( g, "s = " );
+        for( i = 0; i < num; i++ ) {
+            if( i ) {
+                Put( g, ", " );
+            }
+            PutText( g, 8 + (int)(NextRand( g ) % 200) );
+        }
+        Put( g, "\n" );
+    }
+}
+
+/*
+============
+PutBin
+============
+*/
+static void PutBin( gen_t *g, uint64_t v ) {
+    char buf[72];
+    int n = 64;
+
+    buf[n] = 0;
+    do {
+        buf[--n] = (char)('0' + (v & 1));
+        v >>= 1;
+    } while( v );
+    Put( g, "0b%s", buf + n );
+}
+
+/*
+============
+GenNumbers
+
+Runs of numbers in every base and sign
+============
+*/
+static void GenNumbers( gen_t *g, uint64_t size ) {
+    uint64_t v;
+    int i, num;
+
+    while( g->size < size ) {
+        num = 1 + (int)(NextRand( g ) % 16);
+        Put( g, "n = " );
+        for( i = 0; i < num; i++ ) {
+            v = NextRand( g ) >> (NextRand( g ) % 64);
+            if( i ) {
+                Put( g, ", " );
+            }
+            switch( NextRand( g ) % 6 ) {
+                case 0: Put( g, "0x%llx", (unsigned long long)v ); break;
+                case 1: Put( g, "0%llo", (unsigned long long)v ); break;
+                case 2: Put( g, "-%lld", (long long)(v >> 1) ); break;
+                case 3: Put( g, "+%lld", (long long)(v >> 1) ); break;
+                case 4: PutBin( g, v & 0xffff ); break;
+                default: Put( g, "%llu", (unsigned long long)v ); break;
+            }
+        }
+        Put( g, "\n" );
+    }
+}
+
+/*
+============
+GenExample
+
+Key bindings like example.li: groups of commands
+============
+*/
+static void GenExample( gen_t *g, uint64_t size ) {
+    uint64_t n = 0;
+    int i, num;
+
+    while( g->size < size ) {
+        Put( g, "keybinding = {\n" );
+        Put( g, "    group = {\n" );
+        Put( g, "        name = \"kb_grp_%llu\"\n", (unsigned long long)n );
+        Put( g, "        command = {\n" );
+        num = 4 + (int)(NextRand( g ) % 12);
+        for( i = 0; i < num; i++ ) {
+            Put( g, "            id = \"kb_%llu_%d\"\n",
+                    (unsigned long long)n, i );
+            Put( g, "            exe = \"cmd_%d\"\n",
+                    (int)(NextRand( g ) % 64) );
+            Put( g, i + 1 < num ? "        }, {\n" : "        }\n" );
+        }
+        Put( g, "    }\n" );
+        Put( g, "}\n" );
+        n++;
+    }
+}
+
+/*
+============
+ParseSize
+============
+*/
+static uint64_t ParseSize( const char *s ) {
+    char *end;
+    uint64_t v = strtoull( s, &end, 10 );
+
+    switch( *end ) {
+        case 'k': case 'K': v <<= 10; break;
+        case 'm': case 'M': v <<= 20; break;
+        case 'g': case 'G': v <<= 30; break;
+        default: break;
+    }
+    return v;
+}
+
+int main( int argc, char **argv ) {
+    static char buf[1 << 20];
+    gen_t g;
+    uint64_t size;
+
+    if( argc < 4 ) {
+        printf( "usage: gencorpus <deep|wide|strings|numbers|example> "
+                "<size[K|M|G]> <file> [seed]\n" );
+        return 1;
+    }
+    size = ParseSize( argv[2] );
+    g.f = fopen( argv[3], "wb" );
+    if( !g.f ) {
+        printf( "error: can't open %s\n", argv[3] );
+        return 1;
+    }
+    setvbuf( g.f, buf, _IOFBF, sizeof(buf) );
+    g.size = 0;
+    g.rand = argc > 4 ? strtoull( argv[4], NULL, 0 ) : 0x9e3779b97f4a7c15ULL;
+    if( !g.rand ) {
+        g.rand = 1;
+    }
+
+    if( strcmp( argv[1], "deep" ) == 0 ) {
+        GenDeep( &g, size );
+    } else if( strcmp( argv[1], "wide" ) == 0 ) {
+        GenWide( &g, size );
+    } else if( strcmp( argv[1], "strings" ) == 0 ) {
+        GenStrings( &g, size );
+    } else if( strcmp( argv[1], "numbers" ) == 0 ) {
+        GenNumbers( &g, size );
+    } else if( strcmp( argv[1], "example" ) == 0 ) {
+        GenExample( &g, size );
+    } else {
+        printf( "error: unknown shape %s\n", argv[1] );
+        fclose( g.f );
+        return 1;
+    }
+
+    if( fclose( g.f ) != 0 ) {
+        printf( "error: can't write %s\n", argv[3] );
+        return 1;
+    }
+    return 0;
+}
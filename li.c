@@ -1,6 +1,14 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "li.h"
 #include "liassert.h"
 #include "liutil.h"
+#include "lizip.h"
+
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
 
 
 
@@ -10,6 +18,7 @@
 ================================================
 */
 
+#if defined(LI_CHECKED_CALLS)
 /*
 ============
 LiParent
@@ -59,6 +68,7 @@ liObj_t *LiLastChild( liObj_t *o ) {
     liassert(o);
     return o->lastChild;
 }
+#endif
 
 /*
 ============
@@ -194,11 +204,19 @@ static void InsertionHelper( liObj_t *left, liObj_t *right,
         }
     }
 #endif    
+    /* checked in release builds too, the block would free the node */
+    liObj_t *it;
+    for( it = firstInsert; it; it = it->next ) {
+        liverifya( !(it->flags & LI_FEMBED), "error: a node of a deep "
+                "clone can't be moved to another tree" );
+    }
+    
     /* restoring "family" relations */
     if( parent ) {
+        LiHashInvalidate( parent );
         /* set the whole sibling sequence of the parent and get a
         pointer to the last node of the sibling sequence */
-        liObj_t *it = firstInsert;
+        it = firstInsert;
         do {
             it->parent = parent;
         } while( (it = it->next) );
@@ -241,6 +259,7 @@ static void RestoreKeys( liObj_t *left, liObj_t *parent, liObj_t *restore ){
         liassert( left->key );
         while( restore && !restore->key ) {
             restore->key = LiSRef( left->key );
+            restore->hash = 0;
             restore = restore->next;
         }
     } else if( parent ) {
@@ -393,6 +412,15 @@ static liObj_t *ExtractionHelper( liObj_t *left, liObj_t *right ) {
     liObj_t *after = right->next;
     liObj_t *it;
     
+    /* checked in release builds too, the block would free the node */
+    for( it = left; it; it = it->next ) {
+        liverifya( !(it->flags & LI_FEMBED), "error: a node of a deep "
+                "clone can't be extracted or freed alone" );
+        if( it == right ) {
+            break;
+        }
+    }
+    
     /* if the left node has a previous sibling and the
     right node has a next sibling */
     if( before && after ) {
@@ -415,6 +443,7 @@ static liObj_t *ExtractionHelper( liObj_t *left, liObj_t *right ) {
     
     /* disconnect parents */
     if( parent ) {
+        LiHashInvalidate( parent );
         if( left == parent->firstChild ) {
             if( right == parent->lastChild ) {
                 /* no descendants */
@@ -428,10 +457,13 @@ static liObj_t *ExtractionHelper( liObj_t *left, liObj_t *right ) {
         }
         
         it = left;
-        do {
+        while( 1 ) {
             it->parent = NULL;
+            if( it == right ) {
+                break;
+            }
             it = it->next;
-        } while( it != right );
+        }
     }
     
     return left;
@@ -456,7 +488,7 @@ liObj_t *LiExtractSiblings( liObj_t *left, liObj_t *right ) {
     liassert( left || right );
 #if !defined(LI_NODBG) && defined(DEBUG)
     if( left && right ) {
-        liObj_t *it;
+        liObj_t *it = left;
         while( it && it != right ) {
             it = it->next;
         }
@@ -534,7 +566,9 @@ static void LiNodeFreeSubtreeHelper_r( liObj_t *node, int level ) {
                 break;
         }
         
-        LiDealloc( node );
+        if( !(node->flags & LI_FEMBED) ) {
+            LiDealloc( node );
+        }
         node = next;
     } while( node );
 }
@@ -561,6 +595,258 @@ void LiFree( liObj_t *li ) {
 
 
 
+/*
+================================================
+                 li object clone
+================================================
+*/
+
+/*
+============
+CloneStr
+
+Shares a heap string by reference. Strings embedded into
+a deep clone block are copied, they die with the block.
+============
+*/
+static liStr_t *CloneStr( liStr_t *s, lityid_t type ) {
+    if( !s ) {
+        return NULL;
+    }
+    if( !salc(s) ) {
+        return type == LI_TYID_KEY ? LiSNewKeyL( sstr(s), slen(s) ) :
+                LiSNewL( sstr(s), slen(s) );
+    }
+    return LiSRef( s );
+}
+
+/*
+============
+CloneHelper_r
+============
+*/
+static liObj_t *CloneHelper_r( liObj_t *src, liStr_t *key, int level ) {
+    liObj_t *o, *it, *child;
+    
+    liassert( src );
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    o = (liObj_t*)LiAlloc( sizeof(liObj_t), LI_TYID_NODE );
+    o->parent = NULL;
+    o->next = NULL;
+    o->prev = NULL;
+    o->firstChild = NULL;
+    o->lastChild = NULL;
+    o->key = key;
+    o->type = src->type;
+    o->flags = src->flags & ~LI_FEMBED;
+    /* same key text and values */
+    o->hash = src->hash;
+    
+    /* share the value */
+    if( src->type == LI_VTSTR ) {
+        o->vstr = CloneStr( src->vstr, LI_TYID_STR );
+    } else {
+        o->vuint = src->vuint;
+    }
+    
+    /* clone children in order */
+    for( it = src->firstChild; it; it = it->next ) {
+        if( it->prev && it->prev->key == it->key ) {
+            /* keep the sibling run */
+            key = LiSRef( o->lastChild->key );
+        } else {
+            key = CloneStr( it->key, LI_TYID_KEY );
+        }
+        child = CloneHelper_r( it, key, level + 1 );
+        child->parent = o;
+        child->prev = o->lastChild;
+        if( o->lastChild ) {
+            o->lastChild->next = child;
+        } else {
+            o->firstChild = child;
+        }
+        o->lastChild = child;
+    }
+    
+    return o;
+}
+
+/*
+============
+LiClone
+
+Returns a detached copy of the node and its subtree.
+Node links are intrusive, so every node is copied, but
+keys and string values are shared by reference and
+only copied when one side changes them (see LiSetKeyL).
+Sibling runs keep sharing one key, as in the source.
+============
+*/
+liObj_t *LiClone( liObj_t *o ) {
+    liassert( o );
+    return CloneHelper_r( o, CloneStr( o->key, LI_TYID_KEY ), 0 );
+}
+
+/* size of a string embedded into a clone block */
+#define BlockStrSize(len)   ((sizeof(liStr_t) + (len) + 1 + \
+                                sizeof(lisize_t) - 1) & ~(sizeof(lisize_t) - 1))
+
+typedef struct {
+    liObj_t     *node;      /* next free node */
+    char        *str;       /* next free string */
+    size_t      numNodes;   /* number of nodes */
+    size_t      strSize;    /* size of all strings */
+} liBlock_t;
+
+/*
+============
+MeasureHelper_r
+============
+*/
+static void MeasureHelper_r( liBlock_t *b, liObj_t *o, int level ) {
+    liObj_t *it;
+    
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    b->numNodes++;
+    if( o->type == LI_VTSTR && o->vstr ) {
+        b->strSize += BlockStrSize( slen(o->vstr) );
+    }
+    for( it = o->firstChild; it; it = it->next ) {
+        /* a sibling run stores its key once */
+        if( it->key && !(it->prev && it->prev->key == it->key) ) {
+            b->strSize += BlockStrSize( slen(it->key) );
+        }
+        MeasureHelper_r( b, it, level + 1 );
+    }
+}
+
+/*
+============
+BlockStr
+============
+*/
+static liStr_t *BlockStr( liBlock_t *b, liStr_t *src ) {
+    liStr_t *s;
+    
+    if( !src ) {
+        return NULL;
+    }
+    s = (liStr_t*)b->str;
+    salc(s) = 0;
+    slen(s) = slen(src);
+    snref(s) = 0;
+    MemCpy( sstr(s), sstr(src), slen(src) + 1 );
+    b->str += BlockStrSize( slen(src) );
+    
+    return s;
+}
+
+/*
+============
+DeepCloneHelper_r
+
+Lays out the subtree in preorder: the node first,
+then all its descendants.
+============
+*/
+static liObj_t *DeepCloneHelper_r( liBlock_t *b, liObj_t *src, 
+        liStr_t *key ) {
+    liObj_t *o = b->node++;
+    liObj_t *it, *child;
+    
+    o->parent = NULL;
+    o->next = NULL;
+    o->prev = NULL;
+    o->firstChild = NULL;
+    o->lastChild = NULL;
+    o->key = key;
+    o->type = src->type;
+    o->flags = src->flags | LI_FEMBED;
+    o->hash = src->hash;
+    
+    if( src->type == LI_VTSTR ) {
+        o->vstr = BlockStr( b, src->vstr );
+    } else {
+        o->vuint = src->vuint;
+    }
+    
+    for( it = src->firstChild; it; it = it->next ) {
+        if( it->prev && it->prev->key == it->key ) {
+            key = o->lastChild->key;
+            if( key ) {
+                LiSRef( key );
+            }
+        } else {
+            key = BlockStr( b, it->key );
+        }
+        child = DeepCloneHelper_r( b, it, key );
+        child->parent = o;
+        child->prev = o->lastChild;
+        if( o->lastChild ) {
+            o->lastChild->next = child;
+        } else {
+            o->firstChild = child;
+        }
+        o->lastChild = child;
+    }
+    
+    return o;
+}
+
+/*
+============
+LiDeepClone
+
+Returns a detached copy of the node and its subtree
+allocated as one contiguous block: nodes in preorder
+followed by the keys and strings. The returned node
+sits at the start of the block and frees it, so
+the other nodes of the clone and its strings must
+not be moved to or referenced from another tree,
+extracting or freeing them alone asserts. Use
+LiClone for that.
+============
+*/
+liObj_t *LiDeepClone( liObj_t *o ) {
+    liBlock_t b;
+    char *mem;
+    liObj_t *root;
+    
+    liassert( o );
+    
+    /* measure the subtree */
+    b.numNodes = 0;
+    b.strSize = o->key ? BlockStrSize( slen(o->key) ) : 0;
+    MeasureHelper_r( &b, o, 0 );
+    
+    /* lay it out */
+    mem = (char*)LiAlloc( b.numNodes * sizeof(liObj_t) + b.strSize,
+            LI_TYID_NODE );
+    b.node = (liObj_t*)mem;
+    b.str = mem + b.numNodes * sizeof(liObj_t);
+    root = DeepCloneHelper_r( &b, o, NULL );
+    root->key = BlockStr( &b, o->key );
+    /* the root owns the block */
+    root->flags &= ~LI_FEMBED;
+    
+    liassert( b.node == (liObj_t*)mem + b.numNodes );
+    liassert( b.str == mem + b.numNodes * sizeof(liObj_t) + b.strSize );
+    
+    return root;
+}
+
+
+
 /*
 ================================================
                     li object
@@ -628,23 +914,60 @@ void LiSetKey( liObj_t *o, const char *key ) {
 /*
 ============
 LiSetKeyL
+
+A node of a sibling run ("key = a, b") renames the
+whole run. The key is changed in place when only the
+run holds it, clones and pooled strings that share it
+keep the old text (copy on write).
 ============
 */
 void LiSetKeyL( liObj_t *o, const char *key, lisize_t len ) {
+    liObj_t *first, *it;
+    liStr_t *old, *s;
+    lisize_t numRun = 0, i;
+    
     liassert( o );
+    LiHashInvalidate( o );
     if( !key ) {
         if( o->key ) {
             LiSFree( o->key );
             o->key = NULL;
         }
+        return;
+    }
+    
+    liassert( LiIsCorrectKey( key, len ) );
+    old = o->key;
+    if( !old ) {
+        o->key = LiSNewKeyL( key, len );
+        return;
+    }
+    
+    first = o;
+    while( first->prev && first->prev->key == old ) {
+        first = first->prev;
+    }
+    for( it = first; it && it->key == old; it = it->next ) {
+        numRun++;
+    }
+    
+    if( salc(old) && snref(old) == numRun - 1 && len < salc(old) ) {
+        /* fits, a reallocation would count the key as a string */
+        s = old;
+        memmove( sstr(s), key, len );
+        slen(s) = len;
+        sstr(s)[ len ] = 0;
     } else {
-        liassert( LiIsCorrectKey( key, len ) );
-        if( o->key ) {
-            o->key = LiSSetL( o->key, key, len );
-        } else {
-            o->key = LiSNewL( key, len );
+        s = LiSNewKeyL( key, len );
+        snref(s) = numRun - 1;
+        for( i = 0; i < numRun; i++ ) {
+            LiSFree( old );
         }
     }
+    for( it = first, i = 0; i < numRun; it = it->next, i++ ) {
+        it->key = s;
+        LiHashInvalidate( it );
+    }
 }
 
 /*
@@ -654,9 +977,12 @@ LiSetFlags
 */
 void LiSetFlags( liObj_t *o, liflag_t flags ) {
     liassert( o );
-    o->flags = flags;
+    liassert( !(flags & LI_FEMBED) );
+    LiHashInvalidate( o );
+    o->flags = flags | (o->flags & LI_FEMBED);
 }
 
+#if defined(LI_CHECKED_CALLS)
 /*
 ============
 LiTypeIs
@@ -676,6 +1002,7 @@ libool_t LiIsObj( liObj_t *o ) {
     liassert( o );
     return o->type == LI_VTOBJ;
 }
+#endif
 
 /*
 ============
@@ -696,6 +1023,7 @@ static liObj_t *NodeCreate( void ) {
     node->key = NULL;
     node->type = 0;
     node->flags = 0;
+    node->hash = 0;
     
     return node;
 }
@@ -851,7 +1179,7 @@ licode_t LiFindFirst( liFindData_t *dat, liObj_t *o, const char *s ) {
     /* check if the first element is found */
     struct patternData_s *pattern = (struct patternData_s*)aarr(dat->pattern);
     if( (anum(dat->pattern) == 1) && o->key && LiSCmpL( o->key, pattern->str,
-            slen(o->key) ) ) {
+            pattern->len ) ) {
         dat->obj = o;
         return LI_OK;
     }
@@ -906,7 +1234,7 @@ licode_t LiFindNext( liFindData_t *dat ) {
         
        // Log( "%s\n", (o->key ? sstr(o->key) : "(no key)" ) );
         
-        if( o->key && LiSCmpL(o->key, pattern->str, slen(o->key)) ){
+        if( o->key && LiSCmpL(o->key, pattern->str, pattern->len) ){
             if( dat->index == (anum(dat->pattern) - 1) ) {
                 /* object found */
                 dat->obj = o;
@@ -947,699 +1275,2909 @@ licode_t LiFindClose( liFindData_t *dat ) {
 
 /*
 ================================================
-                    li writer
+                 li object hash
+
+A node caches the hash of its key, type, flags, value
+and the hashes of its children. The hash is computed on
+the first request, so a node with a hash has hashes in
+its whole subtree and a node without one has none above
+it. Changing a node clears the hashes up the parent
+chain until a node without a hash is met. Computing
+writes the cache, a tree shared by threads must be
+hashed before it is shared.
 ================================================
 */
 
 /*
 ============
-LiWriteIndent
+HashHelper_r
 ============
 */
-static licode_t LiWriteIndent( liFile_t f, fnLiWrite wr, int indent ) {
-    int i;
-    for( i = 0; i < indent; i++ ) {
-        ssize_t ret = wr( "    ", 4, f );
-        if( ret < 0 ) {
-            return LI_EWRITE;
-        }
+static uint64_t HashHelper_r( liObj_t *o, int level ) {
+    uint64_t h = LI_HASH_INIT;
+    uint64_t ch;
+    liObj_t *it;
+    
+    if( o->hash ) {
+        return o->hash;
     }
-    return LI_OK;
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    if( o->key ) {
+        h = HashBytes( sstr(o->key), slen(o->key), h );
+    }
+    h = HashBytes( &o->type, sizeof(o->type), h );
+    ch = o->flags & ~LI_FEMBED;
+    h = HashBytes( &ch, sizeof(ch), h );
+    switch( o->type ) {
+        case LI_VTSTR:
+            if( o->vstr ) {
+                h = HashBytes( sstr(o->vstr), slen(o->vstr), h );
+            }
+            break;
+        case LI_VTINT:
+        case LI_VTUINT:
+        case LI_VTBOOL:
+            h = HashBytes( &o->vuint, sizeof(o->vuint), h );
+            break;
+        default:
+            break;
+    }
+    for( it = o->firstChild; it; it = it->next ) {
+        ch = HashHelper_r( it, level + 1 );
+        h = HashBytes( &ch, sizeof(ch), h );
+    }
+    
+    /* 0 is not computed */
+    o->hash = h ? h : 1;
+    return o->hash;
 }
 
 /*
 ============
-LiWriteStr
+LiHash
 ============
 */
-static licode_t LiWriteStr( liFile_t f, fnLiWrite wr,
-        const char *s, lisize_t len ) {
-    liassert( s );
-    ssize_t ret = wr( s, len, f );
-    if( ret < 0 ) {
-        return LI_EWRITE;
-    }
-    return LI_OK;
+uint64_t LiHash( liObj_t *o ) {
+    liassert( o );
+    return HashHelper_r( o, 0 );
 }
 
 /*
 ============
-LiWriteCstr
+LiHashInvalidate
+
+Must be called after a value is changed directly
 ============
 */
-static licode_t LiWriteCstr( liFile_t f, fnLiWrite wr, const char *s ) {
-    liassert( s );
-    return LiWriteStr( f, wr, s, (lisize_t)StrLen(s) );
+void LiHashInvalidate( liObj_t *o ) {
+    while( o && o->hash ) {
+        o->hash = 0;
+        o = o->parent;
+    }
 }
 
 /*
 ============
-LiWriteLiStr
+StrEqual
 ============
 */
-static licode_t LiWriteLiStr( liFile_t f, fnLiWrite wr, liStr_t *s ) {
-    liassert( s );
-    return LiWriteStr( f, wr, sstr(s), slen(s) );
+static libool_t StrEqual( liStr_t *a, liStr_t *b ) {
+    if( a == b ) {
+        return litrue;
+    }
+    if( !a || !b || slen(a) != slen(b) ) {
+        return lifalse;
+    }
+    return memcmp( sstr(a), sstr(b), slen(a) ) == 0;
 }
 
 /*
 ============
-LiWriteInt
+EqualHelper_r
 ============
 */
-static licode_t LiWriteInt( liFile_t f, fnLiWrite wr, liObj_t *o ) {
-    char buf[256];
-    char *p = buf;
-    
-    liassert( o->firstChild == NULL );
-    liassert( o->type == LI_VTINT );
+static libool_t EqualHelper_r( liObj_t *a, liObj_t *b, int level ) {
+    liObj_t *ia, *ib;
     
-    if( o->flags & LI_FSIGN ) {
-        if( o->vint >= 0 ) {
-            *p++ = '+';
+    if( a == b ) {
+        return litrue;
+    }
+    if( a->hash != b->hash || a->type != b->type ||
+            ((a->flags ^ b->flags) & ~LI_FEMBED) ) {
+        return lifalse;
+    }
+    if( !StrEqual( a->key, b->key ) ) {
+        return lifalse;
+    }
+    switch( a->type ) {
+        case LI_VTSTR:
+            if( !StrEqual( a->vstr, b->vstr ) ) {
+                return lifalse;
+            }
+            break;
+        case LI_VTINT:
+        case LI_VTUINT:
+        case LI_VTBOOL:
+            if( a->vuint != b->vuint ) {
+                return lifalse;
+            }
+            break;
+        default:
+            break;
+    }
+    for( ia = a->firstChild, ib = b->firstChild; ia && ib;
+            ia = ia->next, ib = ib->next ) {
+        if( !EqualHelper_r( ia, ib, level + 1 ) ) {
+            return lifalse;
         }
     }
-
-    Int64ToStr( o->vint, p, 10 );
-    return LiWriteCstr( f, wr, buf );
+    return ia == ib;
 }
 
 /*
 ============
-LiWriteUint
+LiEqual
+
+Compares the subtrees with their keys. Different
+hashes answer at once, equal ones are confirmed by
+comparing the nodes.
 ============
 */
-static licode_t LiWriteUint( liFile_t f, fnLiWrite wr, liObj_t *o ) {
-    int baseType = o->flags & LI_FBASE_MASK;
-    int base = 10;
-    char buf[256];
-    char *p = buf;
-    
-    liassert( o->firstChild == NULL );
-    liassert( o->type == LI_VTUINT );
-    
-    switch( baseType ) {
-        case LI_FOCT:
-            *p++ = '0';
-            base = 8;
-            break;
-            
-        case LI_FBIN:
-            *p++ = '0';
-            *p++ = 'b';
-            base = 2;
-            break;
-            
-        case LI_FHEX:
-            *p++ = '0';
-            *p++ = 'x';
-            base = 16;
-            break;
-        default:
-            /* LI_FDEC */
-            base = 10;
-            break;
+libool_t LiEqual( liObj_t *a, liObj_t *b ) {
+    liassert( a );
+    liassert( b );
+    if( LiHash( a ) != LiHash( b ) ) {
+        return lifalse;
     }
+    return EqualHelper_r( a, b, 0 );
+}
+
+
+
+/*
+================================================
+                  li dedup
+
+Nodes are linked into their place, so equal subtrees
+cannot share nodes. They share their keys and string
+values instead, which are reference counted and copied
+on write (LiSetKeyL). A subtree equal to one seen before
+takes the strings from it node by node, the others go
+through a string pool. Neighbour nodes that were not
+one run keep different key pointers.
+================================================
+*/
+
+typedef struct {
+    liSPool_t   pool;
+    liObj_t     **subtrees; /* seen objects by hash */
+    lisize_t    size;
+    lisize_t    num;
+    size_t      saved;      /* freed bytes */
+} liDedup_t;
 
-    UInt64ToStr( o->vuint, p, base );
-    return LiWriteCstr( f, wr, buf );
+/*
+============
+DedupRelease
+============
+*/
+static void DedupRelease( liDedup_t *d, liStr_t *s ) {
+    if( !snref(s) && salc(s) ) {
+        d->saved += sizeof(liStr_t) + salc(s);
+    }
+    LiSFree( s );
 }
 
 /*
 ============
-WriteHelper_r
+DedupSubtree
+
+Returns the seen subtree equal to o or adds o
 ============
 */
-static licode_t WriteHelper_r( liFile_t f, fnLiWrite wr, 
-        liObj_t *o, liflag_t flags, int level ) {
-    licode_t code = LI_OK;
-    int nl = 1;
+static liObj_t *DedupSubtree( liDedup_t *d, liObj_t *o ) {
+    liObj_t **old = d->subtrees;
+    lisize_t oldSize = d->size;
+    uint64_t h = LiHash( o );
+    lisize_t i, j;
     
-    liverifya( level <= LI_MAX_NESTING_LEVEL,
-        "error: the nesting level is too high. "
-        "check the tree for looping levels or increase "
-        "the constant LI_MAX_NESTING_LEVEL. "
-        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    if( (d->num + 1) * 2 > d->size ) {
+        d->size = oldSize ? oldSize * 2 : 256;
+        d->subtrees = (liObj_t**)LiAlloc( d->size * sizeof(liObj_t*), 
+                LI_TYID_DICT );
+        memset( d->subtrees, 0, d->size * sizeof(liObj_t*) );
+        for( i = 0; i < oldSize; i++ ) {
+            if( !old[i] ) {
+                continue;
+            }
+            j = (lisize_t)old[i]->hash & (d->size - 1);
+            while( d->subtrees[j] ) {
+                j = (j + 1) & (d->size - 1);
+            }
+            d->subtrees[j] = old[i];
+        }
+        if( old ) {
+            LiDealloc( old );
+        }
+    }
     
-    do {
-        if( nl ) {
-            LiWriteIndent( f, wr, level );
+    for( j = (lisize_t)h & (d->size - 1); d->subtrees[j]; 
+            j = (j + 1) & (d->size - 1) ) {
+        if( d->subtrees[j]->hash == h && LiEqual( d->subtrees[j], o ) ) {
+            return d->subtrees[j];
+        }
+    }
+    d->subtrees[j] = o;
+    d->num++;
+    return NULL;
+}
+
+/*
+============
+DedupKey
+
+oldPrev - the key of the previous node before dedup,
+from - the key of the node of an equal subtree
+============
+*/
+static void DedupKey( liDedup_t *d, liObj_t *o, liStr_t *oldPrev, 
+        liStr_t *from ) {
+    liStr_t *key = o->key;
+    liStr_t *avoid = o->prev ? o->prev->key : NULL;
+    
+    if( !key ) {
+        return;
+    }
+    if( o->prev && oldPrev == key ) {
+        /* the run goes on */
+        key = o->prev->key;
+    } else if( from && from != avoid ) {
+        key = from;
+    } else {
+        o->key = LiSPoolRef( &d->pool, key, avoid, LI_TYID_KEY );
+        DedupRelease( d, key );
+        return;
+    }
+    if( key != o->key ) {
+        LiSRef( key );
+        DedupRelease( d, o->key );
+        o->key = key;
+    }
+}
+
+/*
+============
+DedupValue
+============
+*/
+static void DedupValue( liDedup_t *d, liObj_t *o, liStr_t *from ) {
+    liStr_t *s = o->vstr;
+    
+    if( o->type != LI_VTSTR || !s ) {
+        return;
+    }
+    o->vstr = from ? LiSRef( from ) : LiSPoolRef( &d->pool, s, NULL,
+            LI_TYID_STR );
+    DedupRelease( d, s );
+}
+
+/*
+============
+DedupShare_r
+
+Takes the strings of the equal subtree from
+============
+*/
+static void DedupShare_r( liDedup_t *d, liObj_t *from, liObj_t *o, 
+        int level ) {
+    liObj_t *itf, *ito;
+    liStr_t *oldPrev = NULL;
+    liStr_t *key;
+    
+    for( itf = from->firstChild, ito = o->firstChild; itf && ito;
+            itf = itf->next, ito = ito->next ) {
+        key = ito->key;
+        DedupKey( d, ito, oldPrev, itf->key );
+        oldPrev = key;
+        DedupValue( d, ito, itf->vstr );
+        DedupShare_r( d, itf, ito, level + 1 );
+    }
+}
+
+/*
+============
+DedupList_r
+============
+*/
+static void DedupList_r( liDedup_t *d, liObj_t *first, int level ) {
+    liObj_t *it, *seen;
+    liStr_t *oldPrev = NULL;
+    liStr_t *key;
+    
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    for( it = first; it; it = it->next ) {
+        key = it->key;
+        DedupKey( d, it, oldPrev, NULL );
+        oldPrev = key;
+        DedupValue( d, it, NULL );
+        if( !it->firstChild ) {
+            continue;
+        }
+        seen = DedupSubtree( d, it );
+        if( seen ) {
+            DedupShare_r( d, seen, it, level + 1 );
+        } else {
+            DedupList_r( d, it->firstChild, level + 1 );
+        }
+    }
+}
+
+/*
+============
+LiDedup
+
+Shares the equal keys and strings of the tree of o,
+returns the number of freed bytes. String values must
+not be changed in place afterwards.
+============
+*/
+size_t LiDedup( liObj_t *o ) {
+    liassert( o );
+    liDedup_t d;
+    
+    LiSPoolInit( &d.pool );
+    d.subtrees = NULL;
+    d.size = 0;
+    d.num = 0;
+    d.saved = 0;
+    DedupList_r( &d, LiFirst( LiRoot( o ) ), 0 );
+    if( d.subtrees ) {
+        LiDealloc( d.subtrees );
+    }
+    LiSPoolFree( &d.pool );
+    
+    return d.saved;
+}
+
+
+
+/*
+================================================
+                li memory usage
+
+Shared keys and strings are charged in equal parts to
+every reference, so the usage of disjoint subtrees adds
+up to the usage of the tree.
+================================================
+*/
+
+/*
+============
+StrUsage
+============
+*/
+static size_t StrUsage( liStr_t *s ) {
+    size_t size = sizeof(liStr_t) + (salc(s) ? salc(s) : slen(s) + 1);
+    return size / ((size_t)snref(s) + 1);
+}
+
+/*
+============
+UsageHelper_r
+============
+*/
+static void UsageHelper_r( liMemUsage_t *u, liObj_t *o, int level ) {
+    liObj_t *it;
+    
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    u->nodes += sizeof(liObj_t);
+    if( o->key ) {
+        u->keys += StrUsage( o->key );
+    }
+    if( o->type == LI_VTSTR && o->vstr ) {
+        u->strings += StrUsage( o->vstr );
+    }
+    for( it = o->firstChild; it; it = it->next ) {
+        UsageHelper_r( u, it, level + 1 );
+    }
+}
+
+/*
+============
+LiMemUsage
+
+Returns the bytes used by the node and its subtree,
+usage (may be NULL) gets them by kind
+============
+*/
+size_t LiMemUsage( liObj_t *o, liMemUsage_t *usage ) {
+    liassert( o );
+    liMemUsage_t u = { 0, 0, 0 };
+    
+    UsageHelper_r( &u, o, 0 );
+    if( usage ) {
+        *usage = u;
+    }
+    
+    return u.nodes + u.keys + u.strings;
+}
+
+
+
+/*
+================================================
+                    li writer
+================================================
+*/
+
+/* output buffer */
+typedef struct {
+    liFile_t    f;
+    fnLiWrite   wr;         /* NULL - the buffer grows instead */
+    char        *buf;
+    size_t      len;        /* used bytes */
+    size_t      size;       /* size of the buffer */
+    licode_t    code;       /* first error */
+} liOut_t;
+
+#define LI_INDENT_TABLE_LEVELS  32
+
+static const char liIndentTable[LI_INDENT_TABLE_LEVELS * 4 + 1] =
+    "                                                                "
+    "                                                                ";
+
+/*
+============
+OutInit
+============
+*/
+static void OutInit( liOut_t *out, liFile_t f, fnLiWrite wr, size_t size ) {
+    out->f = f;
+    out->wr = wr;
+    out->size = size ? size : LI_WRITE_BUF_SIZE;
+    out->buf = (char*)LiAlloc( out->size, LI_TYID_BUF );
+    out->len = 0;
+    out->code = LI_OK;
+}
+
+/*
+============
+OutInitMem
+
+Output that is collected in memory
+============
+*/
+static void OutInitMem( liOut_t *out, size_t size ) {
+    OutInit( out, NULL, NULL, size );
+}
+
+/*
+============
+OutGrow
+============
+*/
+static void OutGrow( liOut_t *out, size_t need ) {
+    size_t size = out->size * 2;
+    
+    if( size < need ) {
+        size = need;
+    }
+    out->buf = (char*)LiRealloc( out->buf, size, LI_TYID_BUF );
+    out->size = size;
+}
+
+/*
+============
+OutFlush
+============
+*/
+static licode_t OutFlush( liOut_t *out ) {
+    if( out->len && out->code == LI_OK ) {
+        if( out->wr( out->buf, out->len, out->f ) != (ssize_t)out->len ) {
+            out->code = LI_EWRITE;
+        }
+    }
+    out->len = 0;
+    return out->code;
+}
+
+/*
+============
+OutFinish
+
+Flushes the buffer and ends the output with a write
+of size 0, backends that write in the background
+return their errors there
+============
+*/
+static licode_t OutFinish( liOut_t *out ) {
+    if( OutFlush( out ) == LI_OK && out->wr( out->buf, 0, out->f ) < 0 ) {
+        out->code = LI_EWRITE;
+    }
+    return out->code;
+}
+
+/*
+============
+OutFree
+============
+*/
+static void OutFree( liOut_t *out ) {
+    LiDealloc( out->buf );
+    out->buf = NULL;
+}
+
+/*
+============
+LiWriteStr
+============
+*/
+static void LiWriteStr( liOut_t *out, const char *s, size_t len ) {
+    liassert( s );
+    
+    if( out->len + len > out->size ) {
+        if( !out->wr ) {
+            OutGrow( out, out->len + len );
+            MemCpy( out->buf + out->len, s, len );
+            out->len += len;
+            return;
+        }
+        OutFlush( out );
+        if( len > out->size ) {
+            /* does not fit the buffer, write as is */
+            if( out->code == LI_OK &&
+                    out->wr( s, len, out->f ) != (ssize_t)len ) {
+                out->code = LI_EWRITE;
+            }
+            return;
+        }
+    }
+    MemCpy( out->buf + out->len, s, len );
+    out->len += len;
+}
+
+/* write string literal */
+#define LiWriteLit(out,s)   LiWriteStr( out, s, sizeof(s) - 1 )
+
+/*
+============
+LiWriteIndent
+============
+*/
+static void LiWriteIndent( liOut_t *out, int indent ) {
+    while( indent > LI_INDENT_TABLE_LEVELS ) {
+        LiWriteStr( out, liIndentTable, LI_INDENT_TABLE_LEVELS * 4 );
+        indent -= LI_INDENT_TABLE_LEVELS;
+    }
+    LiWriteStr( out, liIndentTable, (size_t)indent * 4 );
+}
+
+/*
+============
+LiWriteLiStr
+============
+*/
+static void LiWriteLiStr( liOut_t *out, liStr_t *s ) {
+    liassert( s );
+    LiWriteStr( out, sstr(s), slen(s) );
+}
+
+/*
+============
+LiWriteEscStr
+
+Writes the body of a quoted string with the escapes
+ParseString reads back: \" \\ \n \t \r and \xHH for
+the other control characters
+============
+*/
+static void LiWriteEscStr( liOut_t *out, const char *s, size_t len ) {
+    static const char hex[] = "0123456789abcdef";
+    size_t i, start = 0;
+    char esc[4];
+    size_t escLen;
+    
+    for( i = 0; i < len; i++ ) {
+        unsigned char ch = (unsigned char)s[i];
+        if( ch >= 32 && ch != 127 && ch != '"' && ch != '\\' ) {
+            continue;
+        }
+        esc[0] = '\\';
+        escLen = 2;
+        switch( ch ) {
+            case '"':   esc[1] = '"';   break;
+            case '\\':  esc[1] = '\\';  break;
+            case '\n':  esc[1] = 'n';   break;
+            case '\t':  esc[1] = 't';   break;
+            case '\r':  esc[1] = 'r';   break;
+            default:
+                esc[1] = 'x';
+                esc[2] = hex[ch >> 4];
+                esc[3] = hex[ch & 15];
+                escLen = 4;
+                break;
+        }
+        /* the plain run before the escape */
+        LiWriteStr( out, s + start, i - start );
+        LiWriteStr( out, esc, escLen );
+        start = i + 1;
+    }
+    LiWriteStr( out, s + start, len - start );
+}
+
+/*
+============
+LiWriteInt
+============
+*/
+static void LiWriteInt( liOut_t *out, int64_t v, liflag_t flags ) {
+    char buf[256];
+    char *p = buf;
+    
+    if( flags & LI_FSIGN ) {
+        if( v >= 0 ) {
+            *p++ = '+';
+        }
+    }
+
+    p += Int64ToStr( v, p, 10 );
+    LiWriteStr( out, buf, (size_t)(p - buf) );
+}
+
+/*
+============
+LiWriteUint
+============
+*/
+static void LiWriteUint( liOut_t *out, uint64_t v, liflag_t flags ) {
+    int baseType = flags & LI_FBASE_MASK;
+    int base = 10;
+    char buf[256];
+    char *p = buf;
+    
+    switch( baseType ) {
+        case LI_FOCT:
+            *p++ = '0';
+            base = 8;
+            break;
+            
+        case LI_FBIN:
+            *p++ = '0';
+            *p++ = 'b';
+            base = 2;
+            break;
+            
+        case LI_FHEX:
+            *p++ = '0';
+            *p++ = 'x';
+            base = 16;
+            break;
+        default:
+            /* LI_FDEC */
+            base = 10;
+            break;
+    }
+
+    p += UInt64ToStr( v, p, base );
+    LiWriteStr( out, buf, (size_t)(p - buf) );
+}
+
+/*
+============
+WriteKey
+
+The first node of a sibling run starts a line with
+its key, the others continue the line
+============
+*/
+static void WriteKey( liOut_t *out, liObj_t *o, int level ) {
+    if( !o->prev || (o->prev->key != o->key) ) {
+        LiWriteIndent( out, level );
+        LiWriteLiStr( out, o->key );
+        LiWriteLit( out, " = " );
+    } else {
+        LiWriteLit( out, ", " );
+    }
+}
+
+/*
+============
+WriteEndLine
+
+The last node of a sibling run ends the line
+============
+*/
+static void WriteEndLine( liOut_t *out, liObj_t *o ) {
+    if( !o->next || (o->next->key != o->key) ) {
+        LiWriteLit( out, "\n" );
+    }
+}
+
+/*
+============
+WriteHelper_r
+
+Writes the nodes from o to last (NULL - to the end of
+the sibling list). The text of a node only depends on
+the node, its neighbours and the level.
+============
+*/
+static licode_t WriteHelper_r( liOut_t *out, liObj_t *o, liObj_t *last,
+        liflag_t flags, int level ) {
+    licode_t code = LI_OK;
+    
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    while( 1 ) {
+        WriteKey( out, o, level );
+        
+        switch( o->type ) {
+            case LI_VTNULL:
+                liassert( o->firstChild == NULL );
+                LiWriteLit( out, "null" );
+                break;
+                
+            case LI_VTOBJ:
+                if( o->firstChild ) {
+                    /* begin of object */
+                    LiWriteLit( out, "{\n" );
+                    code = WriteHelper_r( out, o->firstChild, NULL,
+                            flags, level + 1 );
+                    if( code != LI_OK ) {
+                        return code;
+                    }
+                    LiWriteIndent( out, level );
+                    /* end of object */
+                    LiWriteLit( out, "}" );
+                } else {
+                    /* empty object */
+                    LiWriteLit( out, "{}\n" );
+                }
+                break;
+                
+            case LI_VTSTR:
+                liassert( o->firstChild == NULL );
+                LiWriteLit( out, "\"" );
+                if( o->vstr ) {
+                    LiWriteEscStr( out, sstr(o->vstr), slen(o->vstr) );
+                }
+                LiWriteLit( out, "\"" );
+                break;
+                
+            case LI_VTINT: 
+                liassert( o->firstChild == NULL );
+                LiWriteInt( out, o->vint, o->flags );
+                break;
+                
+            case LI_VTUINT:
+                liassert( o->firstChild == NULL );
+                LiWriteUint( out, o->vuint, o->flags );
+                break;
+            
+            case LI_VTBOOL:
+                liassert( o->firstChild == NULL );
+                if( o->vint ) {
+                    LiWriteLit( out, "true" );
+                } else {
+                    LiWriteLit( out, "false" );
+                }
+                break;
+                
+            default:
+                liverifya( 0, "error: nuknown object type [%d]", o->type );
+        }
+        
+        WriteEndLine( out, o );
+        
+        if( out->code != LI_OK ) {
+            return out->code;
+        }
+        if( o == last || (o = o->next) == NULL ) {
+            break;
+        }
+    }
+    
+    return code;
+}
+
+/*
+============
+WriteMinHelper_r
+
+Writes without whitespace: key=value, run values are
+separated with a comma. Strings and objects end with
+a delimiter, other values need a space before the
+next key.
+============
+*/
+static licode_t WriteMinHelper_r( liOut_t *out, liObj_t *o, int level ) {
+    licode_t code = LI_OK;
+    int bare = 0;   /* last value ends with a key character */
+    
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    do {
+        /* write key */
+        if( !o->prev || (o->prev->key != o->key) ) {
+            if( bare ) {
+                LiWriteLit( out, " " );
+            }
+            LiWriteLiStr( out, o->key );
+            LiWriteLit( out, "=" );
+        } else {
+            LiWriteLit( out, "," );
+        }
+        bare = 1;
+        
+        switch( o->type ) {
+            case LI_VTNULL:
+                liassert( o->firstChild == NULL );
+                LiWriteLit( out, "null" );
+                break;
+                
+            case LI_VTOBJ:
+                LiWriteLit( out, "{" );
+                if( o->firstChild ) {
+                    code = WriteMinHelper_r( out, o->firstChild, level + 1 );
+                    if( code != LI_OK ) {
+                        return code;
+                    }
+                }
+                LiWriteLit( out, "}" );
+                bare = 0;
+                break;
+                
+            case LI_VTSTR:
+                liassert( o->firstChild == NULL );
+                LiWriteLit( out, "\"" );
+                if( o->vstr ) {
+                    LiWriteEscStr( out, sstr(o->vstr), slen(o->vstr) );
+                }
+                LiWriteLit( out, "\"" );
+                bare = 0;
+                break;
+                
+            case LI_VTINT: 
+                liassert( o->firstChild == NULL );
+                LiWriteInt( out, o->vint, o->flags );
+                break;
+                
+            case LI_VTUINT:
+                liassert( o->firstChild == NULL );
+                LiWriteUint( out, o->vuint, o->flags );
+                break;
+            
+            case LI_VTBOOL:
+                liassert( o->firstChild == NULL );
+                if( o->vint ) {
+                    LiWriteLit( out, "true" );
+                } else {
+                    LiWriteLit( out, "false" );
+                }
+                break;
+                
+            default:
+                liverifya( 0, "error: nuknown object type [%d]", o->type );
         }
         
-        nl = 1;
-        
-        /* write key */
-        if( !o->prev || (o->prev->key != o->key) ) {
-            LiWriteLiStr( f, wr, o->key );
-            LiWriteCstr( f, wr, " = " );
+        if( out->code != LI_OK ) {
+            return out->code;
+        }
+    } while( (o = o->next) != NULL );
+    
+    return code;
+}
+
+/* write segment kinds */
+#define SEG_NODES       0   /* nodes first..last, written by a worker */
+#define SEG_HEAD        1   /* "key = {" of a split object */
+#define SEG_TAIL        2   /* "}" of a split object */
+
+/* parallel write segment */
+typedef struct {
+    int         kind;
+    liObj_t     *first;
+    liObj_t     *last;
+    int         level;
+    liOut_t     out;        /* SEG_NODES text */
+    libool_t    inPlace;    /* SEG_NODES written by the calling thread */
+    int         done;
+} liWriteSeg_t;
+
+/* parallel write */
+typedef struct {
+    liWriteSeg_t    *segs;
+    int             numSegs;
+    int             *tasks;     /* indices of SEG_NODES segments */
+    int             numTasks;
+    atomic_int      nextTask;
+    liflag_t        flags;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} liParWrite_t;
+
+/*
+============
+CountNodes_r
+============
+*/
+static size_t CountNodes_r( liObj_t *o, int level ) {
+    size_t n = 1;
+    
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    for( o = o->firstChild; o; o = o->next ) {
+        n += CountNodes_r( o, level + 1 );
+    }
+    return n;
+}
+
+/*
+============
+AddSeg
+============
+*/
+static void AddSeg( liParWrite_t *pw, int *alloced, int kind,
+        liObj_t *first, liObj_t *last, int level ) {
+    liWriteSeg_t *seg;
+    
+    if( pw->numSegs == *alloced ) {
+        *alloced *= 2;
+        pw->segs = (liWriteSeg_t*)LiRealloc( pw->segs,
+                sizeof(liWriteSeg_t) * *alloced, LI_TYID_BUF );
+    }
+    seg = pw->segs + pw->numSegs++;
+    seg->kind = kind;
+    seg->first = first;
+    seg->last = last;
+    seg->level = level;
+    seg->inPlace = lifalse;
+    seg->done = 0;
+}
+
+/*
+============
+AddBatches
+
+Splits the sibling list into runs of about batchSize nodes
+============
+*/
+static void AddBatches( liParWrite_t *pw, int *alloced, liObj_t *o,
+        int level, size_t batchSize ) {
+    liObj_t *first = o;
+    size_t n = 0;
+    
+    for( ; o; o = o->next ) {
+        n += CountNodes_r( o, level );
+        if( n >= batchSize || !o->next ) {
+            AddSeg( pw, alloced, SEG_NODES, first, o, level );
+            first = o->next;
+            n = 0;
+        }
+    }
+}
+
+/*
+============
+ParWorker
+
+The segment texts are allocated with the global
+allocator, the thread allocator of the caller may be
+an arena that is not thread-safe
+============
+*/
+static void *ParWorker( void *arg ) {
+    liParWrite_t *pw = (liParWrite_t*)arg;
+    liWriteSeg_t *seg;
+    liAlloc_t *prev;
+    int i;
+    
+    prev = LiSetThreadAllocator( NULL );
+    while( (i = atomic_fetch_add( &pw->nextTask, 1 )) < pw->numTasks ) {
+        seg = pw->segs + pw->tasks[i];
+        OutInitMem( &seg->out, 0 );
+        WriteHelper_r( &seg->out, seg->first, seg->last, pw->flags,
+                seg->level );
+        
+        pthread_mutex_lock( &pw->lock );
+        seg->done = 1;
+        pthread_cond_broadcast( &pw->cond );
+        pthread_mutex_unlock( &pw->lock );
+    }
+    LiSetThreadAllocator( prev );
+    
+    return NULL;
+}
+
+/*
+============
+WriteParallel
+
+Top-level objects are split into their children, which
+are written in batches on worker threads into memory.
+The calling thread writes the results in order, so the
+text is the same as from WriteHelper_r.
+============
+*/
+static licode_t WriteParallel( liOut_t *out, liObj_t *o, liflag_t flags,
+        int numThreads ) {
+    liParWrite_t pw;
+    pthread_t threads[LI_MAX_WRITE_THREADS];
+    liWriteSeg_t *seg;
+    liAlloc_t *prev;
+    liObj_t *it;
+    size_t total = 0;
+    size_t batchSize;
+    int alloced = 64;
+    int started = 0;
+    int i;
+    
+    for( it = o; it; it = it->next ) {
+        total += CountNodes_r( it, 0 );
+    }
+    if( numThreads <= 1 || total < LI_PARALLEL_MIN_NODES ) {
+        return WriteHelper_r( out, o, NULL, flags, 0 );
+    }
+    batchSize = total / ((size_t)numThreads * 8);
+    if( batchSize < 256 ) {
+        batchSize = 256;
+    }
+    
+    /* cut the tree into segments */
+    pw.segs = (liWriteSeg_t*)LiAlloc( sizeof(liWriteSeg_t) * alloced,
+            LI_TYID_BUF );
+    pw.numSegs = 0;
+    for( it = o; it; it = it->next ) {
+        if( it->type == LI_VTOBJ && it->firstChild ) {
+            AddSeg( &pw, &alloced, SEG_HEAD, it, it, 0 );
+            AddBatches( &pw, &alloced, it->firstChild, 1, batchSize );
+            AddSeg( &pw, &alloced, SEG_TAIL, it, it, 0 );
+        } else {
+            /* small top-level nodes are written in place */
+            AddSeg( &pw, &alloced, SEG_NODES, it, it, 0 );
+            pw.segs[ pw.numSegs - 1 ].inPlace = litrue;
+        }
+    }
+    pw.tasks = (int*)LiAlloc( sizeof(int) * pw.numSegs, LI_TYID_BUF );
+    pw.numTasks = 0;
+    for( i = 0; i < pw.numSegs; i++ ) {
+        if( pw.segs[i].kind == SEG_NODES && !pw.segs[i].inPlace ) {
+            pw.tasks[ pw.numTasks++ ] = i;
+        }
+    }
+    atomic_init( &pw.nextTask, 0 );
+    pw.flags = flags;
+    pthread_mutex_init( &pw.lock, NULL );
+    pthread_cond_init( &pw.cond, NULL );
+    
+    if( numThreads > pw.numTasks ) {
+        numThreads = pw.numTasks;
+    }
+    for( i = 0; i < numThreads; i++ ) {
+        if( pthread_create( threads + i, NULL, ParWorker, &pw ) != 0 ) {
+            break;
+        }
+        started++;
+    }
+    if( !started ) {
+        /* no threads, do the work here */
+        ParWorker( &pw );
+    }
+    
+    /* write the segments in order */
+    for( i = 0; i < pw.numSegs; i++ ) {
+        seg = pw.segs + i;
+        switch( seg->kind ) {
+            case SEG_HEAD:
+                WriteKey( out, seg->first, seg->level );
+                LiWriteLit( out, "{\n" );
+                break;
+                
+            case SEG_TAIL:
+                LiWriteIndent( out, seg->level );
+                LiWriteLit( out, "}" );
+                WriteEndLine( out, seg->first );
+                break;
+                
+            default:
+                if( seg->inPlace ) {
+                    WriteHelper_r( out, seg->first, seg->last, flags,
+                            seg->level );
+                    break;
+                }
+                pthread_mutex_lock( &pw.lock );
+                while( !seg->done ) {
+                    pthread_cond_wait( &pw.cond, &pw.lock );
+                }
+                pthread_mutex_unlock( &pw.lock );
+                LiWriteStr( out, seg->out.buf, seg->out.len );
+                /* given back to the global allocator like ParWorker */
+                prev = LiSetThreadAllocator( NULL );
+                OutFree( &seg->out );
+                LiSetThreadAllocator( prev );
+                break;
+        }
+    }
+    
+    for( i = 0; i < started; i++ ) {
+        pthread_join( threads[i], NULL );
+    }
+    pthread_cond_destroy( &pw.cond );
+    pthread_mutex_destroy( &pw.lock );
+    LiDealloc( pw.tasks );
+    LiDealloc( pw.segs );
+    
+    return out->code;
+}
+
+/*
+============
+NumThreads
+
+maxThreads - upper limit of the caller's thread table
+============
+*/
+static int NumThreads( int numThreads, int maxThreads ) {
+    if( numThreads <= 0 ) {
+#if defined(_SC_NPROCESSORS_ONLN)
+        numThreads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+#else
+        numThreads = 4;
+#endif
+    }
+    if( numThreads > maxThreads ) {
+        numThreads = maxThreads;
+    }
+    return numThreads;
+}
+
+/* compressed file opened with LiZipOpen */
+static liIO_t liZipIO = {
+    NULL,
+    LiZipClose,
+    LiZipRead,
+    LiZipWrite,
+    LiZipAcquire,
+    LiZipRelease
+};
+
+/*
+============
+WriteFile
+
+bufSize - size of the output buffer (0 - LI_WRITE_BUF_SIZE)
+numThreads - threads for LI_FPARALLEL (0 - number of CPUs)
+============
+*/
+static licode_t WriteFile( liIO_t *io, liObj_t *o, const char *name,
+        liflag_t flags, size_t bufSize, int numThreads ) {
+    liFile_t f;
+    liOut_t out;
+    licode_t code = LI_OK;
+    
+    if( io == NULL ) {
+        extern liIO_t liDefaultIO;
+        io = &liDefaultIO;
+    }
+    
+    if( flags & (LI_FLZ | LI_FGZIP) ) {
+        f = LiZipOpen( io, name, 'w', flags );
+        io = &liZipIO;
+    } else {
+        f = io->open( name, 'w' );
+    }
+    if( f == NULL ) {
+        return LI_EFILEOPEN;
+    }
+    if( o ) {
+        OutInit( &out, f, io->write, bufSize );
+        if( flags & LI_FMINIFY ) {
+            code = WriteMinHelper_r( &out, o, 0 );
+            LiWriteLit( &out, "\n" );
+        } else if( flags & LI_FPARALLEL ) {
+            code = WriteParallel( &out, o, flags, 
+                    NumThreads( numThreads,
+                    LI_MAX_WRITE_THREADS ) );
+        } else {
+            code = WriteHelper_r( &out, o, NULL, flags, 0 );
+        }
+        if( OutFinish( &out ) != LI_OK ) {
+            code = out.code;
+        }
+        OutFree( &out );
+    }
+    io->close( f );
+    
+    return code;
+}
+
+/*
+============
+LiWrite
+============
+*/
+licode_t LiWrite( liObj_t *o, const char *name ) {
+    liassert(o);
+    return LiWriteEx( NULL, o, name, 0 );
+}
+
+/*
+============
+LiWriteEx
+============
+*/
+licode_t LiWriteEx( liIO_t *io, liObj_t *o, const char *name,
+        liflag_t flags ) {
+    liassert(o);
+    return WriteFile( io, o, name, flags, 0, 0 );
+}
+
+
+
+/*
+================================================
+                 li stream writer
+
+Writes the text of a tree that is never built. The
+output is the same as from LiWriteEx for the tree
+the calls describe. A NULL key continues the run of
+the previous sibling ("key = a, b"), like siblings
+that share a key pointer.
+================================================
+*/
+
+struct liWriter_t {
+    liIO_t      *io;
+    liFile_t    f;
+    liOut_t     out;
+    int         level;      /* level of the next value */
+    libool_t    line;       /* line of the last sibling is not ended */
+    libool_t    objOpen;    /* "{" of the current object not written */
+};
+
+/*
+============
+LiWriterOpen
+============
+*/
+licode_t LiWriterOpen( liWriter_t **w, liIO_t *io, const char *name ) {
+    liFile_t f;
+    
+    liassert( w );
+    
+    if( io == NULL ) {
+        extern liIO_t liDefaultIO;
+        io = &liDefaultIO;
+    }
+    
+    *w = NULL;
+    f = io->open( name, 'w' );
+    if( f == NULL ) {
+        return LI_EFILEOPEN;
+    }
+    
+    *w = (liWriter_t*)LiAlloc( sizeof(liWriter_t), LI_TYID_BUF );
+    (*w)->io = io;
+    (*w)->f = f;
+    OutInit( &(*w)->out, f, io->write, 0 );
+    (*w)->level = 0;
+    (*w)->line = lifalse;
+    (*w)->objOpen = lifalse;
+    
+    return LI_OK;
+}
+
+/*
+============
+LiWriterClose
+
+Closes the file and frees the writer. Returns the
+first write error.
+============
+*/
+licode_t LiWriterClose( liWriter_t *w ) {
+    licode_t code;
+    
+    liassert( w );
+    liasserta( w->level == 0 && !w->objOpen,
+            "error: the writer has open objects" );
+    
+    if( w->line ) {
+        LiWriteLit( &w->out, "\n" );
+    }
+    code = OutFinish( &w->out );
+    OutFree( &w->out );
+    w->io->close( w->f );
+    LiDealloc( w );
+    
+    return code;
+}
+
+/*
+============
+WriterKey
+
+Starts a value, the counterpart of WriteKey
+============
+*/
+static void WriterKey( liWriter_t *w, const char *key ) {
+    liOut_t *out = &w->out;
+    
+    if( w->objOpen ) {
+        LiWriteLit( out, "{\n" );
+        w->objOpen = lifalse;
+    }
+    
+    if( key ) {
+        liassert( LiIsCorrectKey( key, (lisize_t)StrLen(key) ) );
+        if( w->line ) {
+            LiWriteLit( out, "\n" );
+        }
+        LiWriteIndent( out, w->level );
+        LiWriteStr( out, key, StrLen(key) );
+        LiWriteLit( out, " = " );
+    } else {
+        liasserta( w->line, "error: no run to continue" );
+        LiWriteLit( out, ", " );
+    }
+    w->line = litrue;
+}
+
+/*
+============
+LiWriterBeginObject
+============
+*/
+void LiWriterBeginObject( liWriter_t *w, const char *key ) {
+    liassert( w );
+    liverifya( w->level < LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+    
+    WriterKey( w, key );
+    /* "{" waits for the first child, empty objects are "{}" */
+    w->objOpen = litrue;
+    w->line = lifalse;
+    w->level++;
+}
+
+/*
+============
+LiWriterEnd
+
+Ends the object of the last LiWriterBeginObject
+============
+*/
+void LiWriterEnd( liWriter_t *w ) {
+    liassert( w );
+    liasserta( w->level > 0, "error: no object to end" );
+    
+    w->level--;
+    if( w->objOpen ) {
+        LiWriteLit( &w->out, "{}\n" );
+        w->objOpen = lifalse;
+    } else {
+        if( w->line ) {
+            LiWriteLit( &w->out, "\n" );
+        }
+        LiWriteIndent( &w->out, w->level );
+        LiWriteLit( &w->out, "}" );
+    }
+    w->line = litrue;
+}
+
+/*
+============
+LiWriterNull
+============
+*/
+void LiWriterNull( liWriter_t *w, const char *key ) {
+    liassert( w );
+    WriterKey( w, key );
+    LiWriteLit( &w->out, "null" );
+}
+
+/*
+============
+LiWriterString
+============
+*/
+void LiWriterString( liWriter_t *w, const char *key, const char *s,
+        lisize_t len ) {
+    liassert( w );
+    liassert( s || !len );
+    WriterKey( w, key );
+    LiWriteLit( &w->out, "\"" );
+    if( len ) {
+        LiWriteEscStr( &w->out, s, len );
+    }
+    LiWriteLit( &w->out, "\"" );
+}
+
+/*
+============
+LiWriterInt
+
+flags - LI_FSIGN
+============
+*/
+void LiWriterInt( liWriter_t *w, const char *key, int64_t v,
+        liflag_t flags ) {
+    liassert( w );
+    WriterKey( w, key );
+    LiWriteInt( &w->out, v, flags );
+}
+
+/*
+============
+LiWriterUint
+
+flags - LI_FDEC, LI_FOCT, LI_FBIN or LI_FHEX
+============
+*/
+void LiWriterUint( liWriter_t *w, const char *key, uint64_t v,
+        liflag_t flags ) {
+    liassert( w );
+    WriterKey( w, key );
+    LiWriteUint( &w->out, v, flags );
+}
+
+/*
+============
+LiWriterBool
+============
+*/
+void LiWriterBool( liWriter_t *w, const char *key, libool_t b ) {
+    liassert( w );
+    WriterKey( w, key );
+    if( b ) {
+        LiWriteLit( &w->out, "true" );
+    } else {
+        LiWriteLit( &w->out, "false" );
+    }
+}
+
+/*
+============
+LiWriterObj
+
+Writes a built subtree (o and its siblings up to
+the end of the list) at the current position
+============
+*/
+licode_t LiWriterObj( liWriter_t *w, liObj_t *o ) {
+    liassert( w );
+    liassert( o );
+    
+    if( w->objOpen ) {
+        LiWriteLit( &w->out, "{\n" );
+        w->objOpen = lifalse;
+    }
+    if( w->line ) {
+        LiWriteLit( &w->out, "\n" );
+    }
+    WriteHelper_r( &w->out, o, NULL, 0, w->level );
+    /* WriteHelper_r ends the lines itself */
+    w->line = lifalse;
+    
+    return w->out.code;
+}
+
+
+
+/*
+================================================
+                    li parser
+================================================
+*/
+
+typedef struct {
+    liFile_t    f;
+    fnLiRead    rd;
+    fnLiAcquire acq;        /* the file lends its data (NULL - rd) */
+    fnLiRelease rel;
+    const char  *lent;      /* lent data */
+    const char  *lentEnd;
+    libool_t    lentEof;
+    liStr_t     *scanBuf;   /* buffered file data */
+    liStr_t     *errBuf;    
+
+    char        *tkBeg;
+    char        *tkFwd;
+    lisize_t    tkLen;
+    int         tk;
+
+    char        *lnBeg;
+    int         ln;
+    int         col;
+    
+    liStr_t     *storage;
+    
+    libool_t    chProc;     /* char processed */
+    int         lvl;        /* GetChar recursion level */
+    
+    int         tkLine;     /* position of the current token */
+    int         tkCol;
+    
+    libool_t    peeked;     /* the current token is scanned again */
+    licode_t    err;        /* parse error */
+    liSPool_t   *pool;      /* LI_FDEDUP: shared keys and strings */
+#if defined(LI_READ_STATS)
+    liReadStats_t   stats;
+#endif
+} liScan_t;
+
+#if defined(LI_READ_STATS)
+    #define ScanStat(field,n)   (scan->stats.field += (n))
+#else
+    #define ScanStat(field,n)
+#endif
+
+/*
+============
+ScanInit
+============
+*/
+static void ScanInit( liScan_t *scan, liFile_t f, liIO_t *io ) {
+    scan->f = f;
+    scan->rd = io->read;
+    scan->acq = io->release ? io->acquire : NULL;
+    scan->rel = io->release;
+    scan->lent = NULL;
+    scan->lentEnd = NULL;
+    scan->lentEof = lifalse;
+    scan->scanBuf = LiSAlloc( 1024 );
+    scan->errBuf = NULL;    
+
+    scan->tkBeg = sstr(scan->scanBuf);
+    scan->tkFwd = sstr(scan->scanBuf);
+    scan->tkLen = 0;
+    scan->tk = 0;
+
+    scan->lnBeg = sstr(scan->scanBuf);
+    scan->ln = 1;
+    scan->col = 1;
+    
+    scan->storage = NULL;
+    
+    scan->chProc = lifalse;
+    scan->lvl = 0;
+    
+    scan->tkLine = 1;
+    scan->tkCol = 1;
+    
+    scan->peeked = lifalse;
+    scan->err = LI_OK;
+    scan->pool = NULL;
+#if defined(LI_READ_STATS)
+    memset( &scan->stats, 0, sizeof(scan->stats) );
+#endif
+}
+
+/*
+============
+ScanFree
+============
+*/
+static void ScanFree( liScan_t *scan ) {
+    if( scan->lent ) {
+        scan->rel( scan->lent, scan->f );
+    }
+    if( scan->scanBuf ) {
+        LiSFree( scan->scanBuf );
+    }
+    if( scan->errBuf ) {
+        LiSFree( scan->errBuf );
+    }
+    if( scan->storage ) {
+        LiSFree( scan->storage );
+    }
+}
+
+
+#define tb      (scan->tkBeg)
+#define tf      (scan->tkFwd)
+#define tl      (scan->tkLen)
+#define tk      (scan->tk)
+#define lb      (scan->lnBeg)
+#define ln      (scan->ln)
+#define lc      (scan->col)
+
+/*
+============
+UpdateBuffer
+============
+*/
+static ssize_t UpdateBuffer( liScan_t *scan ) {
+    char *min;
+    if( lb < tb ) {
+        if( (size_t)(tb - lb) > 64 ) {
+            lb = tb - 64;
+        }
+        min = lb;
+    } else {
+        min = tb;
+    }
+    ssize_t left = min - sstr(scan->scanBuf);
+    ssize_t right = salc(scan->scanBuf) - slen(scan->scanBuf);
+    
+    liassert( left >= 0 );
+    liassert( right >= 0 );
+    
+    if( left ) {
+        ssize_t siz = slen(scan->scanBuf) - left;
+        liassert( siz > 0 );
+        /* the ranges overlap */
+        memmove( sstr(scan->scanBuf), min, siz );
+        ScanStat( bytesMoved, (uint64_t)siz );
+        tb -= left;
+        tf -= left;
+        lb -= left;
+        slen(scan->scanBuf) -= left;
+        right += left;
+    }
+    
+    ScanStat( refills, 1 );
+    if( right ) {
+        char *to = sstr(scan->scanBuf) + slen(scan->scanBuf);
+        ssize_t rsiz = scan->rd( to, right, scan->f );
+        ScanStat( reads, 1 );
+        if( rsiz < 0 ) {
+            return rsiz;
+        }
+        ScanStat( bytesRead, (uint64_t)rsiz );
+        slen(scan->scanBuf) += rsiz;
+        liassert( slen(scan->scanBuf) <= salc(scan->scanBuf) );
+        return rsiz;
+    }
+    
+    return 0;
+}
+
+/*
+============
+StoreBufData
+============
+*/
+static void StoreBufData( liScan_t *scan ) {
+    if( lb < tb ) {
+        if( (size_t)(tb - lb) > 64 ) {
+            lb = tb - 64;
+        }
+    }
+    
+    if( scan->storage ) {
+        /* a token cut by the end of the buffer */
+        ScanStat( concats, slen(scan->storage) ? 1 : 0 );
+        scan->storage = LiSCatL( scan->storage, tb, tl );
+    } else {
+        scan->storage = LiSNewL( tb, tl );
+    }
+    tb = tf;
+    tl = 0;
+}
+
+/*
+============
+NextLent
+
+Gives the lent data back and scans the next piece in
+place. A token that is cut is stored like at the end
+of a full buffer.
+============
+*/
+static ssize_t NextLent( liScan_t *scan ) {
+    const void *data;
+    ssize_t rsiz;
+    
+    if( scan->lent ) {
+        /* the cut token is copied before the piece is given back */
+        ScanStat( bytesMoved, tl );
+        StoreBufData( scan );
+        scan->rel( scan->lent, scan->f );
+        scan->lent = NULL;
+        scan->lentEnd = NULL;
+    }
+    if( scan->lentEof ) {
+        return 0;
+    }
+    
+    ScanStat( refills, 1 );
+    rsiz = scan->acq( &data, scan->f );
+    ScanStat( reads, 1 );
+    if( rsiz <= 0 ) {
+        scan->lentEof = litrue;
+        return rsiz;
+    }
+    ScanStat( bytesRead, (uint64_t)rsiz );
+    scan->lent = (const char*)data;
+    scan->lentEnd = scan->lent + rsiz;
+    /* the scanner does not write to the window */
+    tb = tf = lb = (char*)scan->lent;
+    
+    return rsiz;
+}
+
+#define CH_EOF  0x7f100000
+#define CH_ERD  0x7f200000
+
+/*
+============
+GetChar
+============
+*/
+static int GetChar( liScan_t *scan ) {
+    if( scan->acq ) {
+        if( !scan->lent || tf >= scan->lentEnd ) {
+            ssize_t rsiz = NextLent( scan );
+            if( rsiz < 0 ) {
+                return CH_ERD;
+            }
+            if( rsiz == 0 ) {
+                return CH_EOF;
+            }
+        }
+    } else if( tf >= sstr(scan->scanBuf) + slen(scan->scanBuf) ) {
+        ssize_t rsiz = UpdateBuffer( scan );
+        if( rsiz < 0 ) {
+            /* return reading error */
+            return CH_ERD;
+        }
+        if( rsiz == 0 ) {
+            if( salc(scan->scanBuf) == slen(scan->scanBuf) ) {
+                /* end of buffer */
+                StoreBufData( scan );
+                scan->lvl++;
+                liassert( scan->lvl <= 2 ); /* check recursion level */
+                int ch = GetChar( scan );
+                scan->lvl--;
+                return ch;
+            }
+            /* return end of file */
+            return CH_EOF;
+        }
+    }
+    if( !scan->chProc ) {
+        if( *tf == '\n' ) {
+            ln++;
+            lc = 1;
+            lb = tf + 1;
         } else {
-            LiWriteCstr( f, wr, ", " );
+            lc++;
+        }
+        scan->chProc = litrue;
+    }
+    return (unsigned char)*tf;
+}
+
+/*
+============
+GetNextChar
+============
+*/
+static int GetNextChar( liScan_t *scan ) {
+    tf++;
+    scan->chProc = lifalse;
+    return GetChar( scan );
+}
+
+
+
+#define TK_ERD      0x80000000
+#define TK_EOF      0x71000000
+#define TK_STR      0x72000000
+#define TK_KEY      0x73000000
+#define TK_ERR      0x74000000
+#define TK_NUM      0x75000000
+
+/*
+============
+ScanKeyword
+============
+*/
+static int ScanKeyword( liScan_t *scan ) {
+    int ch = GetChar( scan );
+    liassert( is_firstkeych( (char)ch ) );
+    tb = tf;
+    tl = 1;
+    while( 1 ) {
+        ch = GetNextChar( scan );
+        if( !is_nextkeych( (char)ch ) ) {
+            break;
         }
-        if( o->next && (o->next->key == o->key) ) {
-            nl = 0;
+        tl++;
+    }
+    /* store string to storage and return */
+    StoreBufData( scan );
+    return TK_KEY;
+}
+
+/*
+============
+ScanNumber
+
+0x123123        hex (int)
+0123            oct (int)
+[+/-]123123     dec (int)
+[+/-]123.123        (double)
+[+/-](nan/inf/inf)  (double)
+[+/-]1e[+/-]12           (double)
+[+/-](0-9)[.(0-9)]
+============
+*/
+static int ScanNumber( liScan_t *scan ) {
+    int ch = GetChar( scan );
+    liassert( (ch >= '0' && ch <= '9') || ch == '-' || ch == '+' );
+    tb = tf;
+    tl = 1;
+    while( 1 ) {
+        ch = GetNextChar( scan );
+        /* take the whole word, the parser checks it */
+        if( !is_nextkeych( (char)ch ) && ch != '.' ) {
+            break;
         }
-        
-        switch( o->type ) {
-            case LI_VTNULL:
-                liassert( o->firstChild == NULL );
-                LiWriteCstr( f, wr, "null" );
+        tl++;
+    }
+    StoreBufData( scan );
+    return TK_NUM;
+}
+
+/*
+============
+ScanString
+
+"string... \t ...string... \n \t \a" ...
+============
+*/
+static int ScanString( liScan_t *scan ) {
+    int ch = GetChar( scan );
+    liassert( ch == '"' );
+    tb = tf;
+    tl = 0;
+    ch = GetNextChar( scan );
+    /* the string starts after the quote, tl counts up to tf */
+    tb = tf;
+    while( ch != '"' ) {
+        if( ch == '\\' ) {
+            /* escape character */
+            tl++;
+            ch = GetNextChar( scan );
+            if( !(ch >= 32 && ch <= 255 && ch != 127) ) {
+                /* not printable character */
+                /* TODO error message */
+                goto goErr;
+            }
+        } else if( ch >= 32 && ch <= 255 && ch != 127 ) {
+            /* if character is printable */
+        } else {
+            /* handle as error */
+            /* check for special characters */
+            if( ch == CH_EOF ) {
+                /* TODO error message */
+                goto goErr;
+            } else if( ch == CH_ERD ) {
+                /* TODO error message */
+                goto goErr;
+            } else {
+                /* control characters have to be escaped */
+                goto goErr;
+            }
+        }
+        tl++;
+        ch = GetNextChar( scan );
+    }
+    /* skip current char '"' */
+    GetNextChar( scan );
+    /* store string to storage */
+    StoreBufData( scan );
+    return TK_STR;
+goErr:
+    tb = tf;
+    tl = 0;
+    return TK_ERR;
+}
+
+/*
+============
+ScanToken
+============
+*/
+static int ScanToken( liScan_t *scan ) { 
+    int ch = GetChar( scan );
+    tl = 0;
+    while( 1 ) {
+        tb = tf;
+        /* the column is counted past a processed char */
+        scan->tkLine = ln;
+        scan->tkCol = scan->chProc ? lc - 1 : lc;
+        switch( ch ) {
+            case CH_EOF:
+                /* end of file */
+                return tk = TK_EOF;
+            case CH_ERD:
+                /* reading error */
+                return tk = TK_ERD;
+            case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+                /* skip space character */
                 break;
-                
-            case LI_VTOBJ:
-                if( o->firstChild ) {
-                    /* begin of object */
-                    LiWriteCstr( f, wr, "{\n" );
-                    code = WriteHelper_r( f, wr, o->firstChild, 
-                            flags, level + 1 );
-                    if( code != LI_OK ) {
-                        return code;
-                    }
-                    LiWriteIndent( f, wr, level );
-                    /* end of object */
-                    LiWriteCstr( f, wr, "}" );
-                } else {
-                    /* empty object */
-                    LiWriteCstr( f, wr, "{}\n" );
+            case '"':
+                return tk = ScanString( scan );
+            default:
+                /* check for keyword */
+                if( is_firstkeych( (char)ch ) ) {
+                    return tk = ScanKeyword( scan );
                 }
-                break;
-                
-            case LI_VTSTR:
-                liassert( o->firstChild == NULL );
-                LiWriteCstr( f, wr, "\"" );
-                if( o->vstr ) {
-                    LiWriteLiStr( f, wr, o->vstr );
+                /* check for number */
+                if( (ch >= '0' && ch <= '9') || (ch == '-') || (ch == '+') ){
+                    return tk = ScanNumber( scan );
+                }
+                /* return character as token */
+                tk = ch;
+                GetNextChar( scan );
+                return tk;
+        }
+        ch = GetNextChar( scan );
+    }
+}
+
+#undef tb
+#undef tf
+#undef tl
+#undef tk
+#undef lb
+#undef ln
+#undef lc
+
+static liObj_t *ParseFile_r( liScan_t *scan, liflag_t flags, int level );
+
+/*
+============
+NextToken
+
+Scans the next token, the text of keys, strings
+and numbers is in scan->storage
+============
+*/
+static int NextToken( liScan_t *scan ) {
+    if( scan->peeked ) {
+        scan->peeked = lifalse;
+        return scan->tk;
+    }
+    if( scan->storage ) {
+        slen(scan->storage) = 0;
+    }
+    ScanToken( scan );
+#if defined(LI_READ_STATS)
+    switch( scan->tk ) {
+        case TK_KEY:    ScanStat( tokens[LI_RTK_KEY], 1 );  break;
+        case TK_STR:    ScanStat( tokens[LI_RTK_STR], 1 );  break;
+        case TK_NUM:    ScanStat( tokens[LI_RTK_NUM], 1 );  break;
+        case TK_EOF:
+        case TK_ERD:
+        case TK_ERR:    ScanStat( tokens[LI_RTK_END], 1 );  break;
+        default:        ScanStat( tokens[LI_RTK_CHAR], 1 ); break;
+    }
+#endif
+    return scan->tk;
+}
+
+/*
+============
+TokenText
+============
+*/
+static char *TokenText( liScan_t *scan, lisize_t *len ) {
+    if( !scan->storage ) {
+        *len = 0;
+        return (char*)"";
+    }
+    *len = slen(scan->storage);
+    return sstr(scan->storage);
+}
+
+/*
+============
+ParseError
+============
+*/
+static void ParseError( liScan_t *scan, const char *msg ) {
+    if( scan->err != LI_OK ) {
+        /* keep the first error */
+        return;
+    }
+    scan->err = scan->tk == (int)TK_ERD ? LI_EREAD : LI_EINPDAT;
+    scan->errBuf = SPrint( scan->errBuf, "line %d, column %d: %s",
+            scan->tkLine, scan->tkCol, msg );
+}
+
+/*
+============
+ParseNumber
+
+[+/-]123    dec (int, LI_FSIGN with '+')
+123         dec (int, uint if it does not fit)
+0x1f        hex (uint)
+0b101       bin (uint)
+0123        oct (uint)
+============
+*/
+static liObj_t *ParseNumber( liScan_t *scan ) {
+    lisize_t len, i = 0;
+    char *s = TokenText( scan, &len );
+    liflag_t flags = LI_FDEC;
+    uint64_t v = 0;
+    uint64_t max;
+    int base = 10;
+    int sign = 0;
+    int d;
+    liObj_t *o;
+    
+    if( s[0] == '-' || s[0] == '+' ) {
+        sign = s[0];
+        i++;
+    }
+    if( i + 1 < len && s[i] == '0' ) {
+        if( s[i + 1] == 'x' || s[i + 1] == 'X' ) {
+            base = 16;
+            flags = LI_FHEX;
+            i += 2;
+        } else if( s[i + 1] == 'b' || s[i + 1] == 'B' ) {
+            base = 2;
+            flags = LI_FBIN;
+            i += 2;
+        } else {
+            base = 8;
+            flags = LI_FOCT;
+            i += 1;
+        }
+    }
+    if( i == len || (sign && base != 10) ) {
+        ParseError( scan, "bad number" );
+        return NULL;
+    }
+    
+    for( ; i < len; i++ ) {
+        if( s[i] >= '0' && s[i] <= '9' ) {
+            d = s[i] - '0';
+        } else if( s[i] >= 'a' && s[i] <= 'z' ) {
+            d = s[i] - 'a' + 10;
+        } else if( s[i] >= 'A' && s[i] <= 'Z' ) {
+            d = s[i] - 'A' + 10;
+        } else {
+            d = base;
+        }
+        if( d >= base ) {
+            ParseError( scan, "bad number" );
+            return NULL;
+        }
+        if( v > (UINT64_MAX - (uint64_t)d) / (uint64_t)base ) {
+            ParseError( scan, "the number is out of range" );
+            return NULL;
+        }
+        v = v * (uint64_t)base + (uint64_t)d;
+    }
+    
+    if( base != 10 ) {
+        o = LiUint( v );
+        LiSetFlags( o, flags );
+        return o;
+    }
+    
+    max = sign == '-' ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    if( v > max ) {
+        if( sign ) {
+            ParseError( scan, "the number is out of range" );
+            return NULL;
+        }
+        return LiUint( v );
+    }
+    
+    if( sign == '-' ) {
+        o = LiInt( v == max ? INT64_MIN : -(int64_t)v );
+    } else {
+        o = LiInt( (int64_t)v );
+    }
+    if( sign ) {
+        LiSetFlags( o, LI_FSIGN );
+    }
+    return o;
+}
+
+/*
+============
+HexDigit
+
+Returns the value of a hex digit, -1 for other characters
+============
+*/
+static int HexDigit( char c ) {
+    if( c >= '0' && c <= '9' ) {
+        return c - '0';
+    } else if( c >= 'a' && c <= 'f' ) {
+        return c - 'a' + 10;
+    } else if( c >= 'A' && c <= 'F' ) {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+============
+ParseString
+
+Replaces escapes in place: \n \t \r \xHH, any other
+character after '\' stands for itself
+============
+*/
+static liObj_t *ParseString( liScan_t *scan ) {
+    lisize_t len, i, n = 0;
+    char *s = TokenText( scan, &len );
+    liObj_t *o;
+    
+    for( i = 0; i < len; i++ ) {
+        if( s[i] == '\\' && i + 1 < len ) {
+            i++;
+            switch( s[i] ) {
+                case 'n':   s[n++] = '\n';  break;
+                case 't':   s[n++] = '\t';  break;
+                case 'r':   s[n++] = '\r';  break;
+                case 'x':
+                    if( i + 2 < len && HexDigit( s[i + 1] ) >= 0 &&
+                            HexDigit( s[i + 2] ) >= 0 ) {
+                        s[n++] = (char)(HexDigit( s[i + 1] ) * 16 +
+                                HexDigit( s[i + 2] ));
+                        i += 2;
+                    } else {
+                        s[n++] = s[i];
+                    }
+                    break;
+                default:    s[n++] = s[i];  break;
+            }
+        } else {
+            s[n++] = s[i];
+        }
+    }
+    
+    ScanStat( strings, 1 );
+    if( scan->pool ) {
+        o = LiStrL( NULL, 0 );
+        o->vstr = LiSPoolGet( scan->pool, s, n, NULL, LI_TYID_STR );
+        return o;
+    }
+    return LiStrL( s, n );
+}
+
+/*
+============
+ParseValue_r
+============
+*/
+static liObj_t *ParseValue_r( liScan_t *scan, liflag_t flags, int level ) {
+    liObj_t *o, *child;
+    
+    switch( NextToken( scan ) ) {
+        case '{':
+            o = LiObj();
+            child = ParseFile_r( scan, flags, level + 1 );
+            if( scan->err != LI_OK ) {
+                LiFree( o );
+                return NULL;
+            }
+            /* adopt the children */
+            o->firstChild = child;
+            for( ; child; child = child->next ) {
+                child->parent = o;
+                o->lastChild = child;
+            }
+            return o;
+            
+        case TK_STR:
+            return ParseString( scan );
+            
+        case TK_NUM:
+            return ParseNumber( scan );
+            
+        case TK_ERR:
+            ParseError( scan, "bad string" );
+            return NULL;
+            
+        case TK_KEY:
+            if( LiSCmpL( scan->storage, "null", 4 ) ) {
+                return LiNull();
+            }
+            if( LiSCmpL( scan->storage, "true", 4 ) ) {
+                return LiBool( litrue );
+            }
+            if( LiSCmpL( scan->storage, "false", 5 ) ) {
+                return LiBool( lifalse );
+            }
+            ParseError( scan, "unknown value" );
+            return NULL;
+            
+        default:
+            ParseError( scan, "value expected" );
+            return NULL;
+    }
+}
+
+/*
+============
+ParseFile_r
+
+Parses "key = value[, value...]" entries until the end
+of the file (level 0) or '}'. The values of a line share
+one key. Returns the sibling list, on an error it is
+freed and scan->err is set.
+============
+*/
+static liObj_t *ParseFile_r( liScan_t *scan, liflag_t flags, int level ) {
+    liObj_t *first = NULL;
+    liObj_t *last = NULL;
+    liObj_t *o;
+    liStr_t *key;
+    lisize_t len;
+    char *s;
+            
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "increase the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+
+    while( 1 ) {
+        switch( NextToken( scan ) ) {
+            case TK_EOF:
+                if( level ) {
+                    ParseError( scan, "'}' expected" );
+                    goto goErr;
                 }
-                LiWriteCstr( f, wr, "\"" );
-                break;
+                return first;
                 
-            case LI_VTINT: 
-                code = LiWriteInt( f, wr, o );
-                if( code != LI_OK ) {
-                    return code;
+            case '}':
+                if( !level ) {
+                    ParseError( scan, "unexpected '}'" );
+                    goto goErr;
                 }
-                break;
+                return first;
                 
-            case LI_VTUINT:
-                code = LiWriteUint( f, wr, o );
-                if( code != LI_OK ) {
-                    return code;
-                }
-                break;
-            
-            case LI_VTBOOL:
-                liassert( o->firstChild == NULL );
-                LiWriteCstr( f, wr, o->vint ? "true" : "false" );
+            case TK_KEY:
                 break;
                 
             default:
-                liverifya( 0, "error: nuknown object type [%d]", o->type );
+                ParseError( scan, "key expected" );
+                goto goErr;
         }
         
-        if( nl ) {
-            LiWriteCstr( f, wr, "\n" );
+        s = TokenText( scan, &len );
+        if( scan->pool ) {
+            /* the previous line is another run */
+            key = LiSPoolGet( scan->pool, s, len, last ? last->key : NULL,
+                    LI_TYID_KEY );
+        } else {
+            key = LiSNewKeyL( s, len );
+        }
+        ScanStat( strings, 1 );
+        if( NextToken( scan ) != '=' ) {
+            LiSFree( key );
+            ParseError( scan, "'=' expected" );
+            goto goErr;
         }
         
-    } while( (o = o->next) != NULL );
+        /* values of the run */
+        do {
+            o = ParseValue_r( scan, flags, level );
+            if( !o ) {
+                LiSFree( key );
+                goto goErr;
+            }
+            ScanStat( nodes, 1 );
+            o->key = key;
+            LiSRef( key );
+            o->prev = last;
+            if( last ) {
+                last->next = o;
+            } else {
+                first = o;
+            }
+            last = o;
+        } while( NextToken( scan ) == ',' );
+        /* the run holds its own references */
+        LiSFree( key );
+        scan->peeked = litrue;
+    }
     
-    return code;
+goErr:
+    if( first ) {
+        LiFree( first );
+    }
+    return NULL;
 }
 
 /*
 ============
-LiWrite
+ParseHelper
 ============
 */
-licode_t LiWrite( liObj_t *o, const char *name ) {
+static licode_t ParseHelper( liScan_t *scan, liObj_t **o, liflag_t flags,
+        char *errbuf, size_t errbufLen ) {
+    liSPool_t pool;
+    
+    if( flags & LI_FDEDUP ) {
+        LiSPoolInit( &pool );
+        scan->pool = &pool;
+    }
+    *o = ParseFile_r( scan, flags, 0 );
+    if( scan->pool ) {
+        LiSPoolFree( scan->pool );
+        scan->pool = NULL;
+    }
+    if( scan->err != LI_OK && errbuf ) {
+        SPrintf( errbuf, "%.*s", (int)(errbufLen - 1), 
+                scan->errBuf ? sstr(scan->errBuf) : "" );
+    }
+    return scan->err;
+}
+
+/*
+============
+LiRead
+============
+*/
+licode_t LiRead( liObj_t **o, const char *name ) {
     liassert(o);
-    return LiWriteEx( NULL, o, name, 0 );
+    return LiReadEx( NULL, o, name, 0, NULL, 0 );
 }
 
+#if defined(LI_READ_STATS)
+/* counters of the reads of the thread */
+static _Thread_local liReadStats_t *liReadStats = NULL;
+
 /*
 ============
-LiWriteEx
+LiSetReadStats
+
+The reads of the calling thread add their counters
+to stats (NULL - stop counting).
+
+return values:
+previous stats of the thread (may be NULL)
 ============
 */
-licode_t LiWriteEx( liIO_t *io, liObj_t *o, const char *name,
-        liflag_t flags ) {
+liReadStats_t *LiSetReadStats( liReadStats_t *stats ) {
+    liReadStats_t *prev = liReadStats;
+    liReadStats = stats;
+    return prev;
+}
+
+/*
+============
+ReadStatsTime
+============
+*/
+static uint64_t ReadStatsTime( void ) {
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+============
+ReadStatsAdd
+============
+*/
+static void ReadStatsAdd( liReadStats_t *dst, const liReadStats_t *src ) {
+    uint64_t *d = (uint64_t*)dst;
+    const uint64_t *s = (const uint64_t*)src;
+    size_t i;
+    
+    for( i = 0; i < sizeof(liReadStats_t) / sizeof(uint64_t); i++ ) {
+        d[i] += s[i];
+    }
+}
+#endif
+
+/*
+============
+ReadHelper
+============
+*/
+static licode_t ReadHelper( liIO_t *io, liObj_t **o, const char *name, 
+        liflag_t flags, char *errbuf, size_t errbufLen ) {
     liassert(o);
+    liassert(*o == NULL);
+    liverifya( (errbuf && (errbufLen >= 1024)) || 
+            (!errbuf && (errbufLen == 0)),
+            "error: the buffer size must be at least 1024" );
     
     liFile_t f;
     licode_t code = LI_OK;
+    liScan_t scan;
+    
+#if defined(LI_READ_STATS)
+    uint64_t t0 = ReadStatsTime();
+    uint64_t t1, t2;
+#endif
     
     if( io == NULL ) {
         extern liIO_t liDefaultIO;
         io = &liDefaultIO;
     }
     
-    f = io->open( name, 'w' );
+    /* compressed files are detected by their magic bytes */
+    f = LiZipOpen( io, name, 'r', flags );
     if( f == NULL ) {
         return LI_EFILEOPEN;
     }
-    if( o ) {
-        code = WriteHelper_r( f, io->write, o, flags, 0 );
-    }
+    io = &liZipIO;
+    ScanInit( &scan, f, io );
+#if defined(LI_READ_STATS)
+    t1 = ReadStatsTime();
+#endif
+    code = ParseHelper( &scan, o, flags, errbuf, errbufLen );
+#if defined(LI_READ_STATS)
+    t2 = ReadStatsTime();
+#endif
+    ScanFree( &scan );
     io->close( f );
+#if defined(LI_READ_STATS)
+    if( liReadStats ) {
+        scan.stats.openNs = t1 - t0;
+        scan.stats.parseNs = t2 - t1;
+        scan.stats.closeNs = ReadStatsTime() - t2;
+        ReadStatsAdd( liReadStats, &scan.stats );
+    }
+#endif
     
     return code;
 }
 
+/*
+============
+LiReadEx
+============
+*/
+licode_t LiReadEx( liIO_t *io, liObj_t **o, const char *name, 
+                    liflag_t flags, char *errbuf, size_t errbufLen ) {
+    return ReadHelper( io, o, name, flags, errbuf, errbufLen );
+}
+
+/*
+============
+memory files
+
+The file name passed to open is the liMemFile_t itself
+============
+*/
+typedef struct {
+    const char  *data;
+    size_t      len;
+    size_t      pos;
+} liMemFile_t;
+
+static liFile_t MemOpen( const char *name, char mode ) {
+    liassert( mode == 'r' );
+    return (liFile_t)name;
+}
+
+static void MemClose( liFile_t f ) {
+}
+
+static ssize_t MemRead( void *dst, size_t size, liFile_t f ) {
+    liMemFile_t *m = (liMemFile_t*)f;
+    if( size > m->len - m->pos ) {
+        size = m->len - m->pos;
+    }
+    MemCpy( dst, m->data + m->pos, size );
+    m->pos += size;
+    return (ssize_t)size;
+}
+
+static ssize_t MemAcquire( const void **data, liFile_t f ) {
+    liMemFile_t *m = (liMemFile_t*)f;
+    size_t size = m->len - m->pos;
+    *data = m->data + m->pos;
+    m->pos = m->len;
+    return (ssize_t)size;
+}
+
+static void MemRelease( const void *data, liFile_t f ) {
+}
+
+static liIO_t liMemIO = {
+    MemOpen, MemClose, MemRead, NULL, MemAcquire, MemRelease
+};
+
+/*
+============
+LiReadMem
+
+Parses the text in memory, the data is not copied
+============
+*/
+licode_t LiReadMem( liObj_t **o, const void *data, size_t len, 
+                    liflag_t flags, char *errbuf, size_t errbufLen ) {
+    liMemFile_t m;
+    liassert( data || !len );
+    m.data = (const char*)data;
+    m.len = len;
+    m.pos = 0;
+    return ReadHelper( &liMemIO, o, (const char*)&m, flags, errbuf, 
+            errbufLen );
+}
+
 
 
 /*
 ================================================
-                    li parser
+                   li context
 ================================================
 */
 
-typedef struct {
-    liFile_t    f;
-    fnLiRead    rd;
-    liStr_t     *scanBuf;   /* buffered file data */
-    liStr_t     *errBuf;    
-
-    char        *tkBeg;
-    char        *tkFwd;
-    lisize_t    tkLen;
-    int         tk;
+/*
+============
+LiContextInit
 
-    char        *lnBeg;
-    int         ln;
-    int         col;
-    
-    liStr_t     *storage;
+A context carries the allocator and the I/O backend
+of the calls made with it. It holds no state of its
+own, so it may be shared by threads as long as the
+allocator is thread-safe.
+============
+*/
+void LiContextInit( liContext_t *ctx, liAlloc_t *alc, liIO_t *io ) {
+    liassert( ctx );
     
-    libool_t    chProc;     /* char processed */
-} liScan_t;
+    ctx->alc = alc;
+    ctx->io = io;
+    ctx->writeBufSize = 0;
+    ctx->numThreads = 0;
+}
 
 /*
 ============
-ScanInit
+LiContextEnter
+
+Makes the allocator of the context the allocator of
+the calling thread until LiContextLeave. All li calls
+made in between allocate and free with it. Returns the
+allocator to give to LiContextLeave, so sections can
+be nested.
 ============
 */
-static void ScanInit( liScan_t *scan, liFile_t f, fnLiRead rd ) {
-    scan->f = f;
-    scan->rd = rd;
-    scan->scanBuf = LiSAlloc( 1024 );
-    scan->errBuf = NULL;    
+liAlloc_t *LiContextEnter( liContext_t *ctx ) {
+    liassert( ctx );
+    return LiSetThreadAllocator( ctx->alc );
+}
 
-    scan->tkBeg = sstr(scan->scanBuf);
-    scan->tkFwd = sstr(scan->scanBuf);
-    scan->tkLen = 0;
-    scan->tk = 0;
+/*
+============
+LiContextLeave
 
-    scan->lnBeg = sstr(scan->scanBuf);
-    scan->ln = 1;
-    scan->col = 1;
-    
-    scan->storage = NULL;
-    
-    scan->chProc = lifalse;
+prev - the allocator LiContextEnter returned
+============
+*/
+void LiContextLeave( liContext_t *ctx, liAlloc_t *prev ) {
+    liassert( ctx );
+    LiSetThreadAllocator( prev );
 }
 
 /*
 ============
-ScanFree
+LiObjCtx
 ============
 */
-static void ScanFree( liScan_t *scan ) {
-    if( scan->scanBuf ) {
-        LiSFree( scan->scanBuf );
-    }
-    if( scan->errBuf ) {
-        LiSFree( scan->errBuf );
-    }
+liObj_t *LiObjCtx( liContext_t *ctx ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiObj();
+    LiContextLeave( ctx, prev );
+    return o;
 }
 
-
-#define tb      (scan->tkBeg)
-#define tf      (scan->tkFwd)
-#define tl      (scan->tkLen)
-#define tk      (scan->tk)
-#define lb      (scan->lnBeg)
-#define ln      (scan->ln)
-#define lc      (scan->col)
+/*
+============
+LiNullCtx
+============
+*/
+liObj_t *LiNullCtx( liContext_t *ctx ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiNull();
+    LiContextLeave( ctx, prev );
+    return o;
+}
 
 /*
 ============
-UpdateBuffer
+LiStrCtx
 ============
 */
-static ssize_t UpdateBuffer( liScan_t *scan ) {
-    char *min;
-    if( lb < tb ) {
-        if( (size_t)(tb - lb) > 64 ) {
-            lb = tb - 64;
-        }
-        min = lb;
-    } else {
-        min = tb;
-    }
-    ssize_t left = min - sstr(scan->scanBuf);
-    ssize_t right = salc(scan->scanBuf) - slen(scan->scanBuf);
-    
-    liassert( left >= 0 );
-    liassert( right >= 0 );
-    
-    if( left ) {
-        ssize_t siz = slen(scan->scanBuf) - left;
-        liassert( siz > 0 );
-        MemCpy( sstr(scan->scanBuf), min, siz );
-        tb -= left;
-        tf -= left;
-        lb -= left;
-        slen(scan->scanBuf) -= left;
-        right += left;
-    }
-    
-    if( right ) {
-        char *to = sstr(scan->scanBuf) + slen(scan->scanBuf);
-        ssize_t rsiz = scan->rd( to, right, scan->f );
-        if( rsiz < 0 ) {
-            return rsiz;
-        }
-        slen(scan->scanBuf) += rsiz;
-        liassert( slen(scan->scanBuf) <= salc(scan->scanBuf) );
-        return rsiz;
-    }
-    
-    return 0;
+liObj_t *LiStrCtx( liContext_t *ctx, const char *s ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiStr( s );
+    LiContextLeave( ctx, prev );
+    return o;
+}
+
+/*
+============
+LiStrLCtx
+============
+*/
+liObj_t *LiStrLCtx( liContext_t *ctx, const char *s, lisize_t len ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiStrL( s, len );
+    LiContextLeave( ctx, prev );
+    return o;
 }
 
 /*
 ============
-StoreBufData
+LiIntCtx
 ============
 */
-static void StoreBufData( liScan_t *scan ) {
-    if( lb < tb ) {
-        if( (size_t)(tb - lb) > 64 ) {
-            lb = tb - 64;
-        }
-    }
-    
-    if( scan->storage ) {
-        scan->storage = LiSCatL( scan->storage, tb, tl );
-    } else {
-        scan->storage = LiSNewL( tb, tl );
-    }
-    tb = tf;
-    tl = 0;
+liObj_t *LiIntCtx( liContext_t *ctx, int64_t i ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiInt( i );
+    LiContextLeave( ctx, prev );
+    return o;
 }
 
-#define CH_EOF  0x7f100000
-#define CH_ERD  0x7f200000
-
 /*
 ============
-GetChar
+LiUintCtx
 ============
 */
-static int GetChar( liScan_t *scan ) {
-    if( tf >= sstr(scan->scanBuf) + slen(scan->scanBuf) ) {
-        ssize_t rsiz = UpdateBuffer( scan );
-        if( rsiz < 0 ) {
-            /* return reading error */
-            return CH_ERD;
-        }
-        if( rsiz == 0 ) {
-            if( salc(scan->scanBuf) == slen(scan->scanBuf) ) {
-                /* end of buffer */
-                StoreBufData( scan );
-                static int lvl = 0;   /* recursion level */
-                lvl++;
-                liassert( lvl <= 2 ); /* check recursion level */
-                int ch = GetChar( scan );
-                lvl--;
-                return ch;
-            }
-            /* return end of file */
-            return CH_EOF;
-        }
-    }
-    if( !scan->chProc ) {
-        if( *tf == '\n' ) {
-            ln++;
-            lc = 1;
-            lb = tf + 1;
-        } else {
-            lc++;
-        }
-        scan->chProc = litrue;
-    }
-    liassert( tf <= sstr(scan->scanBuf) + slen(scan->scanBuf) );
-    return *tf;
+liObj_t *LiUintCtx( liContext_t *ctx, uint64_t u ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiUint( u );
+    LiContextLeave( ctx, prev );
+    return o;
 }
 
 /*
 ============
-GetNextChar
+LiBoolCtx
 ============
 */
-static int GetNextChar( liScan_t *scan ) {
-    tf++;
-    scan->chProc = lifalse;
-    return GetChar( scan );
+liObj_t *LiBoolCtx( liContext_t *ctx, libool_t b ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    liObj_t *o = LiBool( b );
+    LiContextLeave( ctx, prev );
+    return o;
 }
 
-
-
-#define TK_ERD      0x80000000
-#define TK_EOF      0x71000000
-#define TK_STR      0x72000000
-#define TK_KEY      0x73000000
-#define TK_ERR      0x74000000
-#define TK_NUM      0x75000000
-
 /*
 ============
-ScanKeyword
+LiFreeCtx
 ============
 */
-static int ScanKeyword( liScan_t *scan ) {
-    int ch = GetChar( scan );
-    liassert( is_firstkeych( (char)ch ) );
-    tb = tf;
-    tl = 1;
-    while( 1 ) {
-        ch = GetNextChar( scan );
-        if( !is_nextkeych( (char)ch ) ) {
-            break;
-        }
-        tl++;
-    }
-    /* store string to storage and return */
-    StoreBufData( scan );
-    return TK_KEY;
+void LiFreeCtx( liContext_t *ctx, liObj_t *li ) {
+    liAlloc_t *prev = LiContextEnter( ctx );
+    LiFree( li );
+    LiContextLeave( ctx, prev );
 }
 
 /*
 ============
-ScanNumber
-
-0x123123        hex (int)
-0123            oct (int)
-[+/-]123123     dec (int)
-[+/-]123.123        (double)
-[+/-](nan/inf/inf)  (double)
-[+/-]1e[+/-]12           (double)
-[+/-](0-9)[.(0-9)]
+LiWriteCtx
 ============
 */
-static int ScanNumber( liScan_t *scan ) {
-    int ch = GetChar( scan );
-    /* if( ch >= '0' && ch <= '9' || ch == '-' || ch == '+' ) {
-    */
-    return TK_NUM;
+licode_t LiWriteCtx( liContext_t *ctx, liObj_t *o, const char *name,
+        liflag_t flags ) {
+    liassert( ctx );
+    
+    liAlloc_t *prev = LiContextEnter( ctx );
+    licode_t code = WriteFile( ctx->io, o, name, flags, ctx->writeBufSize,
+            ctx->numThreads );
+    LiContextLeave( ctx, prev );
+    return code;
 }
 
 /*
 ============
-ScanString
-
-"string... \t ...string... \n \t \a" ...
+LiReadCtx
 ============
 */
-static int ScanString( liScan_t *scan ) {
-    int ch = GetChar( scan );
-    liassert( ch == '"' );
-    tb = tf;
-    tl = 0;
-    while( 1 ) {
-        ch = GetNextChar( scan );
-        if( ch == '"' ) {
-            /* check for end of string character */
-            break;
-        } else if( ch == '\\' ) {
-            /* escape character */
-            tl++;
-            ch = GetNextChar( scan );
-            if( !(ch >= 32 && ch <= 255 && ch != 127) ) {
-                /* not printable character */
-                /* TODO error message */
-                goto goErr;
-            }
-        } else if( ch >= 32 && ch <= 255 && ch != 127 ) {
-            /* if character is printable */
-        } else {
-            /* handle as error */
-            /* check for special characters */
-            if( ch == CH_EOF ) {
-                /* TODO error message */
-                goto goErr;
-            } else if( ch == CH_ERD ) {
-                /* TODO error message */
-                goto goErr;
-            } else {
-                liasserta( 0, "unknown character" );
-            }
-        }
-        tl++;
-    }
-    /* skip current char '"' */
-    GetNextChar( scan );
-    /* store string to storage */
-    StoreBufData( scan );
-    return TK_STR;
-goErr:
-    tb = tf;
-    tl = 0;
-    return TK_ERR;
+licode_t LiReadCtx( liContext_t *ctx, liObj_t **o, const char *name,
+        liflag_t flags, char *errbuf, size_t errbufLen ) {
+    liassert( ctx );
+    
+    liAlloc_t *prev = LiContextEnter( ctx );
+    licode_t code = ReadHelper( ctx->io, o, name, flags, errbuf, errbufLen );
+    LiContextLeave( ctx, prev );
+    return code;
 }
 
+
+
+/*
+================================================
+                 li batch read
+
+Files are parsed on worker threads. The trees are
+allocated with the allocator of the options or,
+without one, with the global allocator, either has to
+be thread-safe. All workers share that one allocator.
+A thread allocator of the caller is never shared with
+the workers, it may be an arena, so a caller that has
+one must pass the allocator of the trees.
+================================================
+*/
+
+struct liReadJob_t {
+    const char * const  *paths;
+    size_t              numPaths;
+    liObj_t             **results;
+    licode_t            *codes;
+    licode_t            *ownCodes;  /* codes if the caller passed none */
+    liIO_t              *io;
+    liAlloc_t           *alc;
+    liflag_t            flags;
+    atomic_size_t       next;       /* next file to read */
+    atomic_size_t       numDone;
+    pthread_t           threads[LI_MAX_READ_THREADS];
+    int                 numThreads;
+};
+
 /*
 ============
-ScanToken
+ReadWorker
 ============
 */
-static int ScanToken( liScan_t *scan ) { 
-    int ch = GetChar( scan );
-    tl = 0;
-    while( 1 ) {
-        tb = tf;
-        switch( ch ) {
-            case CH_EOF:
-                /* end of file */
-                return tk = TK_EOF;
-            case CH_ERD:
-                /* reading error */
-                return tk = TK_ERD;
-            case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
-                /* skip space character */
-                break;
-            case '"':
-                return tk = ScanString( scan );
-            default:
-                /* check for keyword */
-                if( is_firstkeych( (char)ch ) ) {
-                    return tk = ScanKeyword( scan );
-                }
-                /* check for number */
-                if( (ch >= '0' && ch <= '9') || (ch == '-') || (ch == '+') ){
-                    return tk = ScanNumber( scan );
-                }
-                /* return character as token */
-                tk = ch;
-                GetNextChar( scan );
-                return tk;
-        }
-        ch = GetNextChar( scan );
+static void *ReadWorker( void *arg ) {
+    liReadJob_t *job = (liReadJob_t*)arg;
+    liContext_t ctx;
+    size_t i;
+    
+    LiContextInit( &ctx, job->alc, job->io );
+    while( (i = atomic_fetch_add( &job->next, 1 )) < job->numPaths ) {
+        job->results[i] = NULL;
+        job->codes[i] = LiReadCtx( &ctx, job->results + i, job->paths[i],
+                job->flags, NULL, 0 );
+        atomic_fetch_add( &job->numDone, 1 );
     }
+    
+    return NULL;
 }
 
-#undef tb
-#undef tf
-#undef tl
-#undef tk
-#undef lb
-#undef ln
-#undef lc
-
 /*
 ============
-ParseFile_r
+LiReadAsync
+
+Starts reading the files into results[0..n-1], codes
+gets the code of every file (may be NULL). Returns
+before the files are read, the job must be finished
+with LiReadWait.
 ============
 */
-static liObj_t *ParseFile_r( liScan_t *scan, liflag_t flags, int level ) {
-            
-    liverifya( level <= LI_MAX_NESTING_LEVEL,
-        "error: the nesting level is too high. "
-        "increase the constant LI_MAX_NESTING_LEVEL. "
-        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
-
-    return NULL;
+liReadJob_t *LiReadAsync( const char * const *paths, size_t n,
+        liObj_t **results, licode_t *codes, const liReadOpts_t *opts ) {
+    liReadJob_t *job;
+    int numThreads;
+    
+    liassert( paths || !n );
+    liassert( results || !n );
+    /* the trees are allocated with the global allocator and would
+    be freed with the thread allocator, checked in release builds */
+    liverifya( (opts && opts->alc) || !LiGetThreadAllocator(),
+            "error: a caller with a thread allocator has to pass "
+            "the allocator of the trees in opts->alc" );
+    
+    job = (liReadJob_t*)LiAlloc( sizeof(liReadJob_t), LI_TYID_BUF );
+    job->paths = paths;
+    job->numPaths = n;
+    job->results = results;
+    job->ownCodes = NULL;
+    if( !codes && n ) {
+        job->ownCodes = (licode_t*)LiAlloc( sizeof(licode_t) * n,
+                LI_TYID_BUF );
+        codes = job->ownCodes;
+    }
+    job->codes = codes;
+    job->io = opts ? opts->io : NULL;
+    job->alc = opts ? opts->alc : NULL;
+    job->flags = opts ? opts->flags : 0;
+    atomic_init( &job->next, 0 );
+    atomic_init( &job->numDone, 0 );
+    job->numThreads = 0;
+    
+    numThreads = NumThreads( opts ? opts->numThreads : 0,
+            LI_MAX_READ_THREADS );
+    if( (size_t)numThreads > n ) {
+        numThreads = (int)n;
+    }
+    while( job->numThreads < numThreads ) {
+        if( pthread_create( job->threads + job->numThreads, NULL,
+                ReadWorker, job ) != 0 ) {
+            break;
+        }
+        job->numThreads++;
+    }
+    if( !job->numThreads && n ) {
+        /* no threads, read here */
+        ReadWorker( job );
+    }
+    
+    return job;
 }
 
 /*
 ============
-LiRead
+LiReadPoll
+
+Returns litrue if all files of the job are read
 ============
 */
-licode_t LiRead( liObj_t **o, const char *name ) {
-    liassert(o);
-    return LiReadEx( NULL, o, name, 0, NULL, 0 );
+libool_t LiReadPoll( liReadJob_t *job ) {
+    liassert( job );
+    return atomic_load( &job->numDone ) == job->numPaths;
 }
 
-#include <stdio.h>
-#include <stdlib.h>
 /*
 ============
-LiReadEx
+LiReadWait
+
+Waits for the job and frees it. Returns the code of
+the first file that failed.
 ============
 */
-licode_t LiReadEx( liIO_t *io, liObj_t **o, const char *name, 
-                    liflag_t flags, char *errbuf, size_t errbufLen ) {
-    liassert(o);
-    liassert(*o == NULL);
-    liverifya( (errbuf && (errbufLen >= 1024)) || 
-            (!errbuf && (errbufLen == 0)),
-            "error: the buffer size must be at least 1024" );
-    
-    liFile_t f;
+licode_t LiReadWait( liReadJob_t *job ) {
     licode_t code = LI_OK;
-    liScan_t scan;
+    size_t i;
+    int t;
     
-    if( io == NULL ) {
-        extern liIO_t liDefaultIO;
-        io = &liDefaultIO;
-    }
+    liassert( job );
     
-    f = io->open( name, 'r' );
-    if( f == NULL ) {
-        return LI_EFILEOPEN;
+    for( t = 0; t < job->numThreads; t++ ) {
+        pthread_join( job->threads[t], NULL );
     }
-    ScanInit( &scan, f, io->read );
-    *o = ParseFile_r( &scan, flags, 0 );
-    
-    
-    size_t rd;
-    FILE *file = fopen( "out.txt", "wb" );
-    
-    liStr_t *s = NULL;
-    int ch = GetChar( &scan );
-    char *prev = scan.tkBeg;
-    while( ch != CH_EOF && ch != CH_ERD ) {
-        scan.tkLen++;
-        char c = (char)ch;
-        fwrite( &c, 1, 1, file );
-        ch = GetNextChar( &scan );
+    for( i = 0; i < job->numPaths; i++ ) {
+        if( job->codes[i] != LI_OK ) {
+            code = job->codes[i];
+            break;
+        }
     }
     
-    if( ch == CH_EOF ) {
-        Log( "CH_EOF\n" );
-    } else if( ch == CH_ERD ) {
-        Log( "CH_ERD\n" );
+    if( job->ownCodes ) {
+        LiDealloc( job->ownCodes );
     }
-    
-    s = scan.storage;
-    scan.storage = NULL;
-    
-    LiSFree(s);
-    
-    fclose( file );
-    
-    ScanFree( &scan );
-    io->close( f );
+    LiDealloc( job );
     
     return code;
 }
 
+/*
+============
+LiReadMany
+
+Reads the files on worker threads and waits for them
+============
+*/
+licode_t LiReadMany( const char * const *paths, size_t n, liObj_t **results,
+        licode_t *codes, const liReadOpts_t *opts ) {
+    return LiReadWait( LiReadAsync( paths, n, results, codes, opts ) );
+}
@@ -5,7 +5,14 @@
 #include "limem.h"
 #include "listr.h"
 
+#include <stddef.h>
+#include <sys/types.h>
+
 #define LI_MAX_NESTING_LEVEL    4096
+#define LI_WRITE_BUF_SIZE       (64 * 1024)
+#define LI_MAX_WRITE_THREADS    64
+#define LI_MAX_READ_THREADS     64
+#define LI_PARALLEL_MIN_NODES   (64 * 1024)
 
 
 
@@ -16,15 +23,38 @@ typedef liFile_t        (*fnLiOpen)(const char*,char);
 typedef void            (*fnLiClose)(liFile_t);
 typedef ssize_t         (*fnLiRead)(void*,size_t,liFile_t);
 typedef ssize_t         (*fnLiWrite)(const void*,size_t,liFile_t);
+typedef ssize_t         (*fnLiAcquire)(const void**,liFile_t);
+typedef void            (*fnLiRelease)(const void*,liFile_t);
+
+/*
+acquire lends the next data of the file, it returns
+the length (0 - end of file, < 0 - error). The data
+stays valid until release, only one piece is lent at
+a time. Backends without acquire are read with read.
 
+The last write before close has size 0. Backends that
+write in the background finish all data there and
+return < 0 if any of it failed.
+*/
 typedef struct liIO_t {
     fnLiOpen            open;       /* open file */
     fnLiClose           close;      /* close file */
     fnLiRead            read;       /* read file */
     fnLiWrite           write;      /* write file */
+    fnLiAcquire         acquire;    /* lend file data (optional) */
+    fnLiRelease         release;    /* give lent data back (optional) */
 } liIO_t;
 
 
+/* li context */
+typedef struct liContext_t {
+    liAlloc_t           *alc;       /* allocator (NULL - global) */
+    liIO_t              *io;        /* I/O backend (NULL - default) */
+    size_t              writeBufSize;/* output buffer size (0 - default) */
+    int                 numThreads; /* LI_FPARALLEL threads (0 - CPUs) */
+} liContext_t;
+
+
 /* li object */
 typedef struct liObj_t {
     struct liObj_t      *parent;    /* parent */
@@ -43,9 +73,58 @@ typedef struct liObj_t {
     liStr_t             *key;       /* key */
     litype_t            type;       /* object type */
     liflag_t            flags;      /* object flags */
+    uint64_t            hash;       /* subtree hash (0 - not computed) */
 } liObj_t;
 
 
+#if defined(LI_READ_STATS)
+/* token kinds of liReadStats_t */
+#define LI_RTK_KEY      0
+#define LI_RTK_STR      1
+#define LI_RTK_NUM      2
+#define LI_RTK_CHAR     3   /* '=', ',', '{', '}' and unexpected chars */
+#define LI_RTK_END      4   /* end of file, read errors */
+#define LI_RTK_NUM_KINDS    5
+
+/* parser counters, LiReadEx adds to them (LiSetReadStats) */
+typedef struct {
+    uint64_t            bytesRead;  /* bytes got from the file */
+    uint64_t            reads;      /* fnLiRead and fnLiAcquire calls */
+    uint64_t            refills;    /* buffer refills, lent pieces */
+    uint64_t            bytesMoved; /* token bytes kept over a refill */
+    uint64_t            concats;    /* tokens joined across buffers */
+    uint64_t            tokens[LI_RTK_NUM_KINDS];
+    uint64_t            nodes;      /* nodes created */
+    uint64_t            strings;    /* keys and string values created */
+    uint64_t            openNs;     /* time to open the file */
+    uint64_t            parseNs;    /* time to scan and parse */
+    uint64_t            closeNs;    /* time to free the scanner and close */
+} liReadStats_t;
+#endif
+
+/* memory used by a subtree */
+typedef struct {
+    size_t              nodes;      /* liObj_t structures */
+    size_t              keys;       /* keys */
+    size_t              strings;    /* string values */
+} liMemUsage_t;
+
+/* batch read options */
+typedef struct {
+    liIO_t              *io;        /* I/O backend (NULL - default) */
+    liAlloc_t           *alc;       /* allocator (NULL - global) */
+    liflag_t            flags;      /* LiReadEx flags */
+    int                 numThreads; /* worker threads (0 - CPUs) */
+} liReadOpts_t;
+
+/* batch read in progress */
+typedef struct liReadJob_t liReadJob_t;
+
+
+/* stream writer */
+typedef struct liWriter_t liWriter_t;
+
+
 /* find data */
 typedef struct {
     liObj_t             *obj;
@@ -58,11 +137,27 @@ typedef struct {
 
 
 
+#if defined(LI_CHECKED_CALLS)
 liObj_t     *LiParent( liObj_t *o );
 liObj_t     *LiNext( liObj_t *o );
 liObj_t     *LiPrev( liObj_t *o );
 liObj_t     *LiFirstChild( liObj_t *o );
 liObj_t     *LiLastChild( liObj_t *o );
+libool_t    LiTypeIs( liObj_t *o, litype_t type );
+libool_t    LiIsObj( liObj_t *o );
+#else
+static inline liObj_t *LiParent( liObj_t *o )       { return o->parent; }
+static inline liObj_t *LiNext( liObj_t *o )         { return o->next; }
+static inline liObj_t *LiPrev( liObj_t *o )         { return o->prev; }
+static inline liObj_t *LiFirstChild( liObj_t *o )   { return o->firstChild; }
+static inline liObj_t *LiLastChild( liObj_t *o )    { return o->lastChild; }
+static inline libool_t LiTypeIs( liObj_t *o, litype_t type ) {
+    return o->type == type;
+}
+static inline libool_t LiIsObj( liObj_t *o ) {
+    return o->type == LI_VTOBJ;
+}
+#endif
 liObj_t     *LiFirst( liObj_t *o );
 liObj_t     *LiLast( liObj_t *o );
 liObj_t     *LiRoot( liObj_t *o );
@@ -80,14 +175,29 @@ liObj_t     *LiExtractChildren( liObj_t *node );
 void        LiFreeSubtree( liObj_t *node );
 void        LiFree( liObj_t *li );
 
+/*
+LiClone copies every node of the subtree (O(nodes)),
+the links are intrusive and can't be shared. Keys
+and strings are shared by reference, so a clone of a
+string-heavy tree costs little more than its nodes.
+*/
+liObj_t     *LiClone( liObj_t *o );
+liObj_t     *LiDeepClone( liObj_t *o );
+
+uint64_t    LiHash( liObj_t *o );
+libool_t    LiEqual( liObj_t *a, liObj_t *b );
+void        LiHashInvalidate( liObj_t *o );
+size_t      LiDedup( liObj_t *o );
+size_t      LiMemUsage( liObj_t *o, liMemUsage_t *usage );
 
 
 
+
+/* a node of a sibling run renames the whole run */
 void        LiSetKey( liObj_t *o, const char *key );
 void        LiSetKeyL( liObj_t *o, const char *key, lisize_t len );
+libool_t    LiIsCorrectKey( const char *s, lisize_t len );
 void        LiSetFlags( liObj_t *o, liflag_t flags );
-libool_t    LiTypeIs( liObj_t *o, litype_t type );
-libool_t    LiIsObj( liObj_t *o );
 liObj_t     *LiObj( void );
 liObj_t     *LiNull( void );
 liObj_t     *LiStr( const char *s );
@@ -106,9 +216,62 @@ licode_t    LiWrite( liObj_t *o, const char *name );
 licode_t    LiWriteEx( liIO_t *io, liObj_t *o, const char *name, 
                     liflag_t flags );
 
+licode_t    LiWriterOpen( liWriter_t **w, liIO_t *io, const char *name );
+licode_t    LiWriterClose( liWriter_t *w );
+void        LiWriterBeginObject( liWriter_t *w, const char *key );
+void        LiWriterEnd( liWriter_t *w );
+void        LiWriterNull( liWriter_t *w, const char *key );
+void        LiWriterString( liWriter_t *w, const char *key, const char *s,
+                    lisize_t len );
+void        LiWriterInt( liWriter_t *w, const char *key, int64_t v,
+                    liflag_t flags );
+void        LiWriterUint( liWriter_t *w, const char *key, uint64_t v,
+                    liflag_t flags );
+void        LiWriterBool( liWriter_t *w, const char *key, libool_t b );
+licode_t    LiWriterObj( liWriter_t *w, liObj_t *o );
+
+licode_t    LiWriteBinary( liIO_t *io, liObj_t *o, const char *name,
+                    liflag_t flags );
+licode_t    LiReadBinary( liIO_t *io, liObj_t **o, const char *name,
+                    liflag_t flags );
+
 licode_t    LiRead( liObj_t **o, const char *name );
 licode_t    LiReadEx( liIO_t *io, liObj_t **o, const char *name, 
                     liflag_t flags, char *errbuf, size_t errbufLen );
+licode_t    LiReadMem( liObj_t **o, const void *data, size_t len, 
+                    liflag_t flags, char *errbuf, size_t errbufLen );
+#if defined(LI_READ_STATS)
+liReadStats_t   *LiSetReadStats( liReadStats_t *stats );
+#endif
+
+
+void        LiContextInit( liContext_t *ctx, liAlloc_t *alc, liIO_t *io );
+liAlloc_t   *LiContextEnter( liContext_t *ctx );
+void        LiContextLeave( liContext_t *ctx, liAlloc_t *prev );
+
+liObj_t     *LiObjCtx( liContext_t *ctx );
+liObj_t     *LiNullCtx( liContext_t *ctx );
+liObj_t     *LiStrCtx( liContext_t *ctx, const char *s );
+liObj_t     *LiStrLCtx( liContext_t *ctx, const char *s, lisize_t len );
+liObj_t     *LiIntCtx( liContext_t *ctx, int64_t i );
+liObj_t     *LiUintCtx( liContext_t *ctx, uint64_t u );
+liObj_t     *LiBoolCtx( liContext_t *ctx, libool_t b );
+void        LiFreeCtx( liContext_t *ctx, liObj_t *li );
+
+licode_t    LiWriteCtx( liContext_t *ctx, liObj_t *o, const char *name,
+                    liflag_t flags );
+licode_t    LiReadCtx( liContext_t *ctx, liObj_t **o, const char *name,
+                    liflag_t flags, char *errbuf, size_t errbufLen );
+
+
+licode_t    LiReadMany( const char * const *paths, size_t n, 
+                    liObj_t **results, licode_t *codes, 
+                    const liReadOpts_t *opts );
+liReadJob_t *LiReadAsync( const char * const *paths, size_t n,
+                    liObj_t **results, licode_t *codes, 
+                    const liReadOpts_t *opts );
+libool_t    LiReadPoll( liReadJob_t *job );
+licode_t    LiReadWait( liReadJob_t *job );
 
 
 #endif //__LI_H__
\ No newline at end of file
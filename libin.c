@@ -0,0 +1,733 @@
+#include "li.h"
+#include "liassert.h"
+#include "liutil.h"
+
+
+
+/*
+================================================
+                 li binary format
+
+header:
+    "LIB\1"
+    varint      number of keys
+    keys        varint length, bytes (no \0)
+
+node list (preorder, siblings end with a zero tag):
+    tag         bits 0-2 type (LI_VT*)
+                bits 3-4 LI_FBASE_MASK
+                bit  5   LI_FSIGN
+                bit  6   key of the previous sibling (sibling run)
+                bit  7   key from the dictionary
+    key         varint index into the dictionary (bit 7)
+    value       LI_VTSTR    varint length + 1 (0 - no string), bytes
+                LI_VTINT    zigzag varint
+                LI_VTUINT   varint
+                LI_VTBOOL   one byte
+                LI_VTOBJ    child node list
+================================================
+*/
+
+#define BIN_MAGIC           "LIB\1"
+#define BIN_MAGIC_LEN       4
+#define BIN_BUF_SIZE        (64 * 1024)
+
+#define BIN_TYPE_MASK       0x07
+#define BIN_FLAG_SHIFT      3
+#define BIN_FSIGN           0x20
+#define BIN_KEYRUN          0x40
+#define BIN_KEYDICT         0x80
+
+/* buffered output */
+typedef struct {
+    liFile_t    f;
+    fnLiWrite   wr;
+    uint8_t     *buf;
+    size_t      len;
+    licode_t    code;
+} liBinOut_t;
+
+/* buffered input */
+typedef struct {
+    liFile_t    f;
+    fnLiRead    rd;
+    uint8_t     *buf;
+    size_t      pos;
+    size_t      len;
+    licode_t    code;
+} liBinIn_t;
+
+/* key dictionary slot */
+typedef struct {
+    liStr_t     *key;
+    uint32_t    index;
+} liKeySlot_t;
+
+/* key dictionary, keys are compared by value */
+typedef struct {
+    liKeySlot_t *slots;
+    uint32_t    mask;
+    liStr_t     **keys;     /* keys in index order */
+    uint32_t    numKeys;
+} liKeyDict_t;
+
+
+
+/*
+================================================
+                 key dictionary
+================================================
+*/
+
+/*
+============
+DictInit
+============
+*/
+static void DictInit( liKeyDict_t *d ) {
+    uint32_t i;
+
+    d->mask = 255;
+    d->slots = (liKeySlot_t*)LiAlloc( sizeof(liKeySlot_t) * (d->mask + 1),
+            LI_TYID_DICT );
+    for( i = 0; i <= d->mask; i++ ) {
+        d->slots[i].key = NULL;
+    }
+    d->keys = (liStr_t**)LiAlloc( sizeof(liStr_t*) * (d->mask + 1),
+            LI_TYID_DICT );
+    d->numKeys = 0;
+}
+
+/*
+============
+DictFree
+============
+*/
+static void DictFree( liKeyDict_t *d ) {
+    LiDealloc( d->slots );
+    LiDealloc( d->keys );
+}
+
+/*
+============
+DictFind
+
+Returns the slot of the key or the empty slot it goes to
+============
+*/
+static liKeySlot_t *DictFind( liKeyDict_t *d, liStr_t *key ) {
+    uint32_t i = (uint32_t)HashBytes( sstr(key), slen(key), LI_HASH_INIT );
+    liKeySlot_t *slot;
+
+    while( 1 ) {
+        slot = d->slots + (i & d->mask);
+        if( !slot->key || slot->key == key ||
+                LiSCmpL( slot->key, sstr(key), slen(key) ) ) {
+            return slot;
+        }
+        i++;
+    }
+}
+
+/*
+============
+DictGrow
+============
+*/
+static void DictGrow( liKeyDict_t *d ) {
+    liKeySlot_t *old = d->slots;
+    uint32_t oldMask = d->mask;
+    uint32_t i;
+
+    d->mask = d->mask * 2 + 1;
+    d->slots = (liKeySlot_t*)LiAlloc( sizeof(liKeySlot_t) * (d->mask + 1),
+            LI_TYID_DICT );
+    for( i = 0; i <= d->mask; i++ ) {
+        d->slots[i].key = NULL;
+    }
+    for( i = 0; i <= oldMask; i++ ) {
+        if( old[i].key ) {
+            *DictFind( d, old[i].key ) = old[i];
+        }
+    }
+    LiDealloc( old );
+    d->keys = (liStr_t**)LiRealloc( d->keys, sizeof(liStr_t*) * 
+            (d->mask + 1), LI_TYID_DICT );
+}
+
+/*
+============
+DictAdd
+============
+*/
+static void DictAdd( liKeyDict_t *d, liStr_t *key ) {
+    liKeySlot_t *slot = DictFind( d, key );
+
+    if( slot->key ) {
+        return;
+    }
+    slot->key = key;
+    slot->index = d->numKeys;
+    d->keys[ d->numKeys++ ] = key;
+    if( d->numKeys * 2 > d->mask ) {
+        DictGrow( d );
+    }
+}
+
+/*
+============
+DictCollect_r
+============
+*/
+static void DictCollect_r( liKeyDict_t *d, liObj_t *o, int level ) {
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+
+    for( ; o; o = o->next ) {
+        if( o->key && !(o->prev && o->prev->key == o->key) ) {
+            DictAdd( d, o->key );
+        }
+        if( o->firstChild ) {
+            DictCollect_r( d, o->firstChild, level + 1 );
+        }
+    }
+}
+
+
+
+/*
+================================================
+                 binary writer
+================================================
+*/
+
+/*
+============
+BinFlush
+============
+*/
+static void BinFlush( liBinOut_t *out ) {
+    if( out->len && out->code == LI_OK ) {
+        if( out->wr( out->buf, out->len, out->f ) != (ssize_t)out->len ) {
+            out->code = LI_EWRITE;
+        }
+    }
+    out->len = 0;
+}
+
+/*
+============
+BinPutBytes
+============
+*/
+static void BinPutBytes( liBinOut_t *out, const void *data, size_t len ) {
+    const uint8_t *p = (const uint8_t*)data;
+    size_t n;
+
+    while( len ) {
+        if( out->len == BIN_BUF_SIZE ) {
+            BinFlush( out );
+        }
+        n = BIN_BUF_SIZE - out->len;
+        if( n > len ) {
+            n = len;
+        }
+        MemCpy( out->buf + out->len, p, n );
+        out->len += n;
+        p += n;
+        len -= n;
+    }
+}
+
+/*
+============
+BinPutByte
+============
+*/
+static void BinPutByte( liBinOut_t *out, uint8_t b ) {
+    if( out->len == BIN_BUF_SIZE ) {
+        BinFlush( out );
+    }
+    out->buf[ out->len++ ] = b;
+}
+
+/*
+============
+BinPutVarint
+============
+*/
+static void BinPutVarint( liBinOut_t *out, uint64_t v ) {
+    uint8_t tmp[10];
+    int n = 0;
+
+    while( v >= 0x80 ) {
+        tmp[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    tmp[n++] = (uint8_t)v;
+    BinPutBytes( out, tmp, n );
+}
+
+/*
+============
+BinWrite_r
+============
+*/
+static void BinWrite_r( liBinOut_t *out, liKeyDict_t *d, liObj_t *o,
+        int level ) {
+    uint8_t tag;
+
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+
+    for( ; o; o = o->next ) {
+        liassert( o->type >= LI_VTNULL && o->type <= LI_VTBOOL );
+
+        tag = (uint8_t)o->type;
+        tag |= (uint8_t)((o->flags & LI_FBASE_MASK) << BIN_FLAG_SHIFT);
+        if( o->flags & LI_FSIGN ) {
+            tag |= BIN_FSIGN;
+        }
+        if( o->key ) {
+            tag |= (o->prev && o->prev->key == o->key) ?
+                    BIN_KEYRUN : BIN_KEYDICT;
+        }
+        BinPutByte( out, tag );
+        if( tag & BIN_KEYDICT ) {
+            BinPutVarint( out, DictFind( d, o->key )->index );
+        }
+
+        switch( o->type ) {
+            case LI_VTSTR:
+                if( o->vstr ) {
+                    BinPutVarint( out, (uint64_t)slen(o->vstr) + 1 );
+                    BinPutBytes( out, sstr(o->vstr), slen(o->vstr) );
+                } else {
+                    BinPutVarint( out, 0 );
+                }
+                break;
+
+            case LI_VTINT:
+                /* zigzag */
+                BinPutVarint( out, ((uint64_t)o->vint << 1) ^
+                        (uint64_t)(o->vint >> 63) );
+                break;
+
+            case LI_VTUINT:
+                BinPutVarint( out, o->vuint );
+                break;
+
+            case LI_VTBOOL:
+                BinPutByte( out, o->vint ? 1 : 0 );
+                break;
+
+            case LI_VTOBJ:
+                if( o->firstChild ) {
+                    BinWrite_r( out, d, o->firstChild, level + 1 );
+                }
+                BinPutByte( out, 0 );
+                break;
+
+            default:
+                /* LI_VTNULL */
+                break;
+        }
+    }
+}
+
+/*
+============
+LiWriteBinary
+
+Writes the node and its next siblings in the binary format
+============
+*/
+licode_t LiWriteBinary( liIO_t *io, liObj_t *o, const char *name,
+        liflag_t flags ) {
+    liassert( o );
+
+    liBinOut_t out;
+    liKeyDict_t dict;
+    uint32_t i;
+
+    liunused( flags );
+    if( io == NULL ) {
+        extern liIO_t liDefaultIO;
+        io = &liDefaultIO;
+    }
+
+    out.f = io->open( name, 'w' );
+    if( out.f == NULL ) {
+        return LI_EFILEOPEN;
+    }
+    out.wr = io->write;
+    out.buf = (uint8_t*)LiAlloc( BIN_BUF_SIZE, LI_TYID_BUF );
+    out.len = 0;
+    out.code = LI_OK;
+
+    /* header with the key dictionary */
+    DictInit( &dict );
+    DictCollect_r( &dict, o, 0 );
+    BinPutBytes( &out, BIN_MAGIC, BIN_MAGIC_LEN );
+    BinPutVarint( &out, dict.numKeys );
+    for( i = 0; i < dict.numKeys; i++ ) {
+        BinPutVarint( &out, slen(dict.keys[i]) );
+        BinPutBytes( &out, sstr(dict.keys[i]), slen(dict.keys[i]) );
+    }
+
+    /* nodes */
+    BinWrite_r( &out, &dict, o, 0 );
+    BinPutByte( &out, 0 );
+    BinFlush( &out );
+    if( out.code == LI_OK && out.wr( out.buf, 0, out.f ) < 0 ) {
+        out.code = LI_EWRITE;
+    }
+
+    DictFree( &dict );
+    LiDealloc( out.buf );
+    io->close( out.f );
+
+    return out.code;
+}
+
+
+
+/*
+================================================
+                 binary reader
+================================================
+*/
+
+/*
+============
+BinFill
+============
+*/
+static libool_t BinFill( liBinIn_t *in ) {
+    ssize_t rsiz;
+
+    if( in->code != LI_OK ) {
+        return lifalse;
+    }
+    rsiz = in->rd( in->buf, BIN_BUF_SIZE, in->f );
+    if( rsiz <= 0 ) {
+        in->code = rsiz < 0 ? LI_EREAD : LI_EINPDAT;
+        return lifalse;
+    }
+    in->pos = 0;
+    in->len = (size_t)rsiz;
+    return litrue;
+}
+
+/*
+============
+BinGetByte
+============
+*/
+static uint8_t BinGetByte( liBinIn_t *in ) {
+    if( in->pos == in->len && !BinFill( in ) ) {
+        return 0;
+    }
+    return in->buf[ in->pos++ ];
+}
+
+/*
+============
+BinGetBytes
+============
+*/
+static void BinGetBytes( liBinIn_t *in, void *data, size_t len ) {
+    uint8_t *p = (uint8_t*)data;
+    size_t n;
+
+    while( len ) {
+        if( in->pos == in->len && !BinFill( in ) ) {
+            return;
+        }
+        n = in->len - in->pos;
+        if( n > len ) {
+            n = len;
+        }
+        MemCpy( p, in->buf + in->pos, n );
+        in->pos += n;
+        p += n;
+        len -= n;
+    }
+}
+
+/*
+============
+BinGetVarint
+============
+*/
+static uint64_t BinGetVarint( liBinIn_t *in ) {
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+
+    do {
+        b = BinGetByte( in );
+        if( shift > 63 ) {
+            in->code = LI_EINPDAT;
+            return 0;
+        }
+        v |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while( (b & 0x80) && in->code == LI_OK );
+
+    return v;
+}
+
+/*
+============
+BinGetStr
+
+The string grows with the data that arrives, so a
+length bigger than the rest of the input allocates
+no more than the input holds. Returns NULL if the
+input ends first.
+
+type - accounted type (LI_TYID_STR, LI_TYID_KEY)
+============
+*/
+static liStr_t *BinGetStr( liBinIn_t *in, uint64_t len, lityid_t type ) {
+    liStr_t *s, *t;
+    size_t n;
+    libool_t grown = lifalse;
+
+    if( len >= (lisize_t)-1 ) {
+        in->code = LI_EINPDAT;
+        return NULL;
+    }
+    n = in->len - in->pos;
+    s = LiSAllocType( (lisize_t)(len < n ? len : n) + 1, type );
+    while( len ) {
+        if( in->pos == in->len && !BinFill( in ) ) {
+            LiSFree( s );
+            return NULL;
+        }
+        n = in->len - in->pos;
+        if( n > len ) {
+            n = (size_t)len;
+        }
+        if( slen(s) + n + 1 > salc(s) ) {
+            grown = litrue;
+        }
+        s = LiSCatL( s, (const char*)in->buf + in->pos, (lisize_t)n );
+        in->pos += n;
+        len -= n;
+    }
+    if( grown && type != LI_TYID_STR ) {
+        /* the reallocation counted it as a string value */
+        t = LiSAllocType( slen(s) + 1, type );
+        MemCpy( sstr(t), sstr(s), (size_t)slen(s) + 1 );
+        slen(t) = slen(s);
+        LiSFree( s );
+        s = t;
+    }
+
+    return s;
+}
+
+/*
+============
+BinRead_r
+
+Reads a node list up to its zero tag and links it to
+the parent. Returns the first node.
+============
+*/
+static liObj_t *BinRead_r( liBinIn_t *in, liStr_t **keys, lisize_t numKeys,
+        liObj_t *parent, int level ) {
+    liObj_t *first = NULL;
+    liObj_t *last = NULL;
+    liObj_t *o;
+    liStr_t *key;
+    uint64_t v;
+    uint8_t tag;
+
+    if( level > LI_MAX_NESTING_LEVEL ) {
+        in->code = LI_EINPDAT;
+        return NULL;
+    }
+
+    while( (tag = BinGetByte( in )) != 0 && in->code == LI_OK ) {
+        /* key */
+        key = NULL;
+        if( tag & BIN_KEYDICT ) {
+            v = BinGetVarint( in );
+            if( v >= numKeys ) {
+                in->code = LI_EINPDAT;
+                break;
+            }
+            key = keys[v];
+            /* equal adjacent keys that were not a run stay apart */
+            key = (last && last->key == key) ?
+                    LiSNewKeyL( sstr(key), slen(key) ) : LiSRef( key );
+        } else if( tag & BIN_KEYRUN ) {
+            if( !last || !last->key ) {
+                in->code = LI_EINPDAT;
+                break;
+            }
+            key = LiSRef( last->key );
+        }
+
+        /* value */
+        switch( tag & BIN_TYPE_MASK ) {
+            case LI_VTNULL:
+                o = LiNull();
+                break;
+            case LI_VTOBJ:
+                o = LiObj();
+                break;
+            case LI_VTSTR:
+                o = LiStrL( NULL, 0 );
+                v = BinGetVarint( in );
+                if( v ) {
+                    o->vstr = BinGetStr( in, v - 1, LI_TYID_STR );
+                }
+                break;
+            case LI_VTINT:
+                v = BinGetVarint( in );
+                o = LiInt( (int64_t)((v >> 1) ^ (~(v & 1) + 1)) );
+                break;
+            case LI_VTUINT:
+                o = LiUint( BinGetVarint( in ) );
+                break;
+            case LI_VTBOOL:
+                o = LiBool( BinGetByte( in ) ? litrue : lifalse );
+                break;
+            default:
+                in->code = LI_EINPDAT;
+                o = NULL;
+                break;
+        }
+        if( !o ) {
+            if( key ) {
+                LiSFree( key );
+            }
+            break;
+        }
+        o->key = key;
+        o->flags = (tag >> BIN_FLAG_SHIFT) & LI_FBASE_MASK;
+        if( tag & BIN_FSIGN ) {
+            o->flags |= LI_FSIGN;
+        }
+
+        /* link */
+        o->parent = parent;
+        o->prev = last;
+        if( last ) {
+            last->next = o;
+        } else {
+            first = o;
+        }
+        last = o;
+
+        if( o->type == LI_VTOBJ ) {
+            BinRead_r( in, keys, numKeys, o, level + 1 );
+        }
+    }
+
+    if( parent ) {
+        parent->firstChild = first;
+        parent->lastChild = last;
+    }
+
+    return first;
+}
+
+/*
+============
+LiReadBinary
+
+Reads a file written by LiWriteBinary
+============
+*/
+licode_t LiReadBinary( liIO_t *io, liObj_t **o, const char *name,
+        liflag_t flags ) {
+    liassert( o );
+    liassert( *o == NULL );
+
+    liBinIn_t in;
+    liStr_t **keys = NULL;
+    uint64_t numKeys = 0;
+    uint64_t numAlloced = 0;
+    uint64_t i = 0;
+    char magic[BIN_MAGIC_LEN];
+
+    liunused( flags );
+    if( io == NULL ) {
+        extern liIO_t liDefaultIO;
+        io = &liDefaultIO;
+    }
+
+    in.f = io->open( name, 'r' );
+    if( in.f == NULL ) {
+        return LI_EFILEOPEN;
+    }
+    in.rd = io->read;
+    in.buf = (uint8_t*)LiAlloc( BIN_BUF_SIZE, LI_TYID_BUF );
+    in.pos = 0;
+    in.len = 0;
+    in.code = LI_OK;
+
+    /* header */
+    BinGetBytes( &in, magic, BIN_MAGIC_LEN );
+    if( in.code == LI_OK &&
+            (magic[0] != 'L' || magic[1] != 'I' || magic[2] != 'B' ||
+            magic[3] != '\1') ) {
+        in.code = LI_EINPDAT;
+    }
+    if( in.code == LI_OK ) {
+        numKeys = BinGetVarint( &in );
+        if( numKeys > ((uint64_t)1 << 31) / sizeof(liStr_t*) ) {
+            in.code = LI_EINPDAT;
+        }
+    }
+    /* every key takes at least one byte, the table grows
+    with the keys read so a forged count allocates nothing */
+    for( i = 0; i < numKeys && in.code == LI_OK; i++ ) {
+        if( i == numAlloced ) {
+            numAlloced = numAlloced ? numAlloced * 2 : 64;
+            if( numAlloced > numKeys ) {
+                numAlloced = numKeys;
+            }
+            keys = (liStr_t**)(keys ?
+                    LiRealloc( keys, sizeof(liStr_t*) * numAlloced,
+                    LI_TYID_DICT ) :
+                    LiAlloc( sizeof(liStr_t*) * numAlloced, LI_TYID_DICT ));
+        }
+        keys[i] = BinGetStr( &in, BinGetVarint( &in ), LI_TYID_KEY );
+    }
+    numKeys = i;
+
+    /* nodes */
+    if( in.code == LI_OK ) {
+        *o = BinRead_r( &in, keys, (lisize_t)numKeys, NULL, 0 );
+        if( in.code != LI_OK && *o ) {
+            LiFree( *o );
+            *o = NULL;
+        }
+    }
+
+    /* the dictionary gives up its references */
+    if( keys ) {
+        for( i = 0; i < numKeys; i++ ) {
+            if( keys[i] ) {
+                LiSFree( keys[i] );
+            }
+        }
+        LiDealloc( keys );
+    }
+    LiDealloc( in.buf );
+    io->close( in.f );
+
+    return in.code;
+}
@@ -0,0 +1,672 @@
+#include "lidiff.h"
+#include "liassert.h"
+#include "liutil.h"
+
+#include <string.h>
+
+
+
+/*
+================================================
+                  li diff
+
+Sibling lists are compared level by level. Nodes are
+paired through hash tables of the cached subtree hashes: first the same key and
+value, then the same value under another key (key op),
+then the same key (the value is compared deeper or
+replaced). The pairs that keep their order (the longest
+increasing run of positions) stay, the other nodes of
+the old list are deleted and the new ones inserted.
+================================================
+*/
+
+typedef struct {
+    liObj_t     **nodes;
+    uint64_t    *keyHash;
+    uint64_t    *valHash;
+    lisize_t    *match;     /* paired node of the other list + 1 */
+    lisize_t    num;
+} liSide_t;
+
+typedef struct {
+    liObj_t     *first;     /* script */
+    liObj_t     *last;
+    lisize_t    path[LI_MAX_NESTING_LEVEL + 1];
+} liDiff_t;
+
+/*
+============
+KeyHash
+============
+*/
+static uint64_t KeyHash( liStr_t *key ) {
+    if( !key ) {
+        return LI_HASH_INIT;
+    }
+    return HashBytes( sstr(key), slen(key), LI_HASH_INIT );
+}
+
+/*
+============
+KeyEqual
+============
+*/
+static libool_t KeyEqual( liStr_t *a, liStr_t *b ) {
+    if( a == b ) {
+        return litrue;
+    }
+    if( !a || !b || slen(a) != slen(b) ) {
+        return lifalse;
+    }
+    return memcmp( sstr(a), sstr(b), slen(a) ) == 0;
+}
+
+/*
+============
+ValueHash
+
+Type, flags, value and the cached hashes of the
+children, the key of the node is left out
+============
+*/
+static uint64_t ValueHash( liObj_t *o ) {
+    uint64_t h = LI_HASH_INIT;
+    uint64_t ch;
+    liObj_t *it;
+
+    h = HashBytes( &o->type, sizeof(o->type), h );
+    ch = o->flags & ~LI_FEMBED;
+    h = HashBytes( &ch, sizeof(ch), h );
+    switch( o->type ) {
+        case LI_VTSTR:
+            if( o->vstr ) {
+                h = HashBytes( sstr(o->vstr), slen(o->vstr), h );
+            }
+            break;
+        case LI_VTINT:
+        case LI_VTUINT:
+        case LI_VTBOOL:
+            h = HashBytes( &o->vint, sizeof(o->vint), h );
+            break;
+        default:
+            break;
+    }
+    for( it = o->firstChild; it; it = it->next ) {
+        ch = LiHash( it );
+        h = HashBytes( &ch, sizeof(ch), h );
+    }
+    return h;
+}
+
+/*
+============
+ValueEqual
+============
+*/
+static libool_t ValueEqual( liObj_t *a, liObj_t *b ) {
+    liObj_t *ia, *ib;
+
+    if( a->type != b->type || ((a->flags ^ b->flags) & ~LI_FEMBED) ) {
+        return lifalse;
+    }
+    switch( a->type ) {
+        case LI_VTSTR:
+            if( !KeyEqual( a->vstr, b->vstr ) ) {
+                return lifalse;
+            }
+            break;
+        case LI_VTINT:
+        case LI_VTUINT:
+        case LI_VTBOOL:
+            if( a->vint != b->vint ) {
+                return lifalse;
+            }
+            break;
+        default:
+            break;
+    }
+    for( ia = a->firstChild, ib = b->firstChild; ia && ib;
+            ia = ia->next, ib = ib->next ) {
+        if( !LiEqual( ia, ib ) ) {
+            return lifalse;
+        }
+    }
+    return ia == ib;
+}
+
+/*
+============
+SideInit
+============
+*/
+static void SideInit( liSide_t *s, liObj_t *first ) {
+    liObj_t *it;
+    lisize_t i;
+
+    s->num = 0;
+    for( it = first; it; it = it->next ) {
+        s->num++;
+    }
+    if( !s->num ) {
+        return;
+    }
+
+    s->nodes = (liObj_t**)LiAlloc( s->num * sizeof(liObj_t*), LI_TYID_BUF );
+    s->keyHash = (uint64_t*)LiAlloc( s->num * sizeof(uint64_t), LI_TYID_BUF );
+    s->valHash = (uint64_t*)LiAlloc( s->num * sizeof(uint64_t), LI_TYID_BUF );
+    s->match = (lisize_t*)LiAlloc( s->num * sizeof(lisize_t), LI_TYID_BUF );
+    for( it = first, i = 0; it; it = it->next, i++ ) {
+        s->nodes[i] = it;
+        s->keyHash[i] = KeyHash( it->key );
+        s->valHash[i] = ValueHash( it );
+        s->match[i] = 0;
+    }
+}
+
+/*
+============
+SideFree
+============
+*/
+static void SideFree( liSide_t *s ) {
+    if( !s->num ) {
+        return;
+    }
+    LiDealloc( s->nodes );
+    LiDealloc( s->keyHash );
+    LiDealloc( s->valHash );
+    LiDealloc( s->match );
+}
+
+/* pairing passes */
+#define PASS_SAME       0
+#define PASS_REKEY      1
+#define PASS_KEY        2
+
+/*
+============
+PassHash
+============
+*/
+static uint64_t PassHash( liSide_t *s, lisize_t i, int pass ) {
+    switch( pass ) {
+        case PASS_SAME:
+            return LiHash( s->nodes[i] );
+        case PASS_REKEY:
+            return s->valHash[i];
+        default:
+            return s->keyHash[i];
+    }
+}
+
+/*
+============
+PairNodes
+
+Pairs the nodes of b with the nodes of a. The unpaired
+nodes of a are chained in list order under one bucket
+per distinct hash, the bucket keeps a cursor to its
+first unpaired node, so a run of equal keys is paired
+in constant time per node.
+============
+*/
+static void PairNodes( liSide_t *a, liSide_t *b, int pass ) {
+    lisize_t size, mask, i, j, k, numBuckets = 0;
+    lisize_t *table;        /* bucket + 1 by hash */
+    lisize_t *head;         /* first unpaired node + 1 of a bucket */
+    lisize_t *tail;         /* last node + 1 of a bucket */
+    lisize_t *chain;        /* next node + 1 of the same hash */
+    uint64_t *hashes;       /* hash of a bucket */
+    uint64_t h;
+    liObj_t *na, *nb;
+    libool_t eq;
+
+    size = CeilPow2( a->num * 2 );
+    mask = size - 1;
+    table = (lisize_t*)LiAlloc( size * sizeof(lisize_t), LI_TYID_BUF );
+    head = (lisize_t*)LiAlloc( a->num * sizeof(lisize_t), LI_TYID_BUF );
+    tail = (lisize_t*)LiAlloc( a->num * sizeof(lisize_t), LI_TYID_BUF );
+    chain = (lisize_t*)LiAlloc( a->num * sizeof(lisize_t), LI_TYID_BUF );
+    hashes = (uint64_t*)LiAlloc( a->num * sizeof(uint64_t), LI_TYID_BUF );
+    memset( table, 0, size * sizeof(lisize_t) );
+    for( i = 0; i < a->num; i++ ) {
+        chain[i] = 0;
+        if( a->match[i] ) {
+            continue;
+        }
+        h = PassHash( a, i, pass );
+        for( j = (lisize_t)h & mask; table[j]; j = (j + 1) & mask ) {
+            if( hashes[table[j] - 1] == h ) {
+                break;
+            }
+        }
+        if( table[j] ) {
+            k = table[j] - 1;
+            chain[tail[k] - 1] = i + 1;
+            tail[k] = i + 1;
+        } else {
+            k = numBuckets++;
+            table[j] = k + 1;
+            hashes[k] = h;
+            head[k] = i + 1;
+            tail[k] = i + 1;
+        }
+    }
+
+    for( i = 0; i < b->num; i++ ) {
+        if( b->match[i] ) {
+            continue;
+        }
+        h = PassHash( b, i, pass );
+        for( j = (lisize_t)h & mask; table[j]; j = (j + 1) & mask ) {
+            if( hashes[table[j] - 1] == h ) {
+                break;
+            }
+        }
+        if( !table[j] ) {
+            continue;
+        }
+        k = table[j] - 1;
+        while( head[k] && a->match[head[k] - 1] ) {
+            head[k] = chain[head[k] - 1];
+        }
+
+        /* the first unpaired node matches unless the hashes collide */
+        nb = b->nodes[i];
+        for( j = head[k]; j; j = chain[j - 1] ) {
+            if( a->match[j - 1] ) {
+                continue;
+            }
+            na = a->nodes[j - 1];
+            switch( pass ) {
+                case PASS_SAME:
+                    eq = LiEqual( na, nb );
+                    break;
+                case PASS_REKEY:
+                    eq = ValueEqual( na, nb );
+                    break;
+                default:
+                    eq = KeyEqual( na->key, nb->key );
+                    break;
+            }
+            if( eq ) {
+                a->match[j - 1] = i + 1;
+                b->match[i] = j;
+                break;
+            }
+        }
+    }
+
+    LiDealloc( hashes );
+    LiDealloc( chain );
+    LiDealloc( tail );
+    LiDealloc( head );
+    LiDealloc( table );
+}
+
+/*
+============
+KeepInOrder
+
+Unpairs the nodes of b that are not in the longest
+run of increasing positions in a
+============
+*/
+static void KeepInOrder( liSide_t *a, liSide_t *b ) {
+    lisize_t *tail, *prev, *keep;
+    lisize_t len = 0, lo, hi, mid, i, k;
+
+    /* patience sorting, tail[k] - b index ending a run of k + 1 */
+    tail = (lisize_t*)LiAlloc( b->num * sizeof(lisize_t), LI_TYID_BUF );
+    prev = (lisize_t*)LiAlloc( b->num * sizeof(lisize_t), LI_TYID_BUF );
+    keep = (lisize_t*)LiAlloc( b->num * sizeof(lisize_t), LI_TYID_BUF );
+    for( i = 0; i < b->num; i++ ) {
+        keep[i] = 0;
+        if( !b->match[i] ) {
+            continue;
+        }
+        lo = 0;
+        hi = len;
+        while( lo < hi ) {
+            mid = (lo + hi) / 2;
+            if( b->match[tail[mid]] < b->match[i] ) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        prev[i] = lo ? tail[lo - 1] : i;
+        tail[lo] = i;
+        if( lo == len ) {
+            len++;
+        }
+    }
+    if( len ) {
+        for( i = tail[len - 1], k = 0; k < len; k++ ) {
+            keep[i] = 1;
+            i = prev[i];
+        }
+    }
+
+    for( i = 0; i < b->num; i++ ) {
+        if( b->match[i] && !keep[i] ) {
+            a->match[b->match[i] - 1] = 0;
+            b->match[i] = 0;
+        }
+    }
+
+    LiDealloc( keep );
+    LiDealloc( prev );
+    LiDealloc( tail );
+}
+
+/*
+============
+AddOp
+============
+*/
+static liObj_t *AddOp( liDiff_t *d, const char *name, int depth ) {
+    liObj_t *op = LiObj();
+    liObj_t *o;
+    int i;
+
+    LiSetKey( op, name );
+    for( i = 0; i <= depth; i++ ) {
+        o = LiUint( d->path[i] );
+        if( !i ) {
+            LiSetKey( o, "at" );
+        }
+        /* the run shares the key */
+        LiInsertLastChild( op, o );
+    }
+
+    if( d->last ) {
+        LiInsertAfter( d->last, op );
+    } else {
+        d->first = op;
+    }
+    d->last = op;
+    return op;
+}
+
+/*
+============
+AddNode
+============
+*/
+static void AddNode( liObj_t *op, liObj_t *node ) {
+    liObj_t *n = LiObj();
+    LiSetKey( n, "node" );
+    LiInsertLastChild( n, LiClone( node ) );
+    LiInsertLastChild( op, n );
+}
+
+/*
+============
+DiffList_r
+============
+*/
+static void DiffList_r( liDiff_t *d, liObj_t *firstA, liObj_t *firstB,
+        int level ) {
+    liSide_t a, b;
+    liObj_t *na, *nb, *op, *o;
+    lisize_t i;
+
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+
+    SideInit( &a, firstA );
+    SideInit( &b, firstB );
+    if( a.num && b.num ) {
+        PairNodes( &a, &b, PASS_SAME );
+        PairNodes( &a, &b, PASS_REKEY );
+        PairNodes( &a, &b, PASS_KEY );
+        KeepInOrder( &a, &b );
+    }
+
+    /* delete from the end, the positions before stay valid */
+    for( i = a.num; i-- > 0; ) {
+        if( !a.match[i] ) {
+            d->path[level] = i;
+            AddOp( d, "del", level );
+        }
+    }
+
+    for( i = 0; i < b.num; i++ ) {
+        d->path[level] = i;
+        nb = b.nodes[i];
+        if( !b.match[i] ) {
+            AddNode( AddOp( d, "ins", level ), nb );
+            continue;
+        }
+
+        na = a.nodes[b.match[i] - 1];
+        if( !KeyEqual( na->key, nb->key ) ) {
+            op = AddOp( d, "key", level );
+            o = LiStrL( nb->key ? sstr(nb->key) : "",
+                    nb->key ? slen(nb->key) : 0 );
+            LiSetKey( o, "name" );
+            LiInsertLastChild( op, o );
+        }
+        if( a.valHash[b.match[i] - 1] == b.valHash[i] &&
+                ValueEqual( na, nb ) ) {
+            continue;
+        }
+        if( na->type == LI_VTOBJ && nb->type == LI_VTOBJ &&
+                na->flags == nb->flags ) {
+            DiffList_r( d, na->firstChild, nb->firstChild, level + 1 );
+        } else {
+            AddNode( AddOp( d, "set", level ), nb );
+        }
+    }
+
+    SideFree( &b );
+    SideFree( &a );
+}
+
+/*
+============
+LiDiff
+
+Returns the script that turns the list of a into the
+list of b (NULL - no differences), only the hashes of
+the trees are computed
+============
+*/
+liObj_t *LiDiff( liObj_t *a, liObj_t *b ) {
+    liDiff_t *d;
+    liObj_t *script;
+
+    d = (liDiff_t*)LiAlloc( sizeof(liDiff_t), LI_TYID_BUF );
+    d->first = NULL;
+    d->last = NULL;
+    DiffList_r( d, a ? LiFirst( a ) : NULL, b ? LiFirst( b ) : NULL, 0 );
+    script = d->first;
+    LiDealloc( d );
+
+    return script;
+}
+
+
+
+/*
+================================================
+                  li patch
+================================================
+*/
+
+/*
+============
+ShareKey
+
+Takes the key of an equal keyed neighbour, so the
+node is written as part of its run
+============
+*/
+static void ShareKey( liObj_t *o ) {
+    liObj_t *n = NULL;
+
+    if( o->prev && KeyEqual( o->prev->key, o->key ) ) {
+        n = o->prev;
+    } else if( o->next && KeyEqual( o->next->key, o->key ) ) {
+        n = o->next;
+    }
+    if( n && n->key != o->key ) {
+        LiSFree( o->key );
+        o->key = LiSRef( n->key );
+    }
+}
+
+/*
+============
+Nth
+============
+*/
+static liObj_t *Nth( liObj_t *first, uint64_t n ) {
+    while( first && n-- ) {
+        first = first->next;
+    }
+    return first;
+}
+
+/*
+============
+OpChild
+============
+*/
+static liObj_t *OpChild( liObj_t *op, const char *key ) {
+    liObj_t *it;
+    for( it = op->firstChild; it; it = it->next ) {
+        if( it->key && LiSCmp( it->key, key ) ) {
+            return it;
+        }
+    }
+    return NULL;
+}
+
+/*
+============
+ApplyOp
+============
+*/
+static licode_t ApplyOp( liObj_t **root, liObj_t *op ) {
+    liObj_t *list = *root;
+    liObj_t *parent = NULL;
+    liObj_t *at, *node, *target, *o;
+    uint64_t idx;
+
+    if( op->type != LI_VTOBJ || !op->key || !(at = OpChild( op, "at" )) ) {
+        return LI_EINPDAT;
+    }
+
+    /* walk the path down to the list of the node */
+    while( 1 ) {
+        if( at->type != LI_VTUINT &&
+                (at->type != LI_VTINT || at->vint < 0) ) {
+            return LI_EINPDAT;
+        }
+        idx = at->vuint;
+        if( !at->next || !KeyEqual( at->next->key, at->key ) ) {
+            /* the last position */
+            break;
+        }
+        parent = Nth( list, idx );
+        if( !parent || parent->type != LI_VTOBJ ) {
+            return LI_EINPDAT;
+        }
+        list = parent->firstChild;
+        at = at->next;
+    }
+    target = Nth( list, idx );
+
+    if( LiSCmp( op->key, "ins" ) ) {
+        node = OpChild( op, "node" );
+        if( !node || !node->firstChild || !node->firstChild->key ||
+                (!target && idx && !Nth( list, idx - 1 )) ) {
+            return LI_EINPDAT;
+        }
+        o = LiClone( node->firstChild );
+        if( target ) {
+            LiInsertBefore( target, o );
+            if( target == *root ) {
+                *root = o;
+            }
+        } else if( parent ) {
+            LiInsertLastChild( parent, o );
+        } else if( list ) {
+            LiInsertLast( list, o );
+        } else {
+            *root = o;
+        }
+        ShareKey( o );
+        return LI_OK;
+    }
+
+    if( !target ) {
+        return LI_EINPDAT;
+    }
+
+    if( LiSCmp( op->key, "del" ) ) {
+        if( target == *root ) {
+            *root = target->next;
+        }
+        LiFreeSubtree( target );
+    } else if( LiSCmp( op->key, "set" ) ) {
+        node = OpChild( op, "node" );
+        if( !node || !node->firstChild ) {
+            return LI_EINPDAT;
+        }
+        o = LiClone( node->firstChild );
+        /* the key stays */
+        if( o->key ) {
+            LiSFree( o->key );
+        }
+        o->key = target->key ? LiSRef( target->key ) : NULL;
+        LiInsertAfter( target, o );
+        if( target == *root ) {
+            *root = o;
+        }
+        LiFreeSubtree( target );
+    } else if( LiSCmp( op->key, "key" ) ) {
+        node = OpChild( op, "name" );
+        if( !node || node->type != LI_VTSTR || !node->vstr ||
+                !LiIsCorrectKey( sstr(node->vstr), slen(node->vstr) ) ) {
+            return LI_EINPDAT;
+        }
+        /* LiSetKeyL would rename the whole run, the node leaves it */
+        if( target->key ) {
+            LiSFree( target->key );
+        }
+        target->key = LiSNewKeyL( sstr(node->vstr), slen(node->vstr) );
+        LiHashInvalidate( target );
+        ShareKey( target );
+    } else {
+        return LI_EINPDAT;
+    }
+    return LI_OK;
+}
+
+/*
+============
+LiPatch
+
+Applies the script to the list of *root, which may
+get a new first node. On an error the operations
+before the failed one stay applied.
+============
+*/
+licode_t LiPatch( liObj_t **root, liObj_t *script ) {
+    liassert( root );
+
+    liObj_t *op;
+    licode_t code;
+
+    for( op = script ? LiFirst( script ) : NULL; op; op = op->next ) {
+        code = ApplyOp( root, op );
+        if( code != LI_OK ) {
+            return code;
+        }
+    }
+    return LI_OK;
+}
@@ -0,0 +1,20 @@
+#ifndef __LIDIFF_H__
+#define __LIDIFF_H__
+
+#include "li.h"
+
+/*
+An edit script is a li list, so it can be written and
+read like any other li file. Operations are applied in
+order, "at" holds the child positions from the top-level
+list down to the node, as the tree is at that moment.
+
+ins = { at = 0, 2  node = { key = value } }    insert before
+del = { at = 1 }                                delete
+set = { at = 0, 1  node = { key = value } }    replace value
+key = { at = 3  name = "key" }                  change key
+*/
+liObj_t     *LiDiff( liObj_t *a, liObj_t *b );
+licode_t    LiPatch( liObj_t **root, liObj_t *script );
+
+#endif //__LIDIFF_H__
@@ -0,0 +1,305 @@
+#include "lidoc.h"
+#include "liassert.h"
+
+#include <stdatomic.h>
+
+
+
+/*
+================================================
+                  li document
+
+A document holds the current version of a tree.
+Readers pin it inside a read section, a single
+writer prepares a new version and publishes it
+with one pointer swap. Replaced versions are kept
+until every read section that could see them is
+over (epoch based reclamation).
+
+Readers never touch string reference counters, so
+they may stay non-atomic as long as only the writer
+clones and frees versions. Node hashes are cached on
+the first LiHash, so a version is hashed before it is
+published and readers only read the cache.
+================================================
+*/
+
+/* reader slot, one per cache line */
+typedef struct {
+    atomic_uint_fast64_t    epoch;  /* pinned epoch (0 - not reading) */
+    atomic_uint             used;   /* slot is taken by a reader */
+    char                    pad[64 - sizeof(atomic_uint_fast64_t) -
+                                sizeof(atomic_uint)];
+} liDocSlot_t;
+
+/* replaced version waiting to be freed */
+typedef struct liRetired_t {
+    struct liRetired_t      *next;
+    liObj_t                 *root;
+    uint64_t                epoch;  /* epoch the version was replaced in */
+} liRetired_t;
+
+struct liDoc_t {
+    liDocSlot_t             slots[LI_DOC_MAX_READERS];
+    _Atomic(liObj_t*)       current;    /* published version */
+    atomic_uint_fast64_t    epoch;      /* global epoch */
+    liRetired_t             *retired;   /* writer only */
+};
+
+/*
+============
+HashVersion
+
+Fills the hash cache of every top-level node
+============
+*/
+static void HashVersion( liObj_t *root ) {
+    liObj_t *it;
+
+    for( it = root; it; it = it->next ) {
+        LiHash( it );
+    }
+}
+
+/*
+============
+LiDocNew
+============
+*/
+liDoc_t *LiDocNew( liObj_t *root ) {
+    liDoc_t *doc;
+    int i;
+
+    HashVersion( root );
+    doc = (liDoc_t*)LiAlloc( sizeof(liDoc_t), LI_TYID_DOC );
+    for( i = 0; i < LI_DOC_MAX_READERS; i++ ) {
+        atomic_init( &doc->slots[i].epoch, 0 );
+        atomic_init( &doc->slots[i].used, 0 );
+    }
+    atomic_init( &doc->current, root );
+    atomic_init( &doc->epoch, 1 );
+    doc->retired = NULL;
+
+    return doc;
+}
+
+/*
+============
+LiDocFree
+
+Frees the document with all its versions. There
+must be no open readers.
+============
+*/
+void LiDocFree( liDoc_t *doc ) {
+    liObj_t *root;
+    liRetired_t *r;
+    int i;
+
+    liassert( doc );
+    for( i = 0; i < LI_DOC_MAX_READERS; i++ ) {
+        liasserta( !atomic_load( &doc->slots[i].used ),
+                "error: the document still has readers" );
+    }
+
+    while( (r = doc->retired) != NULL ) {
+        doc->retired = r->next;
+        if( r->root ) {
+            LiFree( r->root );
+        }
+        LiDealloc( r );
+    }
+    root = atomic_load( &doc->current );
+    if( root ) {
+        LiFree( root );
+    }
+    LiDealloc( doc );
+}
+
+/*
+============
+LiDocReaderOpen
+
+Takes a reader slot. A reader is meant to be
+opened once per thread and used for any number
+of read sections.
+
+return values:
+LI_OK - the reader is opened
+LI_EBUSY - all LI_DOC_MAX_READERS slots are taken
+============
+*/
+licode_t LiDocReaderOpen( liDoc_t *doc, liDocReader_t *rd ) {
+    uint32_t i;
+    unsigned int expected;
+
+    liassert( doc );
+    liassert( rd );
+
+    for( i = 0; i < LI_DOC_MAX_READERS; i++ ) {
+        expected = 0;
+        if( atomic_compare_exchange_strong( &doc->slots[i].used,
+                &expected, 1 ) ) {
+            rd->doc = doc;
+            rd->slot = i;
+            return LI_OK;
+        }
+    }
+
+    rd->doc = NULL;
+    return LI_EBUSY;
+}
+
+/*
+============
+LiDocReaderClose
+============
+*/
+void LiDocReaderClose( liDocReader_t *rd ) {
+    liassert( rd );
+    liassert( rd->doc );
+    liassert( atomic_load( &rd->doc->slots[rd->slot].epoch ) == 0 );
+
+    atomic_store( &rd->doc->slots[rd->slot].used, 0 );
+    rd->doc = NULL;
+}
+
+/*
+============
+LiDocReadBegin
+
+Starts a read section and returns the current version.
+The version stays valid until LiDocReadEnd and must
+not be changed.
+============
+*/
+liObj_t *LiDocReadBegin( liDocReader_t *rd ) {
+    liDoc_t *doc;
+
+    liassert( rd );
+    liassert( rd->doc );
+
+    doc = rd->doc;
+    liasserta( atomic_load( &doc->slots[rd->slot].epoch ) == 0,
+            "error: read sections can not be nested" );
+    /* pin the epoch before looking at the version */
+    atomic_store( &doc->slots[rd->slot].epoch, atomic_load( &doc->epoch ) );
+    return atomic_load( &doc->current );
+}
+
+/*
+============
+LiDocReadEnd
+============
+*/
+void LiDocReadEnd( liDocReader_t *rd ) {
+    liassert( rd );
+    liassert( rd->doc );
+
+    atomic_store_explicit( &rd->doc->slots[rd->slot].epoch, 0,
+            memory_order_release );
+}
+
+/*
+============
+LiDocWriteBegin
+
+Returns a private copy of the current version for
+the writer to change and publish. Strings are shared
+with the current version, the nodes are copied (see
+LiClone), so this is O(nodes). A writer that makes a
+whole new tree (e.g. from LiReadMem) publishes it
+without this copy.
+============
+*/
+liObj_t *LiDocWriteBegin( liDoc_t *doc ) {
+    liObj_t *root, *first, *last, *it;
+
+    liassert( doc );
+
+    /* only the writer replaces versions, no pinning is needed */
+    root = atomic_load_explicit( &doc->current, memory_order_relaxed );
+    if( !root ) {
+        return LiObj();
+    }
+    /* the version is the whole top-level list */
+    first = last = NULL;
+    for( ; root; root = root->next ) {
+        it = LiClone( root );
+        if( last ) {
+            LiInsertAfter( last, it );
+        } else {
+            first = it;
+        }
+        last = it;
+    }
+    return first;
+}
+
+/*
+============
+LiDocPublish
+
+Makes the root the current version. The replaced
+version is freed as soon as no reader can see it.
+============
+*/
+void LiDocPublish( liDoc_t *doc, liObj_t *root ) {
+    liRetired_t *r;
+
+    liassert( doc );
+    liassert( root );
+
+    /* readers must not write the hash cache */
+    HashVersion( root );
+    r = (liRetired_t*)LiAlloc( sizeof(liRetired_t), LI_TYID_DOC );
+    r->root = atomic_exchange( &doc->current, root );
+    /* readers that pinned an older epoch may still see r->root */
+    r->epoch = atomic_fetch_add( &doc->epoch, 1 ) + 1;
+    r->next = doc->retired;
+    doc->retired = r;
+
+    LiDocReclaim( doc );
+}
+
+/*
+============
+LiDocReclaim
+
+Frees replaced versions no reader can see anymore.
+Must be called by the writer.
+============
+*/
+void LiDocReclaim( liDoc_t *doc ) {
+    liRetired_t **it, *r;
+    uint64_t minEpoch = UINT64_MAX;
+    uint64_t e;
+    int i;
+
+    liassert( doc );
+
+    if( !doc->retired ) {
+        return;
+    }
+
+    /* find the oldest pinned epoch */
+    for( i = 0; i < LI_DOC_MAX_READERS; i++ ) {
+        e = atomic_load( &doc->slots[i].epoch );
+        if( e && e < minEpoch ) {
+            minEpoch = e;
+        }
+    }
+
+    it = &doc->retired;
+    while( (r = *it) != NULL ) {
+        if( r->epoch <= minEpoch ) {
+            *it = r->next;
+            if( r->root ) {
+                LiFree( r->root );
+            }
+            LiDealloc( r );
+        } else {
+            it = &r->next;
+        }
+    }
+}
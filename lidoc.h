@@ -0,0 +1,31 @@
+#ifndef __LIDOC_H__
+#define __LIDOC_H__
+
+#include "li.h"
+
+#define LI_DOC_MAX_READERS      64
+
+/* versioned li document */
+typedef struct liDoc_t liDoc_t;
+
+/* document reader */
+typedef struct {
+    liDoc_t             *doc;       /* document */
+    uint32_t            slot;       /* reader slot */
+} liDocReader_t;
+
+
+liDoc_t     *LiDocNew( liObj_t *root );
+void        LiDocFree( liDoc_t *doc );
+
+licode_t    LiDocReaderOpen( liDoc_t *doc, liDocReader_t *rd );
+void        LiDocReaderClose( liDocReader_t *rd );
+liObj_t     *LiDocReadBegin( liDocReader_t *rd );
+void        LiDocReadEnd( liDocReader_t *rd );
+
+liObj_t     *LiDocWriteBegin( liDoc_t *doc );
+void        LiDocPublish( liDoc_t *doc, liObj_t *root );
+void        LiDocReclaim( liDoc_t *doc );
+
+
+#endif //__LIDOC_H__
@@ -0,0 +1,770 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "liimg.h"
+#include "liassert.h"
+#include "liutil.h"
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+/*
+================================================
+                  li image
+
+A relocatable document image that is used in place,
+no li objects are built. All links are offsets, so
+the image can be mapped at any address.
+
+    header
+    nodes       liImgNode_t in preorder, links are
+                node indices (0 - no node)
+    strings     uint32 length, bytes, \0, 4-byte aligned
+
+Values are stored in the byte order of the machine that
+wrote the image, images of another order are refused.
+================================================
+*/
+
+#define IMG_MAGIC           "LIM\1"
+#define IMG_ORDER           0x01020304
+
+typedef struct {
+    char        magic[4];
+    uint32_t    order;      /* IMG_ORDER */
+    uint32_t    nodeSize;   /* sizeof(liImgNode_t) */
+    uint32_t    numNodes;   /* number of nodes */
+    uint64_t    nodesOfs;   /* offset of the first node */
+    uint64_t    size;       /* size of the image */
+} liImgHeader_t;
+
+typedef struct {
+    uint32_t    parent;
+    uint32_t    next;
+    uint32_t    prev;
+    uint32_t    firstChild;
+    uint32_t    lastChild;
+    uint16_t    type;
+    uint16_t    flags;
+    uint64_t    key;        /* key string offset (0 - no key) */
+    uint64_t    value;      /* value or string offset */
+} liImgNode_t;
+
+struct liImage_t {
+    const char          *base;
+    size_t              size;
+    const liImgNode_t   *nodes;     /* nodes[0] is node 1 */
+    uint32_t            numNodes;
+    libool_t            mapped;
+};
+
+#define ImgStrSize(len)     ((sizeof(uint32_t) + (len) + 1 + 3) & ~(size_t)3)
+
+
+
+/*
+================================================
+                 image writer
+================================================
+*/
+
+typedef struct {
+    char        *base;
+    uint32_t    numNodes;   /* nodes laid out */
+    uint64_t    strOfs;     /* next free string offset */
+} liImgOut_t;
+
+/*
+============
+ImgMeasure_r
+============
+*/
+static void ImgMeasure_r( liObj_t *o, uint32_t *numNodes, uint64_t *strSize,
+        int level ) {
+    liObj_t *first = o;
+
+    liverifya( level <= LI_MAX_NESTING_LEVEL,
+        "error: the nesting level is too high. "
+        "check the tree for looping levels or increase "
+        "the constant LI_MAX_NESTING_LEVEL. "
+        "LI_MAX_NESTING_LEVEL=%d", LI_MAX_NESTING_LEVEL );
+
+    for( ; o; o = o->next ) {
+        (*numNodes)++;
+        /* only siblings written to this image share the key,
+        like in ImgFill_r */
+        if( o->key && !(o != first && o->prev->key == o->key) ) {
+            *strSize += ImgStrSize( slen(o->key) );
+        }
+        if( o->type == LI_VTSTR && o->vstr ) {
+            *strSize += ImgStrSize( slen(o->vstr) );
+        }
+        if( o->firstChild ) {
+            ImgMeasure_r( o->firstChild, numNodes, strSize, level + 1 );
+        }
+    }
+}
+
+/*
+============
+ImgPutStr
+============
+*/
+static uint64_t ImgPutStr( liImgOut_t *out, liStr_t *s ) {
+    uint64_t ofs = out->strOfs;
+    uint32_t len = slen(s);
+
+    MemCpy( out->base + ofs, &len, sizeof(len) );
+    MemCpy( out->base + ofs + sizeof(len), sstr(s), (size_t)len + 1 );
+    out->strOfs += ImgStrSize( len );
+
+    return ofs;
+}
+
+/*
+============
+ImgFill_r
+
+Lays out a sibling list and returns the index of its last node
+============
+*/
+static uint32_t ImgFill_r( liImgOut_t *out, liObj_t *o, uint32_t parent ) {
+    liImgNode_t *nodes = (liImgNode_t*)(out->base + sizeof(liImgHeader_t));
+    liImgNode_t *n;
+    uint32_t idx, prev = 0;
+
+    for( ; o; o = o->next ) {
+        idx = ++out->numNodes;
+        n = nodes + idx - 1;
+        n->parent = parent;
+        n->next = 0;
+        n->prev = prev;
+        n->firstChild = 0;
+        n->lastChild = 0;
+        n->type = (uint16_t)o->type;
+        n->flags = (uint16_t)(o->flags & (LI_FBASE_MASK | LI_FSIGN));
+        n->value = 0;
+
+        if( !o->key ) {
+            n->key = 0;
+        } else if( prev && o->prev && o->prev->key == o->key ) {
+            /* sibling run shares the key */
+            n->key = nodes[prev - 1].key;
+        } else {
+            n->key = ImgPutStr( out, o->key );
+        }
+
+        if( o->type == LI_VTSTR ) {
+            n->value = o->vstr ? ImgPutStr( out, o->vstr ) : 0;
+        } else if( o->type != LI_VTOBJ ) {
+            n->value = o->vuint;
+        }
+
+        if( prev ) {
+            nodes[prev - 1].next = idx;
+        }
+        if( o->firstChild ) {
+            n->firstChild = idx + 1;
+            n->lastChild = ImgFill_r( out, o->firstChild, idx );
+        }
+        prev = idx;
+    }
+
+    return prev;
+}
+
+/*
+============
+LiImageWrite
+
+Writes the node and its next siblings as an image
+============
+*/
+licode_t LiImageWrite( liIO_t *io, liObj_t *o, const char *name ) {
+    liassert( o );
+
+    liImgHeader_t *hdr;
+    liImgOut_t out;
+    liFile_t f;
+    uint32_t numNodes = 0;
+    uint64_t strSize = 0;
+    uint64_t size, ofs;
+    size_t n;
+    licode_t code = LI_OK;
+
+    if( io == NULL ) {
+        extern liIO_t liDefaultIO;
+        io = &liDefaultIO;
+    }
+
+    ImgMeasure_r( o, &numNodes, &strSize, 0 );
+    size = sizeof(liImgHeader_t) + (uint64_t)numNodes * sizeof(liImgNode_t) +
+            strSize;
+
+    f = io->open( name, 'w' );
+    if( f == NULL ) {
+        return LI_EFILEOPEN;
+    }
+
+    out.base = (char*)LiAlloc( (size_t)size, LI_TYID_BUF );
+    out.numNodes = 0;
+    out.strOfs = sizeof(liImgHeader_t) +
+            (uint64_t)numNodes * sizeof(liImgNode_t);
+
+    hdr = (liImgHeader_t*)out.base;
+    MemCpy( hdr->magic, IMG_MAGIC, 4 );
+    hdr->order = IMG_ORDER;
+    hdr->nodeSize = sizeof(liImgNode_t);
+    hdr->numNodes = numNodes;
+    hdr->nodesOfs = sizeof(liImgHeader_t);
+    hdr->size = size;
+    ImgFill_r( &out, o, 0 );
+
+    liassert( out.numNodes == numNodes );
+    liassert( out.strOfs == size );
+
+    for( ofs = 0; ofs < size; ofs += n ) {
+        n = (size - ofs) > (1 << 20) ? (1 << 20) : (size_t)(size - ofs);
+        if( io->write( out.base + ofs, n, f ) != (ssize_t)n ) {
+            code = LI_EWRITE;
+            break;
+        }
+    }
+    if( code == LI_OK && io->write( out.base, 0, f ) < 0 ) {
+        code = LI_EWRITE;
+    }
+
+    LiDealloc( out.base );
+    io->close( f );
+
+    return code;
+}
+
+
+
+/*
+================================================
+                  image access
+================================================
+*/
+
+/*
+============
+ImgCheckLinks
+
+Checks that the links form one tree: next and child
+links point forward, parent and prev links backward,
+and every node is reached by exactly one of them. Walks
+over the image then end like walks over li objects.
+============
+*/
+static libool_t ImgCheckLinks( const liImgNode_t *nodes, uint32_t numNodes ) {
+    const liImgNode_t *n;
+    uint32_t i;
+
+    for( i = 1; i <= numNodes; i++ ) {
+        n = nodes + i - 1;
+        if( n->parent >= i || n->prev >= i ||
+                (n->next && (n->next <= i || n->next > numNodes)) ||
+                (n->firstChild && (n->firstChild <= i ||
+                n->firstChild > numNodes)) ||
+                (n->lastChild && (n->lastChild < n->firstChild ||
+                n->lastChild > numNodes)) ||
+                (!n->firstChild != !n->lastChild) ) {
+            return lifalse;
+        }
+        /* the node is reached from its previous sibling, its parent
+        or, for the first node, from the image */
+        if( n->prev ) {
+            if( nodes[n->prev - 1].next != i ||
+                    nodes[n->prev - 1].parent != n->parent ) {
+                return lifalse;
+            }
+        } else if( n->parent ) {
+            if( nodes[n->parent - 1].firstChild != i ) {
+                return lifalse;
+            }
+        } else if( i != 1 ) {
+            return lifalse;
+        }
+        if( n->next && nodes[n->next - 1].prev != i ) {
+            return lifalse;
+        }
+        if( n->firstChild && (nodes[n->firstChild - 1].parent != i ||
+                nodes[n->lastChild - 1].parent != i ||
+                nodes[n->lastChild - 1].next != 0) ) {
+            return lifalse;
+        }
+    }
+
+    return litrue;
+}
+
+/*
+============
+ImgOpen
+
+Checks the header and the links of the nodes, the
+strings are checked when they are accessed
+============
+*/
+static licode_t ImgOpen( liImage_t **img, const void *data, size_t size,
+        libool_t mapped ) {
+    const liImgHeader_t *hdr = (const liImgHeader_t*)data;
+    liImage_t *im;
+
+    if( size < sizeof(liImgHeader_t) ||
+            hdr->magic[0] != 'L' || hdr->magic[1] != 'I' ||
+            hdr->magic[2] != 'M' || hdr->magic[3] != '\1' ||
+            hdr->order != IMG_ORDER ||
+            hdr->nodeSize != sizeof(liImgNode_t) ||
+            hdr->size != size ||
+            hdr->nodesOfs != sizeof(liImgHeader_t) ||
+            hdr->numNodes > (size - sizeof(liImgHeader_t)) /
+                    sizeof(liImgNode_t) ||
+            !ImgCheckLinks( (const liImgNode_t*)((const char*)data +
+                    hdr->nodesOfs), hdr->numNodes ) ) {
+        return LI_EINPDAT;
+    }
+
+    im = (liImage_t*)LiAlloc( sizeof(liImage_t), LI_TYID_IMG );
+    im->base = (const char*)data;
+    im->size = size;
+    im->nodes = (const liImgNode_t*)(im->base + hdr->nodesOfs);
+    im->numNodes = hdr->numNodes;
+    im->mapped = mapped;
+    *img = im;
+
+    return LI_OK;
+}
+
+/*
+============
+LiImageMap
+
+Maps an image file into memory
+============
+*/
+licode_t LiImageMap( liImage_t **img, const char *name ) {
+    liassert( img );
+    liassert( name );
+
+    struct stat st;
+    void *data;
+    licode_t code;
+    int fd;
+
+    *img = NULL;
+    fd = open( name, O_RDONLY );
+    if( fd < 0 ) {
+        return LI_EFILEOPEN;
+    }
+    if( fstat( fd, &st ) != 0 || st.st_size <= 0 ) {
+        close( fd );
+        return LI_EREAD;
+    }
+    data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if( data == MAP_FAILED ) {
+        return LI_EREAD;
+    }
+
+    code = ImgOpen( img, data, (size_t)st.st_size, litrue );
+    if( code != LI_OK ) {
+        munmap( data, (size_t)st.st_size );
+    }
+
+    return code;
+}
+
+/*
+============
+LiImageFromMem
+
+Uses an image in memory, the memory must outlive the image
+and be aligned to 8 bytes
+============
+*/
+licode_t LiImageFromMem( liImage_t **img, const void *data, size_t size ) {
+    liassert( img );
+    liassert( data );
+    liassert( ((uintptr_t)data & 7) == 0 );
+
+    *img = NULL;
+    return ImgOpen( img, data, size, lifalse );
+}
+
+/*
+============
+LiImageClose
+============
+*/
+void LiImageClose( liImage_t *img ) {
+    liassert( img );
+
+    if( img->mapped ) {
+        munmap( (void*)img->base, img->size );
+    }
+    LiDealloc( img );
+}
+
+/*
+============
+LiImageRoot
+============
+*/
+liView_t LiImageRoot( liImage_t *img ) {
+    liassert( img );
+
+    liView_t v;
+    v.img = img;
+    v.node = img->numNodes ? 1 : 0;
+    return v;
+}
+
+/*
+============
+ImgNode
+============
+*/
+static const liImgNode_t *ImgNode( liView_t v ) {
+    if( !v.img || !v.node || v.node > v.img->numNodes ) {
+        return NULL;
+    }
+    return v.img->nodes + v.node - 1;
+}
+
+/*
+============
+ImgStr
+============
+*/
+static const char *ImgStr( const liImage_t *img, uint64_t ofs,
+        lisize_t *len ) {
+    uint32_t l;
+
+    if( !ofs || (ofs & 3) || ofs > img->size - sizeof(uint32_t) ) {
+        return NULL;
+    }
+    MemCpy( &l, img->base + ofs, sizeof(l) );
+    if( (uint64_t)l + 1 > img->size - ofs - sizeof(uint32_t) ) {
+        return NULL;
+    }
+    if( len ) {
+        *len = (lisize_t)l;
+    }
+    return img->base + ofs + sizeof(uint32_t);
+}
+
+/*
+============
+ImgLink
+============
+*/
+static liView_t ImgLink( liView_t v, uint32_t node ) {
+    v.node = node;
+    return v;
+}
+
+/*
+============
+LiViewIsNull
+============
+*/
+libool_t LiViewIsNull( liView_t v ) {
+    return ImgNode( v ) == NULL;
+}
+
+/*
+============
+LiViewParent
+============
+*/
+liView_t LiViewParent( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return ImgLink( v, n ? n->parent : 0 );
+}
+
+/*
+============
+LiViewNext
+============
+*/
+liView_t LiViewNext( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return ImgLink( v, n ? n->next : 0 );
+}
+
+/*
+============
+LiViewPrev
+============
+*/
+liView_t LiViewPrev( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return ImgLink( v, n ? n->prev : 0 );
+}
+
+/*
+============
+LiViewFirstChild
+============
+*/
+liView_t LiViewFirstChild( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return ImgLink( v, n ? n->firstChild : 0 );
+}
+
+/*
+============
+LiViewLastChild
+============
+*/
+liView_t LiViewLastChild( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return ImgLink( v, n ? n->lastChild : 0 );
+}
+
+/*
+============
+LiViewType
+============
+*/
+litype_t LiViewType( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return n ? n->type : 0;
+}
+
+/*
+============
+LiViewFlags
+============
+*/
+liflag_t LiViewFlags( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return n ? n->flags : 0;
+}
+
+/*
+============
+LiViewKey
+
+Returns the null-terminated key or NULL
+============
+*/
+const char *LiViewKey( liView_t v, lisize_t *len ) {
+    const liImgNode_t *n = ImgNode( v );
+    return n ? ImgStr( v.img, n->key, len ) : NULL;
+}
+
+/*
+============
+LiViewStr
+
+Returns the null-terminated string value or NULL
+============
+*/
+const char *LiViewStr( liView_t v, lisize_t *len ) {
+    const liImgNode_t *n = ImgNode( v );
+    if( !n || n->type != LI_VTSTR ) {
+        return NULL;
+    }
+    return ImgStr( v.img, n->value, len );
+}
+
+/*
+============
+LiViewInt
+============
+*/
+int64_t LiViewInt( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return n ? (int64_t)n->value : 0;
+}
+
+/*
+============
+LiViewUint
+============
+*/
+uint64_t LiViewUint( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return n ? n->value : 0;
+}
+
+/*
+============
+LiViewBool
+============
+*/
+libool_t LiViewBool( liView_t v ) {
+    const liImgNode_t *n = ImgNode( v );
+    return n ? (libool_t)!!n->value : lifalse;
+}
+
+
+
+/*
+================================================
+                   view find
+================================================
+*/
+
+/*
+============
+ViewKeyIs
+============
+*/
+static libool_t ViewKeyIs( liView_t v, const char *s, lisize_t len ) {
+    lisize_t keyLen;
+    const char *key = LiViewKey( v, &keyLen );
+
+    return key && keyLen == len && !memcmp( key, s, len );
+}
+
+/*
+============
+ViewSkipToNext
+============
+*/
+static liView_t ViewSkipToNext( liViewFindData_t *dat, liView_t v,
+        int toDown ) {
+    const liImgNode_t *n = ImgNode( v );
+
+    if( toDown && (dat->index < dat->numPattern - 1) && n->firstChild ) {
+        /* skip down */
+        dat->index++;
+        v.node = n->firstChild;
+    } else if( n->next ) {
+        /* skip to next sibling */
+        v.node = n->next;
+    } else if( (dat->index > 0) && n->parent ) {
+        /* skip up */
+        do {
+            dat->index--;
+            v.node = n->parent;
+            n = ImgNode( v );
+        } while( n && (dat->index > 0) && (!n->next) && (n->parent) );
+        v.node = n ? n->next : 0;
+    } else {
+        /* no unvisited nodes left */
+        v.node = 0;
+    }
+
+    return v;
+}
+
+/*
+============
+LiViewFindFirst
+
+Same patterns and order as LiFindFirst
+============
+*/
+licode_t LiViewFindFirst( liViewFindData_t *dat, liView_t v,
+        const char *s ) {
+    liassert( dat );
+    liassert( s );
+
+    const char *start;
+
+    dat->view = v;
+    dat->view.node = 0;
+    dat->numPattern = 0;
+    dat->index = 0;
+
+    if( LiViewIsNull( v ) ) {
+        return LI_EINPDAT;
+    }
+
+    /* check for global pattern (start from the root) */
+    if( *s == '.' ) {
+        s++;
+        while( !LiViewIsNull( LiViewParent( v ) ) ) {
+            v = LiViewParent( v );
+        }
+        while( !LiViewIsNull( LiViewPrev( v ) ) ) {
+            v = LiViewPrev( v );
+        }
+    }
+
+    /* parse the search pattern */
+    while( is_firstkeych(*s) ) {
+        if( dat->numPattern == LI_VIEW_MAX_PATTERN ) {
+            return LI_EINPDAT;
+        }
+        start = s++;
+        for( ; is_nextkeych(*s); s++ );
+        dat->pattern[ dat->numPattern ].str = start;
+        dat->pattern[ dat->numPattern ].len = (lisize_t)(s - start);
+        dat->numPattern++;
+        if( *s == '.' && s[1] != 0 ) {
+            s++;
+        }
+    }
+    if( *s != 0 || !dat->numPattern ) {
+        return LI_EINPDAT;
+    }
+
+    /* check if the first element is found */
+    dat->view = v;
+    if( dat->numPattern == 1 &&
+            ViewKeyIs( v, dat->pattern[0].str, dat->pattern[0].len ) ) {
+        return LI_OK;
+    }
+
+    return LiViewFindNext( dat );
+}
+
+/*
+============
+LiViewFindNext
+============
+*/
+licode_t LiViewFindNext( liViewFindData_t *dat ) {
+    liassert( dat );
+
+    liView_t v = dat->view;
+    if( LiViewIsNull( v ) || !dat->numPattern ) {
+        return LI_FINISHED;
+    }
+
+    v = ViewSkipToNext( dat, v, 1 );
+    while( !LiViewIsNull( v ) ) {
+        if( ViewKeyIs( v, dat->pattern[dat->index].str,
+                dat->pattern[dat->index].len ) ) {
+            if( dat->index == dat->numPattern - 1 ) {
+                /* object found */
+                dat->view = v;
+                return LI_OK;
+            }
+            v = ViewSkipToNext( dat, v, 1 );
+        } else if( !ImgNode( v )->key ) {
+            v = ViewSkipToNext( dat, v, 1 );
+        } else {
+            v = ViewSkipToNext( dat, v, 0 );
+        }
+    }
+
+    dat->view.node = 0;
+    return LI_FINISHED;
+}
+
+/*
+============
+LiViewFindClose
+============
+*/
+licode_t LiViewFindClose( liViewFindData_t *dat ) {
+    liassert( dat );
+
+    dat->view.node = 0;
+    dat->numPattern = 0;
+    dat->index = 0;
+
+    return LI_FINISHED;
+}
@@ -0,0 +1,58 @@
+#ifndef __LIIMG_H__
+#define __LIIMG_H__
+
+#include "li.h"
+
+#define LI_VIEW_MAX_PATTERN     32
+
+/* read-only li document image */
+typedef struct liImage_t liImage_t;
+
+/* view of an image node */
+typedef struct {
+    const liImage_t     *img;       /* image */
+    uint32_t            node;       /* node index (0 - no node) */
+} liView_t;
+
+/* view find data */
+typedef struct {
+    liView_t            view;
+    struct {
+        const char      *str;
+        lisize_t        len;
+    }                   pattern[LI_VIEW_MAX_PATTERN];
+    uint32_t            numPattern;
+    uint32_t            index;
+} liViewFindData_t;
+
+
+licode_t    LiImageWrite( liIO_t *io, liObj_t *o, const char *name );
+licode_t    LiImageMap( liImage_t **img, const char *name );
+licode_t    LiImageFromMem( liImage_t **img, const void *data, size_t size );
+void        LiImageClose( liImage_t *img );
+liView_t    LiImageRoot( liImage_t *img );
+
+
+libool_t    LiViewIsNull( liView_t v );
+liView_t    LiViewParent( liView_t v );
+liView_t    LiViewNext( liView_t v );
+liView_t    LiViewPrev( liView_t v );
+liView_t    LiViewFirstChild( liView_t v );
+liView_t    LiViewLastChild( liView_t v );
+
+litype_t    LiViewType( liView_t v );
+liflag_t    LiViewFlags( liView_t v );
+const char  *LiViewKey( liView_t v, lisize_t *len );
+const char  *LiViewStr( liView_t v, lisize_t *len );
+int64_t     LiViewInt( liView_t v );
+uint64_t    LiViewUint( liView_t v );
+libool_t    LiViewBool( liView_t v );
+
+
+licode_t    LiViewFindFirst( liViewFindData_t *dat, liView_t v,
+                    const char *s );
+licode_t    LiViewFindNext( liViewFindData_t *dat );
+licode_t    LiViewFindClose( liViewFindData_t *dat );
+
+
+#endif //__LIIMG_H__
@@ -2,8 +2,15 @@
 #include "liassert.h"
 #include "liutil.h"
 
+#include <string.h>
+#include <pthread.h>
+
 extern liAlloc_t liDefaultAllocator;
 static liAlloc_t *liAllocator = &liDefaultAllocator;
+/* allocator of the calling thread (NULL - liAllocator) */
+static _Thread_local liAlloc_t *liThreadAllocator = NULL;
+
+#define CurAllocator()  (liThreadAllocator ? liThreadAllocator : liAllocator)
 
 /*
 ============
@@ -11,11 +18,11 @@ LiAlloc
 ============
 */
 void *LiAlloc( size_t size, lityid_t type ) {
-    liassert( liAllocator );
-    liassert( liAllocator->alloc );
+    liAlloc_t *alc = CurAllocator();
+    liassert( alc->alloc );
     liassert( size != 0 );
     
-    return liAllocator->alloc( size, type );
+    return alc->alloc( size, type );
 }
 
 /*
@@ -24,11 +31,11 @@ LiRealloc
 ============
 */
 void *LiRealloc( void *ptr, size_t size, lityid_t type ) {
-    liassert( liAllocator );
-    liassert( liAllocator->realloc );
+    liAlloc_t *alc = CurAllocator();
+    liassert( alc->realloc );
     liassert( size != 0 );
     
-    return liAllocator->realloc( ptr, size, type );
+    return alc->realloc( ptr, size, type );
 }
 
 /*
@@ -37,11 +44,11 @@ LiDealloc
 ============
 */
 void LiDealloc( void *ptr ) {
-    liassert( liAllocator );
-    liassert( liAllocator->free );
+    liAlloc_t *alc = CurAllocator();
+    liassert( alc->free );
     liassert( ptr );
     
-    liAllocator->free( ptr );
+    alc->free( ptr );
 }
 
 /*
@@ -61,12 +68,278 @@ void LiSetAllocator( liAlloc_t *alc ) {
 /*
 ============
 LiGetAllocator
+
+Returns the allocator used by the calling thread
 ============
 */
 liAlloc_t *LiGetAllocator( void ) {
-    return liAllocator;
+    return CurAllocator();
+}
+
+/*
+============
+LiGetThreadAllocator
+
+Returns the allocator set for the calling thread,
+NULL if it uses the global allocator
+============
+*/
+liAlloc_t *LiGetThreadAllocator( void ) {
+    return liThreadAllocator;
+}
+
+/*
+============
+LiSetThreadAllocator
+
+Sets the allocator of the calling thread, NULL
+returns the thread to the global allocator.
+
+return values:
+previous allocator of the thread (may be NULL)
+============
+*/
+liAlloc_t *LiSetThreadAllocator( liAlloc_t *alc ) {
+    liAlloc_t *prev = liThreadAllocator;
+    
+    if( alc ) {
+        liassert( alc->alloc );
+        liassert( alc->realloc );
+        liassert( alc->free );
+    }
+    liThreadAllocator = alc;
+    
+    return prev;
+}
+
+
+/*
+================================================
+            li allocation statistics
+
+The statistics allocator keeps the size and the type
+of a block in a header in front of it, so it has to be
+installed before li memory is allocated and stay
+installed while that memory is in use.
+================================================
+*/
+
+#define LI_MEM_MAGIC    0x4c694d68  /* "LiMh" */
+
+/* block header, keeps the block aligned */
+typedef union {
+    struct {
+        size_t      size;
+        lityid_t    type;
+        uint32_t    magic;  /* LI_MEM_MAGIC while the block is in use */
+    };
+    _Alignas(16) char pad_[16];
+} liMemHeader_t;
+
+static liAlloc_t        *liStatsBase = NULL;
+static liMemStats_t     liStats;
+static pthread_mutex_t  liStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+============
+SizeClass
+============
+*/
+static int SizeClass( size_t size ) {
+    int c = 0;
+    
+    while( size > 1 && c < LI_MEM_CLASSES - 1 ) {
+        size >>= 1;
+        c++;
+    }
+    return c;
+}
+
+/*
+============
+StatsAdd
+============
+*/
+static void StatsAdd( liMemTypeStats_t *st, size_t size, int c ) {
+    st->live += size;
+    if( st->live > st->peak ) {
+        st->peak = st->live;
+    }
+    st->allocs++;
+    st->classes[c]++;
+}
+
+/*
+============
+StatsAlloc
+============
+*/
+static void StatsAlloc( size_t size, lityid_t type ) {
+    int c = SizeClass( size );
+    
+    pthread_mutex_lock( &liStatsLock );
+    StatsAdd( &liStats.total, size, c );
+    StatsAdd( &liStats.types[type < LI_MEM_TYPES ? type : 0], size, c );
+    pthread_mutex_unlock( &liStatsLock );
+}
+
+/*
+============
+StatsFree
+============
+*/
+static void StatsFree( size_t size, lityid_t type, libool_t realloc ) {
+    liMemTypeStats_t *st = &liStats.types[type < LI_MEM_TYPES ? type : 0];
+    
+    pthread_mutex_lock( &liStatsLock );
+    liStats.total.live -= size;
+    st->live -= size;
+    if( !realloc ) {
+        liStats.total.frees++;
+        st->frees++;
+    }
+    pthread_mutex_unlock( &liStatsLock );
+}
+
+/*
+============
+LiStatsAlloc
+============
+*/
+static void *LiStatsAlloc( size_t size, lityid_t type ) {
+    liMemHeader_t *h;
+    
+    h = (liMemHeader_t*)liStatsBase->alloc( sizeof(liMemHeader_t) + size, 
+            type );
+    if( !h ) {
+        return NULL;
+    }
+    h->size = size;
+    h->type = type;
+    h->magic = LI_MEM_MAGIC;
+    StatsAlloc( size, type );
+    
+    return h + 1;
+}
+
+/*
+============
+LiStatsRealloc
+============
+*/
+static void *LiStatsRealloc( void *ptr, size_t size, lityid_t type ) {
+    liMemHeader_t *h;
+    
+    if( !ptr ) {
+        return LiStatsAlloc( size, type );
+    }
+    h = (liMemHeader_t*)ptr - 1;
+    liverifya( h->magic == LI_MEM_MAGIC, "error: the block was not "
+            "allocated by the statistics allocator or is already freed" );
+    h = (liMemHeader_t*)liStatsBase->realloc( h, 
+            sizeof(liMemHeader_t) + size, type );
+    if( !h ) {
+        return NULL;
+    }
+    StatsFree( h->size, h->type, litrue );
+    h->size = size;
+    h->type = type;
+    h->magic = LI_MEM_MAGIC;
+    StatsAlloc( size, type );
+    
+    return h + 1;
+}
+
+/*
+============
+LiStatsFree
+============
+*/
+static void LiStatsFree( void *ptr ) {
+    liMemHeader_t *h;
+    
+    if( !ptr ) {
+        return;
+    }
+    h = (liMemHeader_t*)ptr - 1;
+    liverifya( h->magic == LI_MEM_MAGIC, "error: the block was not "
+            "allocated by the statistics allocator or is already freed" );
+    h->magic = 0;
+    StatsFree( h->size, h->type, lifalse );
+    liStatsBase->free( h );
+}
+
+static liAlloc_t liStatsAllocator = {
+    LiStatsAlloc,
+    LiStatsRealloc,
+    LiStatsFree
+};
+
+/*
+============
+LiMemStatsAllocator
+
+Returns the statistics allocator over base (NULL -
+the current allocator), install it with LiSetAllocator
+or LiSetThreadAllocator. The base is fixed by the
+first call.
+============
+*/
+liAlloc_t *LiMemStatsAllocator( liAlloc_t *base ) {
+    if( !base ) {
+        base = CurAllocator();
+    }
+    pthread_mutex_lock( &liStatsLock );
+    if( !liStatsBase ) {
+        liassert( base != &liStatsAllocator );
+        liStatsBase = base;
+    }
+    liasserta( base == liStatsBase || base == &liStatsAllocator, 
+            "error: the statistics allocator has another base." );
+    pthread_mutex_unlock( &liStatsLock );
+    
+    return &liStatsAllocator;
+}
+
+/*
+============
+LiMemStats
+
+Copies the statistics of the statistics allocator
+============
+*/
+void LiMemStats( liMemStats_t *stats ) {
+    liassert( stats );
+    
+    pthread_mutex_lock( &liStatsLock );
+    *stats = liStats;
+    pthread_mutex_unlock( &liStatsLock );
 }
 
+/*
+============
+LiMemStatsReset
+
+Clears the counters and the histograms, peaks start
+from the bytes in use
+============
+*/
+void LiMemStatsReset( void ) {
+    liMemTypeStats_t *st;
+    int i;
+    
+    pthread_mutex_lock( &liStatsLock );
+    for( i = -1; i < LI_MEM_TYPES; i++ ) {
+        st = i < 0 ? &liStats.total : &liStats.types[i];
+        st->peak = st->live;
+        st->allocs = 0;
+        st->frees = 0;
+        memset( st->classes, 0, sizeof(st->classes) );
+    }
+    pthread_mutex_unlock( &liStatsLock );
+}
+
+
 
 /*
 ================================================
@@ -114,7 +387,7 @@ liArray_t *LiArrayRealloc( liArray_t *array, lisize_t num ) {
     lisize_t memSize = sizeof(liArray_t) + asiz(array) * num;
     array = (liArray_t*)LiRealloc( array, memSize, LI_TYID_ARR );
     aalc(array) = num;
-    if( aalc(array) > anum(array) ) {
+    if( anum(array) > aalc(array) ) {
         anum(array) = aalc(array);
     }
     
@@ -3,6 +3,8 @@
 
 #include "litypes.h"
 
+#include <stddef.h>
+
 /* li allocator */
 typedef void        *(*fnLiAlloc)(size_t,lityid_t);
 typedef void        *(*fnLiRealloc)(void*,size_t,lityid_t);
@@ -20,10 +22,32 @@ typedef struct {
     lisize_t        allocedNum; /* number of alloced elements */
     lisize_t        sizOfElem;  /* size of one item */
     lisize_t        number;     /* number of used array elements */
-    char            array_[0];   /* array */
+    _Alignas(uint64_t) char array_[0]; /* array (aligned for 64-bit items) */
 } liArray_t;
 
 
+/* size classes of the allocation histogram: class i holds
+   sizes 2^i..2^(i+1)-1, the last class everything bigger */
+#define LI_MEM_CLASSES  16
+/* accounted type ids, bigger ids are counted as 0 */
+#define LI_MEM_TYPES    16
+
+/* allocation statistics of one type */
+typedef struct {
+    uint64_t        live;       /* bytes in use */
+    uint64_t        peak;       /* maximum of live bytes */
+    uint64_t        allocs;     /* alloc and realloc calls */
+    uint64_t        frees;      /* free calls */
+    uint64_t        classes[LI_MEM_CLASSES]; /* allocations by size */
+} liMemTypeStats_t;
+
+/* statistics of the statistics allocator */
+typedef struct {
+    liMemTypeStats_t    total;
+    liMemTypeStats_t    types[LI_MEM_TYPES]; /* by LI_TYID_* */
+} liMemStats_t;
+
+
 #define     aalc(a)     ((a)->allocedNum)
 #define     asiz(a)     ((a)->sizOfElem)
 #define     anum(a)     ((a)->number)
@@ -36,6 +60,12 @@ void        LiDealloc( void *ptr );
 
 void        LiSetAllocator( liAlloc_t *alc );
 liAlloc_t   *LiGetAllocator( void );
+liAlloc_t   *LiGetThreadAllocator( void );
+liAlloc_t   *LiSetThreadAllocator( liAlloc_t *alc );
+
+liAlloc_t   *LiMemStatsAllocator( liAlloc_t *base );
+void        LiMemStats( liMemStats_t *stats );
+void        LiMemStatsReset( void );
 
 liArray_t   *LiArrayAlloc( lisize_t siz, lisize_t num );
 liArray_t   *LiArrayRealloc( liArray_t *array, lisize_t num );
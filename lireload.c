@@ -0,0 +1,598 @@
+#define _GNU_SOURCE
+
+#include "lireload.h"
+#include "liassert.h"
+#include "liutil.h"
+#include "lizip.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#define LI_HAVE_INOTIFY
+#endif
+
+
+
+/*
+================================================
+                   li reload
+
+The file is split into top-level sections on the byte
+level, a section is a key with all of its values. A
+section with the same text as a section of the previous
+load keeps its nodes, the other sections are parsed
+with LiReadMem. Nothing is changed until all changed
+sections are parsed, so a broken file keeps the old tree.
+================================================
+*/
+
+typedef struct {
+    size_t      off;        /* text of the section */
+    size_t      len;
+    uint64_t    hash;
+    lisize_t    match;      /* old section + 1 (0 - parsed) */
+    liObj_t     *first;     /* nodes of the section */
+    liObj_t     *last;
+} liSection_t;
+
+struct liReload_t {
+    liIO_t      *io;
+    liStr_t     *name;
+    liStr_t     *text;      /* the file as of the last load */
+    liArray_t   *secs;      /* liSection_t */
+    liObj_t     *root;
+
+    int         fd;         /* inotify */
+    struct timespec mtime;  /* stat without inotify */
+    off_t       size;
+};
+
+#define SEC(a, i)   (((liSection_t*)aarr(a)) + (i))
+
+/*
+============
+LoadText
+============
+*/
+static licode_t LoadText( liReload_t *rl, liStr_t **text ) {
+    liFile_t f;
+    liStr_t *s;
+    ssize_t n;
+
+    f = LiZipOpen( rl->io, sstr(rl->name), 'r', 0 );
+    if( f == NULL ) {
+        return LI_EFILEOPEN;
+    }
+
+    s = LiSAlloc( 64 * 1024 );
+    while( 1 ) {
+        if( salc(s) - slen(s) < 16 * 1024 ) {
+            s = LiSRealloc( s, salc(s) * 2 );
+        }
+        n = LiZipRead( sstr(s) + slen(s), salc(s) - slen(s), f );
+        if( n <= 0 ) {
+            break;
+        }
+        slen(s) += (lisize_t)n;
+    }
+    LiZipClose( f );
+
+    if( n < 0 ) {
+        LiSFree( s );
+        return LI_EREAD;
+    }
+    *text = s;
+    return LI_OK;
+}
+
+/*
+============
+SkipSpace
+============
+*/
+static size_t SkipSpace( const char *t, size_t pos, size_t n ) {
+    while( pos < n && is_space( t[pos] ) ) {
+        pos++;
+    }
+    return pos;
+}
+
+/*
+============
+SkipString
+
+pos - the opening quote, returns the position after the
+closing quote (n - not closed)
+============
+*/
+static size_t SkipString( const char *t, size_t pos, size_t n ) {
+    for( pos++; pos < n; pos++ ) {
+        if( t[pos] == '\\' ) {
+            pos++;
+        } else if( t[pos] == '"' ) {
+            return pos + 1;
+        }
+    }
+    return n + 1;
+}
+
+/*
+============
+SkipValue
+
+Returns the position after the value (> n - error)
+============
+*/
+static size_t SkipValue( const char *t, size_t pos, size_t n ) {
+    size_t begin = pos;
+    int depth = 0;
+
+    if( t[pos] == '"' ) {
+        return SkipString( t, pos, n );
+    }
+    if( t[pos] == '{' ) {
+        while( pos < n ) {
+            if( t[pos] == '"' ) {
+                pos = SkipString( t, pos, n );
+                continue;
+            }
+            if( t[pos] == '{' ) {
+                depth++;
+            } else if( t[pos] == '}' && --depth == 0 ) {
+                return pos + 1;
+            }
+            pos++;
+        }
+        return n + 1;
+    }
+
+    /* number or keyword */
+    while( pos < n && !is_space( t[pos] ) && t[pos] != ',' &&
+            t[pos] != '{' && t[pos] != '}' && t[pos] != '"' ) {
+        pos++;
+    }
+    return pos == begin ? n + 1 : pos;
+}
+
+/*
+============
+SplitSections
+============
+*/
+static libool_t SplitSections( const char *t, size_t n, liArray_t **secs ) {
+    liSection_t sec;
+    size_t pos = 0;
+
+    memset( &sec, 0, sizeof(sec) );
+    while( (pos = SkipSpace( t, pos, n )) < n ) {
+        sec.off = pos;
+        if( !is_firstkeych( t[pos] ) ) {
+            return lifalse;
+        }
+        while( pos < n && is_nextkeych( t[pos] ) ) {
+            pos++;
+        }
+        pos = SkipSpace( t, pos, n );
+        if( pos == n || t[pos] != '=' ) {
+            return lifalse;
+        }
+
+        /* values */
+        while( 1 ) {
+            pos = SkipSpace( t, pos + 1, n );
+            if( pos == n ) {
+                return lifalse;
+            }
+            pos = SkipValue( t, pos, n );
+            if( pos > n ) {
+                return lifalse;
+            }
+            sec.len = pos - sec.off;
+            pos = SkipSpace( t, pos, n );
+            if( pos == n || t[pos] != ',' ) {
+                break;
+            }
+        }
+
+        sec.hash = HashBytes( t + sec.off, sec.len, LI_HASH_INIT );
+        *secs = LiArrayAppend( *secs, &sec );
+    }
+    return litrue;
+}
+
+/*
+============
+MatchSections
+
+Finds the old section with the same text for every new
+section, an old section is given out once
+============
+*/
+static void MatchSections( liReload_t *rl, const char *t, liArray_t *secs ) {
+    lisize_t numOld = anum(rl->secs);
+    lisize_t size, mask, i, j;
+    lisize_t *table;
+    liSection_t *s, *o;
+
+    if( !numOld ) {
+        return;
+    }
+
+    /* open addressing, old section + 1 */
+    size = CeilPow2( numOld * 2 );
+    mask = size - 1;
+    table = (lisize_t*)LiAlloc( size * sizeof(lisize_t), LI_TYID_BUF );
+    memset( table, 0, size * sizeof(lisize_t) );
+    for( i = 0; i < numOld; i++ ) {
+        j = (lisize_t)SEC(rl->secs, i)->hash & mask;
+        while( table[j] ) {
+            j = (j + 1) & mask;
+        }
+        table[j] = i + 1;
+    }
+
+    for( i = 0; i < anum(secs); i++ ) {
+        s = SEC(secs, i);
+        j = (lisize_t)s->hash & mask;
+        for( ; table[j]; j = (j + 1) & mask ) {
+            o = SEC(rl->secs, table[j] - 1);
+            if( o->first && o->hash == s->hash && o->len == s->len &&
+                    memcmp( sstr(rl->text) + o->off, t + s->off,
+                    s->len ) == 0 ) {
+                s->match = table[j];
+                s->first = o->first;
+                s->last = o->last;
+                /* given out */
+                o->first = NULL;
+                break;
+            }
+        }
+    }
+
+    LiDealloc( table );
+}
+
+/*
+============
+ParseSections
+============
+*/
+static licode_t ParseSections( const char *t, liArray_t *secs,
+        lisize_t *numParsed ) {
+    licode_t code;
+    liSection_t *s;
+    lisize_t i;
+
+    *numParsed = 0;
+    for( i = 0; i < anum(secs); i++ ) {
+        s = SEC(secs, i);
+        if( s->match ) {
+            continue;
+        }
+        s->first = NULL;
+        code = LiReadMem( &s->first, t + s->off, s->len, 0, NULL, 0 );
+        if( code != LI_OK ) {
+            return code;
+        }
+        s->last = LiLast( s->first );
+        (*numParsed)++;
+    }
+    return LI_OK;
+}
+
+/*
+============
+ReloadError
+
+Parses the whole file again for the message, the line
+numbers of a section are relative to the section
+============
+*/
+static licode_t ReloadError( const char *t, size_t n, licode_t code,
+        char *errbuf, size_t errbufLen ) {
+    liObj_t *o = NULL;
+    licode_t c = LiReadMem( &o, t, n, 0, errbuf, errbufLen );
+    if( o ) {
+        LiFree( o );
+    }
+    return c != LI_OK ? c : code;
+}
+
+/*
+============
+LiReloadCheck
+
+numParsed - if not NULL, receives the number of sections
+parsed again (0 - the tree is the same)
+============
+*/
+licode_t LiReloadCheck( liReload_t *rl, liObj_t **root,
+        lisize_t *numParsed, char *errbuf, size_t errbufLen ) {
+    liassert( rl );
+
+    liArray_t *secs;
+    liStr_t *text;
+    liSection_t *s;
+    liObj_t *last = NULL;
+    lisize_t num = 0, i;
+    licode_t code;
+
+    if( numParsed ) {
+        *numParsed = 0;
+    }
+    code = LoadText( rl, &text );
+    if( code != LI_OK ) {
+        return code;
+    }
+    if( rl->text && slen(text) == slen(rl->text) &&
+            memcmp( sstr(text), sstr(rl->text), slen(text) ) == 0 ) {
+        /* not changed */
+        LiSFree( text );
+        if( root ) {
+            *root = rl->root;
+        }
+        return LI_OK;
+    }
+
+    secs = LiArrayAlloc( sizeof(liSection_t), 16 );
+    if( !SplitSections( sstr(text), slen(text), &secs ) ) {
+        code = ReloadError( sstr(text), slen(text), LI_EINPDAT,
+                errbuf, errbufLen );
+        goto goErr;
+    }
+    MatchSections( rl, sstr(text), secs );
+    code = ParseSections( sstr(text), secs, &num );
+    if( code != LI_OK ) {
+        code = ReloadError( sstr(text), slen(text), code,
+                errbuf, errbufLen );
+        goto goErr;
+    }
+
+    /* take the old sections apart, free the ones not given out */
+    for( i = 0; i < anum(rl->secs); i++ ) {
+        s = SEC(rl->secs, i);
+        if( s->first ) {
+            LiFree( LiExtractSiblings( s->first, s->last ) );
+        }
+    }
+    for( i = 0; i < anum(secs); i++ ) {
+        s = SEC(secs, i);
+        if( s->match ) {
+            LiExtractSiblings( s->first, s->last );
+        }
+    }
+
+    /* link the new top-level list */
+    rl->root = NULL;
+    for( i = 0; i < anum(secs); i++ ) {
+        s = SEC(secs, i);
+        if( last ) {
+            LiInsertAfter( last, s->first );
+        } else {
+            rl->root = s->first;
+        }
+        last = s->last;
+        /* the section owns its nodes from now on */
+        s->match = 0;
+    }
+
+    LiArrayFree( rl->secs );
+    rl->secs = secs;
+    if( rl->text ) {
+        LiSFree( rl->text );
+    }
+    rl->text = text;
+
+    if( numParsed ) {
+        *numParsed = num;
+    }
+    if( root ) {
+        *root = rl->root;
+    }
+    return LI_OK;
+
+goErr:
+    /* the old tree is left as it is */
+    for( i = 0; i < anum(secs); i++ ) {
+        s = SEC(secs, i);
+        if( s->match ) {
+            /* give back */
+            SEC(rl->secs, s->match - 1)->first = s->first;
+        } else if( s->first ) {
+            LiFree( s->first );
+        }
+    }
+    LiArrayFree( secs );
+    LiSFree( text );
+    return code;
+}
+
+/*
+============
+StatFile
+============
+*/
+static libool_t StatFile( liReload_t *rl ) {
+    struct stat st;
+    libool_t changed;
+
+    if( stat( sstr(rl->name), &st ) != 0 ) {
+        return litrue;
+    }
+    changed = st.st_size != rl->size ||
+            st.st_mtim.tv_sec != rl->mtime.tv_sec ||
+            st.st_mtim.tv_nsec != rl->mtime.tv_nsec;
+    rl->size = st.st_size;
+    rl->mtime = st.st_mtim;
+    return changed;
+}
+
+/*
+============
+WatchFile
+
+Watches the directory, editors replace the file
+by renaming a new one over it
+============
+*/
+static void WatchFile( liReload_t *rl ) {
+    rl->fd = -1;
+#if defined(LI_HAVE_INOTIFY)
+    char *dir = strdup( sstr(rl->name) );
+    char *slash = strrchr( dir, '/' );
+    
+    if( slash == dir ) {
+        dir[1] = 0;
+    } else if( slash ) {
+        *slash = 0;
+    } else {
+        dir[0] = '.';
+        dir[1] = 0;
+    }
+    rl->fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+    if( rl->fd >= 0 && inotify_add_watch( rl->fd, dir, 
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE ) < 0 ) {
+        close( rl->fd );
+        rl->fd = -1;
+    }
+    free( dir );
+#endif
+}
+
+/*
+============
+LiReloadOpen
+============
+*/
+licode_t LiReloadOpen( liReload_t **rl, liIO_t *io, const char *name,
+        liObj_t **root, char *errbuf, size_t errbufLen ) {
+    liassert( rl );
+    liassert( name );
+
+    licode_t code;
+    liReload_t *r = (liReload_t*)LiAlloc( sizeof(liReload_t),
+            LI_TYID_BUF );
+
+    r->io = io;
+    r->name = LiSNew( name );
+    r->text = NULL;
+    r->secs = LiArrayAlloc( sizeof(liSection_t), 16 );
+    r->root = NULL;
+    r->size = -1;
+    r->mtime.tv_sec = 0;
+    r->mtime.tv_nsec = 0;
+    /* before the load, changes made during it are not lost */
+    if( io ) {
+        r->fd = -1;
+    } else {
+        WatchFile( r );
+        StatFile( r );
+    }
+
+    code = LiReloadCheck( r, root, NULL, errbuf, errbufLen );
+    if( code != LI_OK ) {
+        LiReloadClose( r, litrue );
+        *rl = NULL;
+        return code;
+    }
+    *rl = r;
+    return LI_OK;
+}
+
+/*
+============
+LiReloadClose
+
+freeTree - free the loaded tree too
+============
+*/
+void LiReloadClose( liReload_t *rl, libool_t freeTree ) {
+    liassert( rl );
+
+    if( freeTree && rl->root ) {
+        LiFree( rl->root );
+    }
+#if defined(LI_HAVE_INOTIFY)
+    if( rl->fd >= 0 ) {
+        close( rl->fd );
+    }
+#endif
+    if( rl->text ) {
+        LiSFree( rl->text );
+    }
+    LiArrayFree( rl->secs );
+    LiSFree( rl->name );
+    LiDealloc( rl );
+}
+
+/*
+============
+LiReloadFd
+
+The descriptor becomes readable when the directory of
+the file changes, LiReloadWait drains it
+============
+*/
+int LiReloadFd( liReload_t *rl ) {
+    liassert( rl );
+    return rl->fd;
+}
+
+/*
+============
+LiReloadWait
+
+Returns litrue when the file may have changed, the
+check tells if it did. Files of custom I/O backends
+are not watched, litrue is returned after the timeout.
+============
+*/
+libool_t LiReloadWait( liReload_t *rl, int timeoutMs ) {
+    liassert( rl );
+
+    struct timespec ts;
+
+#if defined(LI_HAVE_INOTIFY)
+    if( rl->fd >= 0 ) {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        const struct inotify_event *ev;
+        const char *base = strrchr( sstr(rl->name), '/' );
+        struct pollfd pfd;
+        libool_t changed = lifalse;
+        ssize_t n, i;
+        
+        base = base ? base + 1 : sstr(rl->name);
+        pfd.fd = rl->fd;
+        pfd.events = POLLIN;
+        if( poll( &pfd, 1, timeoutMs ) <= 0 ) {
+            return lifalse;
+        }
+        while( (n = read( rl->fd, buf, sizeof(buf) )) > 0 ) {
+            for( i = 0; i < n; i += sizeof(*ev) + ev->len ) {
+                ev = (const struct inotify_event*)(buf + i);
+                if( ev->len && strcmp( ev->name, base ) == 0 ) {
+                    changed = litrue;
+                }
+            }
+        }
+        return changed;
+    }
+#endif
+
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (long)(timeoutMs % 1000) * 1000000;
+    if( rl->io ) {
+        nanosleep( &ts, NULL );
+        return litrue;
+    }
+    if( StatFile( rl ) ) {
+        return litrue;
+    }
+    nanosleep( &ts, NULL );
+    return StatFile( rl );
+}
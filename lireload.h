@@ -0,0 +1,25 @@
+#ifndef __LIRELOAD_H__
+#define __LIRELOAD_H__
+
+#include "li.h"
+
+typedef struct liReload_t liReload_t;
+
+/*
+A li file kept loaded. A check reads the file again
+and parses only the top-level sections (a key with its
+values) whose text has changed, the nodes of the other
+sections are kept. The top-level list is rebuilt by the
+check, it must not be changed by the caller.
+*/
+licode_t    LiReloadOpen( liReload_t **rl, liIO_t *io, const char *name,
+                    liObj_t **root, char *errbuf, size_t errbufLen );
+licode_t    LiReloadCheck( liReload_t *rl, liObj_t **root,
+                    lisize_t *numParsed, char *errbuf, size_t errbufLen );
+void        LiReloadClose( liReload_t *rl, libool_t freeTree );
+
+/* change notification (inotify fd, -1 - not available) */
+int         LiReloadFd( liReload_t *rl );
+libool_t    LiReloadWait( liReload_t *rl, int timeoutMs );
+
+#endif //__LIRELOAD_H__
@@ -4,6 +4,9 @@
 #include "liutil.h"
 
 #include <string.h>
+#if defined(LI_ATOMIC_REFS)
+    #include <stdatomic.h>
+#endif
 
 
 
@@ -13,9 +16,22 @@ LiSAlloc
 ============
 */
 liStr_t *LiSAlloc( lisize_t siz ) {
+    return LiSAllocType( siz, LI_TYID_STR );
+}
+
+/*
+============
+LiSAllocType
+
+type - accounted type of the string (LI_TYID_STR,
+LI_TYID_KEY), a reallocated string is counted as
+LI_TYID_STR
+============
+*/
+liStr_t *LiSAllocType( lisize_t siz, lityid_t type ) {
     liassert(siz >= 1);
     
-    liStr_t *s = (liStr_t*)LiAlloc( sizeof(liStr_t) + siz, LI_TYID_STR );
+    liStr_t *s = (liStr_t*)LiAlloc( sizeof(liStr_t) + siz, type );
     slen(s) = 0;
     salc(s) = siz;
     snref(s) = 0;
@@ -33,6 +49,7 @@ LiSRealloc
 */
 liStr_t *LiSRealloc( liStr_t *s, lisize_t siz ) {
     liassert(s);
+    liassert(salc(s) != 0);
     liassert(siz >= 1);
     
     siz = CeilPow2( siz );
@@ -56,10 +73,21 @@ LiSFree
 */
 void LiSFree( liStr_t *s ) {
     liassert(s);
+#if defined(LI_ATOMIC_REFS)
+    /* the owner that takes the counter below zero frees the string */
+    if( atomic_fetch_sub_explicit( &snref(s), 1, memory_order_acq_rel ) ) {
+        return;
+    }
+#else
     if( snref(s) ) {
         snref(s)--;
         return;
     }
+#endif
+    if( !salc(s) ) {
+        /* embedded string, freed together with its block */
+        return;
+    }
     LiDealloc( s );
 }
 
@@ -75,12 +103,12 @@ liStr_t *LiSNew( const char *cs ) {
 
 /*
 ============
-LiSNewL
+NewL
 ============
 */
-liStr_t *LiSNewL( const char *cs, lisize_t len ) {
+static liStr_t *NewL( const char *cs, lisize_t len, lityid_t type ) {
     liassert(cs);
-    liStr_t *s = LiSAlloc( len + 1 );
+    liStr_t *s = LiSAllocType( len + 1, type );
     if( len ) {
         slen(s) = len;
         memcpy( sstr(s), cs, len );
@@ -90,6 +118,26 @@ liStr_t *LiSNewL( const char *cs, lisize_t len ) {
     return s;
 }
 
+/*
+============
+LiSNewL
+============
+*/
+liStr_t *LiSNewL( const char *cs, lisize_t len ) {
+    return NewL( cs, len, LI_TYID_STR );
+}
+
+/*
+============
+LiSNewKeyL
+
+A new key, counted apart from the string values
+============
+*/
+liStr_t *LiSNewKeyL( const char *cs, lisize_t len ) {
+    return NewL( cs, len, LI_TYID_KEY );
+}
+
 /*
 ============
 LiSRef
@@ -97,7 +145,11 @@ LiSRef
 */
 liStr_t *LiSRef( liStr_t *s ) {
     liassert(s);
+#if defined(LI_ATOMIC_REFS)
+    atomic_fetch_add_explicit( &snref(s), 1, memory_order_relaxed );
+#else
     snref(s)++;
+#endif
     return s;
 }
 
@@ -156,8 +208,8 @@ liStr_t *LiSCatL( liStr_t *s, const char *cs, lisize_t len ) {
     }
     
     /* check if additional memory is needed */
-    if( slen(s) + len > salc(s) ) {
-        s = LiSRealloc( s, slen(s) + len );
+    if( slen(s) + len + 1 > salc(s) ) {
+        s = LiSRealloc( s, slen(s) + len + 1 );
     }
     
     /* copy substring */
@@ -178,6 +230,7 @@ libool_t LiSCmp( liStr_t *s, const char *cs ) {
     return (strncmp( sstr(s), cs, slen(s) ) == 0) && (cs[slen(s)] == 0);
 }
 
+#if defined(LI_CHECKED_CALLS)
 /*
 ============
 LiSCmpL
@@ -186,5 +239,179 @@ LiSCmpL
 libool_t LiSCmpL( liStr_t *s, const char *cs, lisize_t len ) {
     liassert(s);
     liassert(cs);
-    return (slen(s) == len) && (strncmp( sstr(s), cs, len ) == 0 );
+    return (slen(s) == len) && (memcmp( sstr(s), cs, len ) == 0);
+}
+#endif
+
+
+
+/*
+================================================
+                 li string pool
+
+Equal strings are shared by reference, so one copy
+is kept. The pool holds a reference of every string.
+Keys of neighbour nodes that are not one run must
+stay different pointers, avoid gives the second copy.
+================================================
+*/
+
+/*
+============
+LiSPoolInit
+============
+*/
+void LiSPoolInit( liSPool_t *p ) {
+    liassert(p);
+    p->ents = NULL;
+    p->size = 0;
+    p->num = 0;
+}
+
+/*
+============
+LiSPoolFree
+
+The strings stay alive while they are referenced
+============
+*/
+void LiSPoolFree( liSPool_t *p ) {
+    liassert(p);
+    lisize_t i;
+    for( i = 0; i < p->size; i++ ) {
+        if( p->ents[i].str ) {
+            LiSFree( p->ents[i].str );
+        }
+        if( p->ents[i].alt ) {
+            LiSFree( p->ents[i].alt );
+        }
+    }
+    if( p->ents ) {
+        LiDealloc( p->ents );
+    }
+    LiSPoolInit( p );
+}
+
+/*
+============
+SPoolGrow
+============
+*/
+static void SPoolGrow( liSPool_t *p ) {
+    liSPoolEnt_t *old = p->ents;
+    lisize_t oldSize = p->size;
+    lisize_t i, j;
+
+    p->size = oldSize ? oldSize * 2 : 256;
+    p->ents = (liSPoolEnt_t*)LiAlloc( p->size * sizeof(liSPoolEnt_t), 
+            LI_TYID_DICT );
+    memset( p->ents, 0, p->size * sizeof(liSPoolEnt_t) );
+    for( i = 0; i < oldSize; i++ ) {
+        if( !old[i].str ) {
+            continue;
+        }
+        j = (lisize_t)old[i].hash & (p->size - 1);
+        while( p->ents[j].str ) {
+            j = (j + 1) & (p->size - 1);
+        }
+        p->ents[j] = old[i];
+    }
+    if( old ) {
+        LiDealloc( old );
+    }
+}
+
+/*
+============
+SPoolFind
+
+Returns the entry of the string or the free entry
+it goes to
+============
+*/
+static liSPoolEnt_t *SPoolFind( liSPool_t *p, const char *cs, lisize_t len,
+        uint64_t hash ) {
+    liSPoolEnt_t *e;
+    lisize_t j;
+
+    if( (p->num + 1) * 2 > p->size ) {
+        SPoolGrow( p );
+    }
+    for( j = (lisize_t)hash & (p->size - 1); ; j = (j + 1) & (p->size - 1) ) {
+        e = p->ents + j;
+        if( !e->str || (e->hash == hash && slen(e->str) == len &&
+                memcmp( sstr(e->str), cs, len ) == 0) ) {
+            return e;
+        }
+    }
+}
+
+/*
+============
+SPoolTake
+
+e - the entry of the string, s - a heap copy of it
+or NULL, returns a new reference
+============
+*/
+static liStr_t *SPoolTake( liSPool_t *p, liSPoolEnt_t *e, const char *cs,
+        lisize_t len, liStr_t *s, liStr_t *avoid, lityid_t type ) {
+    liStr_t **slot;
+
+    if( !e->str ) {
+        p->num++;
+        slot = &e->str;
+    } else if( e->str != avoid ) {
+        return LiSRef( e->str );
+    } else if( e->alt ) {
+        return LiSRef( e->alt );
+    } else {
+        slot = &e->alt;
+    }
+    if( !s || s == avoid ) {
+        s = NewL( cs, len, type );
+    } else {
+        LiSRef( s );
+    }
+    /* reference of the pool */
+    *slot = LiSRef( s );
+    return s;
+}
+
+/*
+============
+LiSPoolGet
+
+Returns a reference of the pooled string equal to cs,
+which is not avoid. A new string is counted as type,
+keys and values that share it as the first of them.
+============
+*/
+liStr_t *LiSPoolGet( liSPool_t *p, const char *cs, lisize_t len, 
+        liStr_t *avoid, lityid_t type ) {
+    liassert(p);
+    liassert(cs);
+    uint64_t hash = HashBytes( cs, len, LI_HASH_INIT );
+    liSPoolEnt_t *e = SPoolFind( p, cs, len, hash );
+    e->hash = hash;
+    return SPoolTake( p, e, cs, len, NULL, avoid, type );
+}
+
+/*
+============
+LiSPoolRef
+
+As LiSPoolGet, a heap string not in the pool yet
+becomes the pooled one
+============
+*/
+liStr_t *LiSPoolRef( liSPool_t *p, liStr_t *s, liStr_t *avoid,
+        lityid_t type ) {
+    liassert(p);
+    liassert(s);
+    uint64_t hash = HashBytes( sstr(s), slen(s), LI_HASH_INIT );
+    liSPoolEnt_t *e = SPoolFind( p, sstr(s), slen(s), hash );
+    e->hash = hash;
+    return SPoolTake( p, e, sstr(s), slen(s), salc(s) ? s : NULL, avoid,
+            type );
 }
@@ -3,15 +3,32 @@
 
 #include "litypes.h"
 
+#include <string.h>
+
 /* li string */
 typedef struct liStr_t {
-    lisize_t    alloced;    /* alloced size */
+    lisize_t    alloced;    /* alloced size (0 - embedded into a block) */
     lisize_t    length;     /* length of string without \0 character */
-    lisize_t    numRefs;    /* number of references of this string */
+    lirefs_t    numRefs;    /* number of references of this string */
     char        string[0];  /* null-terminated string */
 } liStr_t;
 
 
+/* string pool entry */
+typedef struct {
+    uint64_t    hash;
+    liStr_t     *str;       /* shared string (NULL - free entry) */
+    liStr_t     *alt;       /* second copy for equal neighbour keys */
+} liSPoolEnt_t;
+
+/* pool of shared strings */
+typedef struct {
+    liSPoolEnt_t    *ents;
+    lisize_t        size;   /* number of entries (power of 2) */
+    lisize_t        num;    /* used entries */
+} liSPool_t;
+
+
 #define     salc(s)     ((s)->alloced)
 #define     slen(s)     ((s)->length)
 #define     sstr(s)     ((s)->string)
@@ -19,11 +36,13 @@ typedef struct liStr_t {
 
 
 liStr_t     *LiSAlloc( lisize_t siz );
+liStr_t     *LiSAllocType( lisize_t siz, lityid_t type );
 liStr_t     *LiSRealloc( liStr_t *s, lisize_t siz );
 void        LiSFree( liStr_t *s );
 
 liStr_t     *LiSNew( const char *cs );
 liStr_t     *LiSNewL( const char *cs, lisize_t len );
+liStr_t     *LiSNewKeyL( const char *cs, lisize_t len );
 liStr_t     *LiSRef( liStr_t *s );
 
 liStr_t     *LiSSet( liStr_t *s, const char *cs );
@@ -33,7 +52,20 @@ liStr_t     *LiSCat( liStr_t *s, const char *cs );
 liStr_t     *LiSCatL( liStr_t *s, const char *cs, lisize_t len );
 
 libool_t    LiSCmp( liStr_t *s, const char *cs );
+#if defined(LI_CHECKED_CALLS)
 libool_t    LiSCmpL( liStr_t *s, const char *cs, lisize_t len );
+#else
+static inline libool_t LiSCmpL( liStr_t *s, const char *cs, lisize_t len ) {
+    return (slen(s) == len) && (memcmp( sstr(s), cs, len ) == 0);
+}
+#endif
+
+void        LiSPoolInit( liSPool_t *p );
+void        LiSPoolFree( liSPool_t *p );
+liStr_t     *LiSPoolGet( liSPool_t *p, const char *cs, lisize_t len, 
+                    liStr_t *avoid, lityid_t type );
+liStr_t     *LiSPoolRef( liSPool_t *p, liStr_t *s, liStr_t *avoid,
+                    lityid_t type );
 
 
 #endif //__LISTR_H__
\ No newline at end of file
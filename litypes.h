@@ -4,6 +4,9 @@
 #include <stdint.h>
 
 /*#define LI_SIZETYPE_64BIT*/
+/*#define LI_ATOMIC_REFS*/     /* thread-safe string reference counters */
+/*#define LI_ZLIB*/            /* gzip I/O through zlib (link with -lz) */
+/*#define LI_READ_STATS*/      /* parser counters (LiSetReadStats) */
 
 /* litypes */
 typedef uint32_t        lityid_t;
@@ -16,14 +19,23 @@ typedef uint32_t        liflag_t;
 #else
     typedef uint32_t    lisize_t;
 #endif
+#if defined(LI_ATOMIC_REFS)
+    typedef _Atomic lisize_t    lirefs_t;
+#else
+    typedef lisize_t            lirefs_t;
+#endif
 
 
 
 /* lityid */
-#define LI_TYID_STR     1
+#define LI_TYID_STR     1   /* string values */
 #define LI_TYID_NODE    2
 #define LI_TYID_ARR     3
-#define LI_TYID_BUF     3
+#define LI_TYID_DOC     4
+#define LI_TYID_DICT    5
+#define LI_TYID_IMG     6
+#define LI_TYID_BUF     7
+#define LI_TYID_KEY     8   /* keys */
 
 /* litype (li value type) */
 #define LI_VTNULL       1
@@ -44,6 +56,7 @@ typedef uint32_t        liflag_t;
 #define LI_EFILEOPEN    ((licode_t)3)
 #define LI_EINPDAT      ((licode_t)4)
 #define LI_FINISHED     ((licode_t)5)
+#define LI_EBUSY        ((licode_t)6)
 
 /* liflag */
 #define LI_FDEC         0x0000
@@ -52,6 +65,19 @@ typedef uint32_t        liflag_t;
 #define LI_FHEX         0x0003
 #define LI_FBASE_MASK   0x0003
 #define LI_FSIGN        0x0004
+#define LI_FMINIFY      0x0010  /* LiWriteEx: no whitespace */
+#define LI_FPARALLEL    0x0020  /* LiWriteEx: write on several threads */
+#define LI_FLZ          0x0040  /* LiWriteEx: built-in compression */
+#define LI_FGZIP        0x0080  /* LiWriteEx: gzip compression (LI_ZLIB) */
+#define LI_FDEDUP       0x0200  /* LiReadEx: share equal keys and strings */
+
+/* internal liflag, never set or passed by callers */
+#define LI_FEMBED       0x80000000  /* node lives in a deep clone block */
+
+/* checked out-of-line accessors (with asserts), else inline in headers */
+#if defined(DEBUG) && !defined(LI_NODBG)
+    #define LI_CHECKED_CALLS
+#endif
 
 /* unused variavle macro */
 #define liunused(a)     ((void)a)
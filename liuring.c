@@ -0,0 +1,818 @@
+#define _GNU_SOURCE
+
+#include "liuring.h"
+#include "liassert.h"
+#include "liutil.h"
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+/* LI_NO_URING - files always use pread/pwrite */
+#if defined(__linux__) && !defined(LI_NO_URING)
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#define LI_HAVE_URING
+#endif
+
+
+
+/*
+================================================
+                  li uring I/O
+
+Every file has its own ring and LI_URING_DEPTH
+registered blocks, so files can be used on different
+threads without locks.
+
+read: all blocks are queued on open, a block is
+queued again for the next free file offset as soon
+as the scanner has copied it out or given it back
+(the blocks are lent with acquire).
+
+write: data is copied into a free block and submitted,
+the call only waits when all blocks are in flight.
+Write errors are returned by the next write call, the
+final write of size 0 waits for all blocks and
+returns the errors of the last ones.
+
+Pipes and other files that are not regular files
+can't be used with offsets, they are read and written
+in order with read/write.
+================================================
+*/
+
+#if defined(LI_HAVE_URING)
+/* submission and completion rings */
+typedef struct {
+    int                     fd;
+    unsigned                *sqHead;
+    unsigned                *sqTail;
+    unsigned                *sqMask;
+    unsigned                *sqArray;
+    struct io_uring_sqe     *sqes;
+    unsigned                *cqHead;
+    unsigned                *cqTail;
+    unsigned                *cqMask;
+    struct io_uring_cqe     *cqes;
+    void                    *sqPtr;
+    size_t                  sqSize;
+    void                    *cqPtr;
+    size_t                  cqSize;
+    size_t                  sqesSize;
+    unsigned                toSubmit;
+} liRing_t;
+#endif
+
+/* uring file */
+typedef struct {
+    int         fd;
+    char        mode;
+    libool_t    useRing;
+    libool_t    stream;                     /* not a regular file */
+    uint8_t     *bufs;                      /* LI_URING_DEPTH blocks */
+    ssize_t     res[LI_URING_DEPTH];        /* block length (-1 - pending) */
+    int         numPending;
+    off_t       offset;                     /* next file offset */
+    off_t       size;                       /* file size (read) */
+    uint64_t    block;                      /* block being read */
+    size_t      pos;                        /* position in the block */
+    size_t      len;                        /* block length (pread) */
+    uint8_t     *map;                       /* mapped file (liMapIO) */
+    int         freeBufs[LI_URING_DEPTH];   /* write */
+    int         numFree;
+    libool_t    failed;                     /* a write failed */
+#if defined(LI_HAVE_URING)
+    liRing_t    ring;
+#endif
+} liUFile_t;
+
+#if defined(LI_HAVE_URING)
+/*
+============
+RingSetup
+============
+*/
+static libool_t RingSetup( liRing_t *r, unsigned entries ) {
+    struct io_uring_params p;
+
+    memset( &p, 0, sizeof(p) );
+    memset( r, 0, sizeof(*r) );
+    r->fd = (int)syscall( __NR_io_uring_setup, entries, &p );
+    if( r->fd < 0 ) {
+        return lifalse;
+    }
+
+    r->sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        if( r->cqSize > r->sqSize ) {
+            r->sqSize = r->cqSize;
+        }
+        r->cqSize = r->sqSize;
+    }
+
+    r->sqPtr = mmap( NULL, r->sqSize, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING );
+    if( r->sqPtr == MAP_FAILED ) {
+        close( r->fd );
+        return lifalse;
+    }
+    if( p.features & IORING_FEAT_SINGLE_MMAP ) {
+        r->cqPtr = r->sqPtr;
+    } else {
+        r->cqPtr = mmap( NULL, r->cqSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING );
+        if( r->cqPtr == MAP_FAILED ) {
+            munmap( r->sqPtr, r->sqSize );
+            close( r->fd );
+            return lifalse;
+        }
+    }
+    r->sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe*)mmap( NULL, r->sqesSize,
+            PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+            IORING_OFF_SQES );
+    if( r->sqes == MAP_FAILED ) {
+        if( r->cqPtr != r->sqPtr ) {
+            munmap( r->cqPtr, r->cqSize );
+        }
+        munmap( r->sqPtr, r->sqSize );
+        close( r->fd );
+        return lifalse;
+    }
+
+    r->sqHead = (unsigned*)((char*)r->sqPtr + p.sq_off.head);
+    r->sqTail = (unsigned*)((char*)r->sqPtr + p.sq_off.tail);
+    r->sqMask = (unsigned*)((char*)r->sqPtr + p.sq_off.ring_mask);
+    r->sqArray = (unsigned*)((char*)r->sqPtr + p.sq_off.array);
+    r->cqHead = (unsigned*)((char*)r->cqPtr + p.cq_off.head);
+    r->cqTail = (unsigned*)((char*)r->cqPtr + p.cq_off.tail);
+    r->cqMask = (unsigned*)((char*)r->cqPtr + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)((char*)r->cqPtr + p.cq_off.cqes);
+
+    return litrue;
+}
+
+/*
+============
+RingFree
+============
+*/
+static void RingFree( liRing_t *r ) {
+    munmap( r->sqes, r->sqesSize );
+    if( r->cqPtr != r->sqPtr ) {
+        munmap( r->cqPtr, r->cqSize );
+    }
+    munmap( r->sqPtr, r->sqSize );
+    close( r->fd );
+}
+
+/*
+============
+RingQueue
+
+Queues a fixed buffer read or write of one block
+============
+*/
+static void RingQueue( liUFile_t *u, int op, int buf, size_t len,
+        off_t offset ) {
+    liRing_t *r = &u->ring;
+    unsigned tail = *r->sqTail;
+    unsigned idx = tail & *r->sqMask;
+    struct io_uring_sqe *sqe = r->sqes + idx;
+
+    memset( sqe, 0, sizeof(*sqe) );
+    sqe->opcode = (uint8_t)op;
+    sqe->fd = u->fd;
+    sqe->off = (uint64_t)offset;
+    sqe->addr = (uint64_t)(uintptr_t)(u->bufs +
+            (size_t)buf * LI_URING_BLOCK_SIZE);
+    sqe->len = (uint32_t)len;
+    sqe->buf_index = (uint16_t)buf;
+    sqe->user_data = (uint64_t)buf;
+    r->sqArray[idx] = idx;
+    __atomic_store_n( r->sqTail, tail + 1, __ATOMIC_RELEASE );
+
+    r->toSubmit++;
+    u->numPending++;
+}
+
+/*
+============
+RingEnter
+
+Submits the queued entries and waits for minComplete
+completions
+============
+*/
+static libool_t RingEnter( liRing_t *r, unsigned minComplete ) {
+    int ret;
+
+    do {
+        ret = (int)syscall( __NR_io_uring_enter, r->fd, r->toSubmit,
+                minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0,
+                NULL, 0 );
+    } while( ret < 0 && errno == EINTR );
+    if( ret < 0 ) {
+        return lifalse;
+    }
+    r->toSubmit -= (unsigned)ret < r->toSubmit ? (unsigned)ret : r->toSubmit;
+
+    return litrue;
+}
+
+/*
+============
+RingReap
+
+Takes one completion, returns the block or -1 if
+there is none
+============
+*/
+static int RingReap( liUFile_t *u, int32_t *res ) {
+    liRing_t *r = &u->ring;
+    unsigned head = *r->cqHead;
+    struct io_uring_cqe *cqe;
+    int buf;
+
+    if( head == __atomic_load_n( r->cqTail, __ATOMIC_ACQUIRE ) ) {
+        return -1;
+    }
+    cqe = r->cqes + (head & *r->cqMask);
+    buf = (int)cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n( r->cqHead, head + 1, __ATOMIC_RELEASE );
+    u->numPending--;
+
+    return buf;
+}
+
+/*
+============
+RingWait
+
+Waits for one completion
+============
+*/
+static int RingWait( liUFile_t *u, int32_t *res ) {
+    int buf;
+
+    while( (buf = RingReap( u, res )) < 0 ) {
+        if( !RingEnter( &u->ring, 1 ) ) {
+            return -1;
+        }
+    }
+    return buf;
+}
+
+/*
+============
+QueueRead
+============
+*/
+static void QueueRead( liUFile_t *u, int buf ) {
+    size_t len = LI_URING_BLOCK_SIZE;
+
+    if( u->offset >= u->size ) {
+        /* past the end */
+        u->res[buf] = 0;
+        return;
+    }
+    if( (off_t)len > u->size - u->offset ) {
+        len = (size_t)(u->size - u->offset);
+    }
+    u->res[buf] = -1;
+    RingQueue( u, IORING_OP_READ_FIXED, buf, len, u->offset );
+    u->offset += (off_t)len;
+}
+#endif
+
+/*
+============
+LiUringAvailable
+============
+*/
+libool_t LiUringAvailable( void ) {
+#if defined(LI_HAVE_URING)
+    liRing_t r;
+
+    if( RingSetup( &r, 1 ) ) {
+        RingFree( &r );
+        return litrue;
+    }
+#endif
+    return lifalse;
+}
+
+/*
+============
+StartRing
+
+Sets up the ring and registers the blocks, the file
+uses pread/pwrite if that fails
+============
+*/
+static void StartRing( liUFile_t *u ) {
+#if defined(LI_HAVE_URING)
+    struct iovec iov[LI_URING_DEPTH];
+    int i;
+
+    if( !RingSetup( &u->ring, LI_URING_DEPTH ) ) {
+        return;
+    }
+    for( i = 0; i < LI_URING_DEPTH; i++ ) {
+        iov[i].iov_base = u->bufs + (size_t)i * LI_URING_BLOCK_SIZE;
+        iov[i].iov_len = LI_URING_BLOCK_SIZE;
+    }
+    if( syscall( __NR_io_uring_register, u->ring.fd,
+            IORING_REGISTER_BUFFERS, iov, LI_URING_DEPTH ) < 0 ) {
+        RingFree( &u->ring );
+        return;
+    }
+    u->useRing = litrue;
+
+    if( u->mode == 'r' ) {
+        for( i = 0; i < LI_URING_DEPTH; i++ ) {
+            QueueRead( u, i );
+        }
+        if( !RingEnter( &u->ring, 0 ) ) {
+            u->failed = litrue;
+        }
+    }
+#else
+    liunused( u );
+#endif
+}
+
+/*
+============
+LiUringOpen
+============
+*/
+static liFile_t LiUringOpen( const char *name, char mode ) {
+    liUFile_t *u;
+    struct stat st;
+    int fd;
+    int i;
+
+    liverify( mode == 'r' || mode == 'w' );
+    liassert( name );
+    liassert( name[0] );
+
+    if( mode == 'r' ) {
+        fd = open( name, O_RDONLY | O_CLOEXEC );
+    } else {
+        fd = open( name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+    }
+    if( fd < 0 ) {
+        return NULL;
+    }
+
+    u = (liUFile_t*)LiAlloc( sizeof(liUFile_t), LI_TYID_BUF );
+    memset( u, 0, sizeof(*u) );
+    u->fd = fd;
+    u->mode = mode;
+    for( i = 0; i < LI_URING_DEPTH; i++ ) {
+        u->freeBufs[i] = i;
+    }
+    u->numFree = LI_URING_DEPTH;
+    u->bufs = (uint8_t*)LiAlloc( (size_t)LI_URING_DEPTH *
+            LI_URING_BLOCK_SIZE, LI_TYID_BUF );
+
+    if( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+        /* unknown size and no offsets, use read/write */
+        u->stream = litrue;
+        if( mode == 'w' ) {
+            LiDealloc( u->bufs );
+            u->bufs = NULL;
+        }
+        return (liFile_t)u;
+    }
+    if( mode == 'r' ) {
+        u->size = st.st_size;
+    }
+    StartRing( u );
+    if( !u->useRing && mode == 'w' ) {
+        LiDealloc( u->bufs );
+        u->bufs = NULL;
+    }
+
+    return (liFile_t)u;
+}
+
+/*
+============
+LiUringClose
+============
+*/
+static void LiUringClose( liFile_t file ) {
+    liUFile_t *u = (liUFile_t*)file;
+
+    liassert( u );
+
+#if defined(LI_HAVE_URING)
+    if( u->useRing ) {
+        int32_t res;
+
+        /* the blocks must not be freed while the kernel uses them */
+        while( u->numPending ) {
+            if( RingWait( u, &res ) < 0 ) {
+                break;
+            }
+        }
+        RingFree( &u->ring );
+    }
+#endif
+
+    if( u->map ) {
+        munmap( u->map, (size_t)u->size );
+    }
+    close( u->fd );
+    if( u->bufs ) {
+        LiDealloc( u->bufs );
+    }
+    LiDealloc( u );
+}
+
+/*
+============
+CurBlock
+
+Returns the unread length of the current block, the
+used up blocks are queued again. 0 - end of the file.
+============
+*/
+static ssize_t CurBlock( liUFile_t *u, uint8_t **data ) {
+    ssize_t n;
+
+    if( !u->useRing ) {
+        if( u->pos == u->len ) {
+            do {
+                if( u->stream ) {
+                    n = read( u->fd, u->bufs, LI_URING_BLOCK_SIZE );
+                } else {
+                    n = pread( u->fd, u->bufs, LI_URING_BLOCK_SIZE,
+                            u->offset );
+                }
+            } while( n < 0 && errno == EINTR );
+            if( n <= 0 ) {
+                return n;
+            }
+            u->offset += n;
+            u->pos = 0;
+            u->len = (size_t)n;
+        }
+        *data = u->bufs + u->pos;
+        return (ssize_t)(u->len - u->pos);
+    }
+
+#if defined(LI_HAVE_URING)
+    if( u->failed ) {
+        return -1;
+    }
+    while( 1 ) {
+        int buf = (int)(u->block % LI_URING_DEPTH);
+        uint8_t *p = u->bufs + (size_t)buf * LI_URING_BLOCK_SIZE;
+        int32_t res;
+        int done;
+        size_t len;
+
+        while( u->res[buf] < 0 ) {
+            done = RingWait( u, &res );
+            if( done < 0 || res < 0 ) {
+                u->failed = litrue;
+                return -1;
+            }
+            u->res[done] = res;
+        }
+
+        len = (size_t)u->res[buf];
+        if( u->pos < len ) {
+            *data = p + u->pos;
+            return (ssize_t)(len - u->pos);
+        }
+        if( len == 0 ) {
+            /* end of the file */
+            return 0;
+        }
+        if( len < LI_URING_BLOCK_SIZE &&
+                (off_t)((u->block + 1) * LI_URING_BLOCK_SIZE) < u->size ) {
+            /* short read inside the file, finish it here */
+            n = pread( u->fd, p + len, LI_URING_BLOCK_SIZE - len,
+                    (off_t)(u->block * LI_URING_BLOCK_SIZE + len) );
+            if( n <= 0 ) {
+                u->failed = litrue;
+                return -1;
+            }
+            u->res[buf] += n;
+            continue;
+        }
+        /* the block is used up, read ahead into it */
+        QueueRead( u, buf );
+        if( u->res[buf] < 0 && !RingEnter( &u->ring, 0 ) ) {
+            u->failed = litrue;
+            return -1;
+        }
+        u->block++;
+        u->pos = 0;
+    }
+#else
+    return -1;
+#endif
+}
+
+/*
+============
+LiUringRead
+============
+*/
+static ssize_t LiUringRead( void *dst, size_t size, liFile_t file ) {
+    liUFile_t *u = (liUFile_t*)file;
+    size_t total = 0;
+    uint8_t *data;
+    ssize_t n;
+
+    liassert( dst );
+    liassert( u );
+
+    while( total < size ) {
+        n = CurBlock( u, &data );
+        if( n < 0 ) {
+            return -1;
+        }
+        if( n == 0 ) {
+            break;
+        }
+        if( (size_t)n > size - total ) {
+            n = (ssize_t)(size - total);
+        }
+        MemCpy( (uint8_t*)dst + total, data, (size_t)n );
+        total += (size_t)n;
+        u->pos += (size_t)n;
+    }
+
+    return (ssize_t)total;
+}
+
+/*
+============
+LiUringAcquire
+
+Lends the rest of the current block
+============
+*/
+static ssize_t LiUringAcquire( const void **data, liFile_t file ) {
+    liUFile_t *u = (liUFile_t*)file;
+    uint8_t *p;
+    ssize_t n;
+
+    liassert( data );
+    liassert( u );
+
+    n = CurBlock( u, &p );
+    if( n > 0 ) {
+        *data = p;
+        u->pos += (size_t)n;
+    }
+    return n;
+}
+
+/*
+============
+LiUringRelease
+
+The block is queued again by the next acquire
+============
+*/
+static void LiUringRelease( const void *data, liFile_t file ) {
+    liunused( data );
+    liunused( file );
+}
+
+#if defined(LI_HAVE_URING)
+/*
+============
+FinishWrites
+
+Waits for all blocks in flight, returns lifalse if
+any of the writes failed
+============
+*/
+static libool_t FinishWrites( liUFile_t *u ) {
+    int32_t res;
+    int buf;
+
+    if( u->ring.toSubmit && !RingEnter( &u->ring, 0 ) ) {
+        u->failed = litrue;
+    }
+    while( u->numPending ) {
+        buf = RingWait( u, &res );
+        if( buf < 0 ) {
+            u->failed = litrue;
+            break;
+        }
+        if( res != u->res[buf] ) {
+            u->failed = litrue;
+        }
+        u->freeBufs[ u->numFree++ ] = buf;
+    }
+    return !u->failed;
+}
+#endif
+
+/*
+============
+LiUringWrite
+
+A write of size 0 finishes the written data
+============
+*/
+static ssize_t LiUringWrite( const void *src, size_t size, liFile_t file ) {
+    liUFile_t *u = (liUFile_t*)file;
+    const uint8_t *in = (const uint8_t*)src;
+    size_t left = size;
+    ssize_t n;
+
+    liassert( src );
+    liassert( u );
+
+    if( !u->useRing ) {
+        while( left ) {
+            if( u->stream ) {
+                n = write( u->fd, in, left );
+            } else {
+                n = pwrite( u->fd, in, left, u->offset );
+            }
+            if( n < 0 && errno == EINTR ) {
+                continue;
+            }
+            if( n <= 0 ) {
+                return -1;
+            }
+            in += n;
+            left -= (size_t)n;
+            u->offset += n;
+        }
+        return (ssize_t)size;
+    }
+
+#if defined(LI_HAVE_URING)
+    if( size == 0 ) {
+        return FinishWrites( u ) ? 0 : -1;
+    }
+    while( left ) {
+        size_t len = left < LI_URING_BLOCK_SIZE ? left : LI_URING_BLOCK_SIZE;
+        int32_t res;
+        int buf;
+
+        /* reap finished writes, wait only if all blocks are busy */
+        while( (buf = RingReap( u, &res )) >= 0 ||
+                (!u->numFree && (buf = RingWait( u, &res )) >= 0) ) {
+            if( res != u->res[buf] ) {
+                u->failed = litrue;
+            }
+            u->freeBufs[ u->numFree++ ] = buf;
+        }
+        if( u->failed || !u->numFree ) {
+            u->failed = litrue;
+            return -1;
+        }
+
+        buf = u->freeBufs[ --u->numFree ];
+        MemCpy( u->bufs + (size_t)buf * LI_URING_BLOCK_SIZE, in, len );
+        u->res[buf] = (ssize_t)len;
+        RingQueue( u, IORING_OP_WRITE_FIXED, buf, len, u->offset );
+        u->offset += (off_t)len;
+        in += len;
+        left -= len;
+    }
+    /* one submission for the whole call */
+    if( !RingEnter( &u->ring, 0 ) ) {
+        u->failed = litrue;
+        return -1;
+    }
+#endif
+
+    return (ssize_t)size;
+}
+
+liIO_t liUringIO = {
+    LiUringOpen,
+    LiUringClose,
+    LiUringRead,
+    LiUringWrite,
+    LiUringAcquire,
+    LiUringRelease
+};
+
+
+
+/*
+================================================
+                   li map I/O
+
+Files are mapped for reading and lent in one piece,
+writing is the same as with liUringIO.
+================================================
+*/
+
+/*
+============
+LiMapOpen
+============
+*/
+static liFile_t LiMapOpen( const char *name, char mode ) {
+    liUFile_t *u;
+    struct stat st;
+    void *map;
+    int fd;
+
+    liverify( mode == 'r' || mode == 'w' );
+    liassert( name );
+    liassert( name[0] );
+
+    if( mode == 'w' ) {
+        return LiUringOpen( name, mode );
+    }
+
+    fd = open( name, O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) {
+        return NULL;
+    }
+    if( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) ) {
+        close( fd );
+        return NULL;
+    }
+
+    u = (liUFile_t*)LiAlloc( sizeof(liUFile_t), LI_TYID_BUF );
+    memset( u, 0, sizeof(*u) );
+    u->fd = fd;
+    u->mode = mode;
+    if( st.st_size > 0 ) {
+        map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( map == MAP_FAILED ) {
+            close( fd );
+            LiDealloc( u );
+            return NULL;
+        }
+        madvise( map, (size_t)st.st_size, MADV_SEQUENTIAL );
+        u->map = (uint8_t*)map;
+        u->size = st.st_size;
+    }
+
+    return (liFile_t)u;
+}
+
+/*
+============
+LiMapRead
+============
+*/
+static ssize_t LiMapRead( void *dst, size_t size, liFile_t file ) {
+    liUFile_t *u = (liUFile_t*)file;
+    size_t n = (size_t)(u->size - u->offset);
+
+    liassert( dst );
+    liassert( u );
+
+    if( n > size ) {
+        n = size;
+    }
+    if( n ) {
+        MemCpy( dst, u->map + u->offset, n );
+        u->offset += (off_t)n;
+    }
+
+    return (ssize_t)n;
+}
+
+/*
+============
+LiMapAcquire
+============
+*/
+static ssize_t LiMapAcquire( const void **data, liFile_t file ) {
+    liUFile_t *u = (liUFile_t*)file;
+    size_t n = (size_t)(u->size - u->offset);
+
+    liassert( data );
+    liassert( u );
+
+    *data = u->map + u->offset;
+    u->offset = u->size;
+
+    return (ssize_t)n;
+}
+
+liIO_t liMapIO = {
+    LiMapOpen,
+    LiUringClose,
+    LiMapRead,
+    LiUringWrite,
+    LiMapAcquire,
+    LiUringRelease
+};
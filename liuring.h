@@ -0,0 +1,23 @@
+#ifndef __LIURING_H__
+#define __LIURING_H__
+
+#include "li.h"
+
+#define LI_URING_DEPTH          8           /* blocks in flight per file */
+#define LI_URING_BLOCK_SIZE     (64 * 1024)
+
+/*
+File I/O without stdio. On Linux reads are queued
+ahead and writes are submitted without waiting through
+an io_uring with registered buffers. Without io_uring
+the files use pread/pwrite, pipes use read/write.
+Building with LI_NO_URING leaves io_uring out.
+*/
+extern liIO_t   liUringIO;
+
+/* files mapped for reading, lent to the scanner in one piece */
+extern liIO_t   liMapIO;
+
+libool_t    LiUringAvailable( void );
+
+#endif //__LIURING_H__
@@ -173,7 +173,9 @@ liIO_t liDefaultIO = {
     LiDefaultOpen,
     LiDefaultClose,
     LiDefaultRead,
-    LiDefaultWrite
+    LiDefaultWrite,
+    NULL,
+    NULL
 };
 
 
@@ -197,13 +199,125 @@ lisize_t CeilPow2( lisize_t v ) {
     return v;
 }
 
+static const char liAlpha[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+static const char liDigits100[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/*
+============
+CountDigits10
+============
+*/
+static int CountDigits10( uint64_t val ) {
+    int n = 1;
+    
+    while( 1 ) {
+        if( val < 10 ) {
+            return n;
+        }
+        if( val < 100 ) {
+            return n + 1;
+        }
+        if( val < 1000 ) {
+            return n + 2;
+        }
+        if( val < 10000 ) {
+            return n + 3;
+        }
+        val /= 10000;
+        n += 4;
+    }
+}
+
+/*
+============
+BitLength
+============
+*/
+static int BitLength( uint64_t val ) {
+#if defined(__GNUC__)
+    return val ? 64 - __builtin_clzll( val ) : 0;
+#else
+    int n = 0;
+    while( val ) {
+        val >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+============
+UInt64ToDec
+
+The length is known up front, digits are written
+from the end two at a time
+============
+*/
+static size_t UInt64ToDec( uint64_t val, char *str ) {
+    int len = CountDigits10( val );
+    char *p = str + len;
+    uint64_t q;
+    
+    *p = 0;
+    while( val >= 100 ) {
+        q = val / 100;
+        p -= 2;
+        MemCpy( p, liDigits100 + (val - q * 100) * 2, 2 );
+        val = q;
+    }
+    if( val >= 10 ) {
+        p -= 2;
+        MemCpy( p, liDigits100 + val * 2, 2 );
+    } else {
+        *--p = (char)('0' + val);
+    }
+    
+    return (size_t)len;
+}
+
+/*
+============
+UInt64ToPow2
+
+Bases 2, 8 and 16, shift is log2 of the base
+============
+*/
+static size_t UInt64ToPow2( uint64_t val, char *str, int shift ) {
+    int len = (BitLength( val ) + shift - 1) / shift;
+    uint64_t mask = ((uint64_t)1 << shift) - 1;
+    char *p;
+    
+    if( !len ) {
+        len = 1;
+    }
+    p = str + len;
+    *p = 0;
+    do {
+        *--p = liAlpha[ val & mask ];
+        val >>= shift;
+    } while( p > str );
+    
+    return (size_t)len;
+}
+
 /*
 ============
 UInt64ToStr
 ============
 */
 size_t UInt64ToStr( uint64_t val, char *str, int base ) {
-    static const char alpha[] = "0123456789abcdefghijklmnopqrstuvwxyz";
     char *p = str;
     uint8_t digits[64]; /* value digits */
     int dig = 0;        /* amount of digits */
@@ -211,6 +325,17 @@ size_t UInt64ToStr( uint64_t val, char *str, int base ) {
     liassert( base >= 2 );
     liassert( base <= 36 );
     
+    switch( base ) {
+        case 10:
+            return UInt64ToDec( val, str );
+        case 16:
+            return UInt64ToPow2( val, str, 4 );
+        case 8:
+            return UInt64ToPow2( val, str, 3 );
+        case 2:
+            return UInt64ToPow2( val, str, 1 );
+    }
+    
     /* calculate digits */
     do {
         digits[dig++] = (uint8_t)(val % base);
@@ -219,7 +344,7 @@ size_t UInt64ToStr( uint64_t val, char *str, int base ) {
     
     /* copy the flipped digits to the output buffer */
     do {
-        *p++ = alpha[ digits[--dig] ];
+        *p++ = liAlpha[ digits[--dig] ];
     } while( dig > 0 );
     *p = 0;
     
@@ -238,54 +363,75 @@ size_t Int64ToStr( int64_t val, char *str, int base ) {
     /* check for negative value */
     if( val < 0 ) {
         *str++ = '-';
-        return UInt64ToStr( (uint64_t)(-val), str, base ) + 1;
+        return UInt64ToStr( (uint64_t)0 - (uint64_t)val, str, base ) + 1;
     }
     return UInt64ToStr( (uint64_t)val, str, base );
 }
 
+/* character classes: 0x01 - next key char, 0x02 - first key char,
+   0x04 - space */
+const uint8_t liCharFlags[256] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 
+    0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
+    0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 
+    0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
+    0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
+    0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+#if defined(LI_CHECKED_CALLS)
 /*
 ============
 __charis
 ============
 */
 libool_t __charis( char c, uint8_t flag ) {
-    uint8_t i = *((uint8_t*)(void*)(&c));
-    static const char flags[256] = {
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 
-        0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
-        0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
-        0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
-        0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x03, 
-        0x00, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
-        0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
-        0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 
-        0x03, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
-        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-    };
+    return !!(liCharFlags[(uint8_t)c] & flag);
+}
+#endif
+
+/*
+============
+HashBytes
+
+64-bit FNV-1a. Pass LI_HASH_INIT as hash for a new hash
+or a previous result to continue it.
+============
+*/
+uint64_t HashBytes( const void *data, size_t len, uint64_t hash ) {
+    const uint8_t *p = (const uint8_t*)data;
     
-    return !!(flags[i] & flag);
+    while( len-- ) {
+        hash ^= *p++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
 }
 
 /*
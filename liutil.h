@@ -4,11 +4,25 @@
 #include "litypes.h"
 #include "listr.h"
 
+#include <stddef.h>
+
+#define     LI_HASH_INIT        0xcbf29ce484222325ULL
+
 lisize_t    CeilPow2( lisize_t v );
 size_t      UInt64ToStr( uint64_t val, char *str, int base );
 size_t      Int64ToStr( int64_t val, char *str, int base );
 
+extern const uint8_t liCharFlags[256];
+
+#if defined(LI_CHECKED_CALLS)
 libool_t    __charis( char c, uint8_t flag );
+#else
+static inline libool_t __charis( char c, uint8_t flag ) {
+    return !!(liCharFlags[(uint8_t)c] & flag);
+}
+#endif
+
+uint64_t    HashBytes( const void *data, size_t len, uint64_t hash );
 
 size_t      StrLen( const char *s );
 void        *MemCpy( void *dst, const void *src, size_t num );
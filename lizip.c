@@ -0,0 +1,779 @@
+#include "lizip.h"
+#include "liassert.h"
+#include "liutil.h"
+
+#include <string.h>
+#if defined(LI_ZLIB)
+#include <zlib.h>
+#endif
+
+
+
+/*
+================================================
+                 li compressed I/O
+
+LZ file (LI_FLZ):
+    "LIZ\1"
+    blocks      u32 raw length, u32 stored length,
+                data (stored length == raw length -
+                the block is not compressed)
+
+LZ block (LZ4 style sequences):
+    token       bits 4-7 literal length, bits 0-3
+                match length - 4 (15 - more length
+                bytes follow, 255 - one more byte)
+    literals
+    offset      u16, back from the current position
+    match
+The last sequence has literals only.
+
+gzip file (LI_FGZIP, LI_ZLIB only):
+    RFC 1952 stream written with zlib
+================================================
+*/
+
+#define ZIP_MAGIC           "LIZ\1"
+#define ZIP_MAGIC_LEN       4
+#define ZIP_HEADER_LEN      8
+
+#define ZIP_RAW             0
+#define ZIP_LZ              1
+#define ZIP_GZ              2
+
+#define LZ_MIN_MATCH        4
+#define LZ_HASH_BITS        12
+#define LZ_MAX_OFFSET       0xffff
+
+/* compressed file */
+typedef struct {
+    liIO_t      *io;        /* base I/O */
+    liFile_t    f;          /* base file */
+    char        mode;
+    int         codec;
+    uint8_t     *buf;       /* decoded block (read) */
+    size_t      pos;
+    size_t      len;
+    uint8_t     *comp;      /* compressed block */
+    libool_t    baseLent;   /* the lent data is from the base I/O */
+#if defined(LI_ZLIB)
+    z_stream    zs;
+    libool_t    finished;   /* the gzip stream is ended (written or read) */
+#endif
+} liZFile_t;
+
+/*
+============
+GetU32
+============
+*/
+static uint32_t GetU32( const uint8_t *p ) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+            ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+============
+PutU32
+============
+*/
+static void PutU32( uint8_t *p, uint32_t v ) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+============
+LzHash
+============
+*/
+static uint32_t LzHash( const uint8_t *p ) {
+    uint32_t v;
+    memcpy( &v, p, 4 );
+    return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/*
+============
+LzPutSeq
+
+Writes a sequence, returns NULL if it does not fit
+============
+*/
+static uint8_t *LzPutSeq( uint8_t *op, uint8_t *oend, const uint8_t *lit,
+        size_t litLen, size_t offset, size_t matchLen ) {
+    size_t mlen = matchLen ? matchLen - LZ_MIN_MATCH : 0;
+    size_t n;
+
+    if( (size_t)(oend - op) < 1 + litLen / 255 + 1 + litLen + 2 +
+            mlen / 255 + 1 ) {
+        return NULL;
+    }
+
+    *op++ = (uint8_t)(((litLen < 15 ? litLen : 15) << 4) |
+            (mlen < 15 ? mlen : 15));
+    if( litLen >= 15 ) {
+        for( n = litLen - 15; n >= 255; n -= 255 ) {
+            *op++ = 255;
+        }
+        *op++ = (uint8_t)n;
+    }
+    memcpy( op, lit, litLen );
+    op += litLen;
+
+    if( matchLen ) {
+        *op++ = (uint8_t)offset;
+        *op++ = (uint8_t)(offset >> 8);
+        if( mlen >= 15 ) {
+            for( n = mlen - 15; n >= 255; n -= 255 ) {
+                *op++ = 255;
+            }
+            *op++ = (uint8_t)n;
+        }
+    }
+
+    return op;
+}
+
+/*
+============
+LiLzCompress
+
+Compresses one block. Returns the compressed length,
+0 if it does not fit into dstLen.
+============
+*/
+size_t LiLzCompress( const void *src, size_t len, void *dst,
+        size_t dstLen ) {
+    const uint8_t *in = (const uint8_t*)src;
+    uint8_t *op = (uint8_t*)dst;
+    uint8_t *oend = op + dstLen;
+    size_t table[1 << LZ_HASH_BITS];
+    size_t ip = 0;
+    size_t anchor = 0;
+    size_t ref;
+    size_t ml;
+    uint32_t h;
+
+    liassert( src || !len );
+    liassert( dst );
+
+    memset( table, 0xff, sizeof(table) );
+    while( ip + LZ_MIN_MATCH <= len ) {
+        h = LzHash( in + ip );
+        ref = table[h];
+        table[h] = ip;
+        if( ref < ip && ip - ref <= LZ_MAX_OFFSET &&
+                memcmp( in + ref, in + ip, LZ_MIN_MATCH ) == 0 ) {
+            ml = LZ_MIN_MATCH;
+            while( ip + ml < len && in[ref + ml] == in[ip + ml] ) {
+                ml++;
+            }
+            op = LzPutSeq( op, oend, in + anchor, ip - anchor, ip - ref, ml );
+            if( !op ) {
+                return 0;
+            }
+            ip += ml;
+            anchor = ip;
+        } else {
+            ip++;
+        }
+    }
+
+    if( anchor < len ) {
+        op = LzPutSeq( op, oend, in + anchor, len - anchor, 0, 0 );
+        if( !op ) {
+            return 0;
+        }
+    }
+
+    return (size_t)(op - (uint8_t*)dst);
+}
+
+/*
+============
+LzGetLen
+============
+*/
+static libool_t LzGetLen( const uint8_t **ip, const uint8_t *iend,
+        size_t *len ) {
+    uint8_t b;
+
+    if( *len != 15 ) {
+        return litrue;
+    }
+    do {
+        if( *ip >= iend ) {
+            return lifalse;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while( b == 255 );
+
+    return litrue;
+}
+
+/*
+============
+LiLzDecompress
+
+Returns the decompressed length, -1 if the data is
+broken or does not fit into dstLen
+============
+*/
+ssize_t LiLzDecompress( const void *src, size_t len, void *dst,
+        size_t dstLen ) {
+    const uint8_t *ip = (const uint8_t*)src;
+    const uint8_t *iend = ip + len;
+    uint8_t *op = (uint8_t*)dst;
+    uint8_t *oend = op + dstLen;
+    const uint8_t *match;
+    size_t litLen;
+    size_t matchLen;
+    size_t offset;
+
+    liassert( src || !len );
+    liassert( dst );
+
+    while( ip < iend ) {
+        litLen = *ip >> 4;
+        matchLen = *ip & 15;
+        ip++;
+
+        /* literals */
+        if( !LzGetLen( &ip, iend, &litLen ) ||
+                litLen > (size_t)(iend - ip) ||
+                litLen > (size_t)(oend - op) ) {
+            return -1;
+        }
+        memcpy( op, ip, litLen );
+        ip += litLen;
+        op += litLen;
+        if( ip == iend ) {
+            break;
+        }
+
+        /* match */
+        if( iend - ip < 2 ) {
+            return -1;
+        }
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if( !LzGetLen( &ip, iend, &matchLen ) ) {
+            return -1;
+        }
+        matchLen += LZ_MIN_MATCH;
+        if( offset == 0 || offset > (size_t)(op - (uint8_t*)dst) ||
+                matchLen > (size_t)(oend - op) ) {
+            return -1;
+        }
+        /* the match may overlap the output */
+        match = op - offset;
+        while( matchLen-- ) {
+            *op++ = *match++;
+        }
+    }
+
+    return (ssize_t)(op - (uint8_t*)dst);
+}
+
+/*
+============
+ReadFull
+
+Reads until size bytes or the end of the file
+============
+*/
+static ssize_t ReadFull( liZFile_t *z, void *dst, size_t size ) {
+    size_t total = 0;
+    ssize_t n;
+
+    while( total < size ) {
+        n = z->io->read( (uint8_t*)dst + total, size - total, z->f );
+        if( n < 0 ) {
+            return -1;
+        }
+        if( n == 0 ) {
+            break;
+        }
+        total += (size_t)n;
+    }
+
+    return (ssize_t)total;
+}
+
+/*
+============
+LiZipOpen
+============
+*/
+liFile_t LiZipOpen( liIO_t *base, const char *name, char mode,
+        liflag_t flags ) {
+    liZFile_t *z;
+    liFile_t f;
+    uint8_t magic[ZIP_MAGIC_LEN];
+    ssize_t n;
+
+    liverify( mode == 'r' || mode == 'w' );
+
+    if( base == NULL ) {
+        extern liIO_t liDefaultIO;
+        base = &liDefaultIO;
+    }
+#if !defined(LI_ZLIB)
+    if( mode == 'w' && (flags & LI_FGZIP) ) {
+        /* built without zlib */
+        return NULL;
+    }
+#endif
+
+    f = base->open( name, mode );
+    if( f == NULL ) {
+        return NULL;
+    }
+
+    z = (liZFile_t*)LiAlloc( sizeof(liZFile_t), LI_TYID_BUF );
+    z->io = base;
+    z->f = f;
+    z->mode = mode;
+    z->buf = (uint8_t*)LiAlloc( LI_LZ_BLOCK_SIZE, LI_TYID_BUF );
+    z->comp = (uint8_t*)LiAlloc( ZIP_HEADER_LEN + LI_LZ_BLOCK_SIZE,
+            LI_TYID_BUF );
+    z->pos = 0;
+    z->len = 0;
+    z->baseLent = lifalse;
+#if defined(LI_ZLIB)
+    z->finished = lifalse;
+#endif
+
+    if( mode == 'w' ) {
+        z->codec = ZIP_LZ;
+#if defined(LI_ZLIB)
+        if( flags & LI_FGZIP ) {
+            z->codec = ZIP_GZ;
+            memset( &z->zs, 0, sizeof(z->zs) );
+            if( deflateInit2( &z->zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                    15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) {
+                z->codec = ZIP_RAW;
+                LiZipClose( z );
+                return NULL;
+            }
+            return z;
+        }
+#endif
+        if( base->write( ZIP_MAGIC, ZIP_MAGIC_LEN, f ) != ZIP_MAGIC_LEN ) {
+            LiZipClose( z );
+            return NULL;
+        }
+        return z;
+    }
+
+    /* detect the codec */
+    n = ReadFull( z, magic, ZIP_MAGIC_LEN );
+    if( n == ZIP_MAGIC_LEN && memcmp( magic, ZIP_MAGIC, ZIP_MAGIC_LEN ) == 0 ) {
+        z->codec = ZIP_LZ;
+        return z;
+    }
+
+    z->codec = ZIP_RAW;
+    if( n > 0 ) {
+        memcpy( z->buf, magic, (size_t)n );
+        z->len = (size_t)n;
+    }
+#if defined(LI_ZLIB)
+    if( n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b ) {
+        memset( &z->zs, 0, sizeof(z->zs) );
+        if( inflateInit2( &z->zs, 15 + 16 ) == Z_OK ) {
+            z->codec = ZIP_GZ;
+            memcpy( z->comp, magic, (size_t)n );
+            z->zs.next_in = z->comp;
+            z->zs.avail_in = (uInt)n;
+            z->len = 0;
+        }
+    }
+#endif
+
+    return z;
+}
+
+#if defined(LI_ZLIB)
+/*
+============
+GzFinish
+
+Writes the end of the gzip stream
+============
+*/
+static libool_t GzFinish( liZFile_t *z ) {
+    libool_t ok = litrue;
+    uInt have;
+    int r;
+
+    z->finished = litrue;
+    z->zs.next_in = NULL;
+    z->zs.avail_in = 0;
+    do {
+        z->zs.next_out = z->comp;
+        z->zs.avail_out = LI_LZ_BLOCK_SIZE;
+        r = deflate( &z->zs, Z_FINISH );
+        have = LI_LZ_BLOCK_SIZE - z->zs.avail_out;
+        if( have && z->io->write( z->comp, have, z->f ) != (ssize_t)have ) {
+            ok = lifalse;
+        }
+    } while( r == Z_OK );
+    return ok && r == Z_STREAM_END;
+}
+#endif
+
+/*
+============
+LiZipClose
+============
+*/
+void LiZipClose( liFile_t f ) {
+    liZFile_t *z = (liZFile_t*)f;
+
+    liassert( z );
+
+#if defined(LI_ZLIB)
+    if( z->codec == ZIP_GZ ) {
+        if( z->mode == 'w' ) {
+            /* without the final write, errors at this point are lost */
+            if( !z->finished ) {
+                GzFinish( z );
+            }
+            deflateEnd( &z->zs );
+        } else {
+            inflateEnd( &z->zs );
+        }
+    }
+#endif
+
+    z->io->close( z->f );
+    LiDealloc( z->comp );
+    LiDealloc( z->buf );
+    LiDealloc( z );
+}
+
+/*
+============
+FillLz
+
+Reads and decodes the next block. Returns the block
+length, 0 at the end of the file.
+============
+*/
+static ssize_t FillLz( liZFile_t *z ) {
+    uint8_t hdr[ZIP_HEADER_LEN];
+    uint32_t rawLen, compLen;
+    ssize_t n;
+
+    n = ReadFull( z, hdr, ZIP_HEADER_LEN );
+    if( n == 0 ) {
+        return 0;
+    }
+    if( n != ZIP_HEADER_LEN ) {
+        return -1;
+    }
+    rawLen = GetU32( hdr );
+    compLen = GetU32( hdr + 4 );
+    if( rawLen == 0 || rawLen > LI_LZ_BLOCK_SIZE || compLen > rawLen ) {
+        return -1;
+    }
+
+    if( compLen == rawLen ) {
+        /* stored */
+        if( ReadFull( z, z->buf, rawLen ) != (ssize_t)rawLen ) {
+            return -1;
+        }
+    } else {
+        if( ReadFull( z, z->comp, compLen ) != (ssize_t)compLen ||
+                LiLzDecompress( z->comp, compLen, z->buf, rawLen ) !=
+                (ssize_t)rawLen ) {
+            return -1;
+        }
+    }
+    z->pos = 0;
+    z->len = rawLen;
+
+    return (ssize_t)rawLen;
+}
+
+#if defined(LI_ZLIB)
+/*
+============
+ReadGz
+
+Returns -1 if the input ends before the end of the
+gzip stream, a truncated file is not a shorter one
+============
+*/
+static ssize_t ReadGz( liZFile_t *z, uint8_t *dst, size_t size ) {
+    ssize_t n;
+    int r;
+
+    if( z->finished ) {
+        return 0;
+    }
+    z->zs.next_out = dst;
+    z->zs.avail_out = (uInt)size;
+    while( z->zs.avail_out ) {
+        if( z->zs.avail_in == 0 ) {
+            n = z->io->read( z->comp, LI_LZ_BLOCK_SIZE, z->f );
+            if( n < 0 ) {
+                return -1;
+            }
+            if( n == 0 ) {
+                /* the end of the stream is missing */
+                return -1;
+            }
+            z->zs.next_in = z->comp;
+            z->zs.avail_in = (uInt)n;
+        }
+        r = inflate( &z->zs, Z_NO_FLUSH );
+        if( r == Z_STREAM_END ) {
+            z->finished = litrue;
+            break;
+        }
+        if( r != Z_OK && r != Z_BUF_ERROR ) {
+            return -1;
+        }
+    }
+
+    return (ssize_t)(size - z->zs.avail_out);
+}
+#endif
+
+/*
+============
+LiZipRead
+============
+*/
+ssize_t LiZipRead( void *dst, size_t size, liFile_t f ) {
+    liZFile_t *z = (liZFile_t*)f;
+    size_t total = 0;
+    size_t n;
+    ssize_t r;
+
+    liassert( z );
+    liassert( dst );
+    liassert( z->mode == 'r' );
+
+#if defined(LI_ZLIB)
+    if( z->codec == ZIP_GZ ) {
+        return ReadGz( z, (uint8_t*)dst, size );
+    }
+#endif
+
+    while( total < size ) {
+        if( z->pos == z->len ) {
+            if( z->codec == ZIP_RAW ) {
+                /* pass through */
+                r = z->io->read( (uint8_t*)dst + total, size - total, z->f );
+                return r < 0 ? r : (ssize_t)total + r;
+            }
+            r = FillLz( z );
+            if( r < 0 ) {
+                return -1;
+            }
+            if( r == 0 ) {
+                break;
+            }
+        }
+        n = z->len - z->pos;
+        if( n > size - total ) {
+            n = size - total;
+        }
+        memcpy( (uint8_t*)dst + total, z->buf + z->pos, n );
+        z->pos += n;
+        total += n;
+    }
+
+    return (ssize_t)total;
+}
+
+/*
+============
+LiZipAcquire
+
+Lends the decoded block, plain files are lent by the
+base I/O if it can
+============
+*/
+ssize_t LiZipAcquire( const void **data, liFile_t f ) {
+    liZFile_t *z = (liZFile_t*)f;
+    ssize_t r;
+
+    liassert( z );
+    liassert( data );
+    liassert( z->mode == 'r' );
+    liassert( !z->baseLent );
+
+    if( z->pos == z->len ) {
+        switch( z->codec ) {
+            case ZIP_LZ:
+                r = FillLz( z );
+                break;
+#if defined(LI_ZLIB)
+            case ZIP_GZ:
+                r = ReadGz( z, z->buf, LI_LZ_BLOCK_SIZE );
+                break;
+#endif
+            default:
+                if( z->io->acquire && z->io->release ) {
+                    z->baseLent = litrue;
+                    r = z->io->acquire( data, z->f );
+                    if( r <= 0 ) {
+                        z->baseLent = lifalse;
+                    }
+                    return r;
+                }
+                r = z->io->read( z->buf, LI_LZ_BLOCK_SIZE, z->f );
+                break;
+        }
+        if( r <= 0 ) {
+            return r;
+        }
+        z->pos = 0;
+        z->len = (size_t)r;
+    }
+
+    *data = z->buf + z->pos;
+    r = (ssize_t)(z->len - z->pos);
+    z->pos = z->len;
+
+    return r;
+}
+
+/*
+============
+LiZipRelease
+============
+*/
+void LiZipRelease( const void *data, liFile_t f ) {
+    liZFile_t *z = (liZFile_t*)f;
+
+    liassert( z );
+
+    if( z->baseLent ) {
+        z->baseLent = lifalse;
+        z->io->release( data, z->f );
+    }
+}
+
+/*
+============
+LiZipWrite
+
+Every call ends its blocks, callers should write in
+large chunks (the li writer writes whole buffers).
+The final write of size 0 ends the stream and is
+passed on to the base file.
+============
+*/
+ssize_t LiZipWrite( const void *src, size_t size, liFile_t f ) {
+    liZFile_t *z = (liZFile_t*)f;
+    const uint8_t *in = (const uint8_t*)src;
+    size_t left = size;
+    size_t n, c;
+
+    liassert( z );
+    liassert( src );
+    liassert( z->mode == 'w' );
+
+    if( size == 0 ) {
+#if defined(LI_ZLIB)
+        if( z->codec == ZIP_GZ && !z->finished && !GzFinish( z ) ) {
+            return -1;
+        }
+#endif
+        return z->io->write( src, 0, z->f ) < 0 ? -1 : 0;
+    }
+
+#if defined(LI_ZLIB)
+    if( z->codec == ZIP_GZ ) {
+        uInt have;
+
+        z->zs.next_in = (Bytef*)in;
+        z->zs.avail_in = (uInt)size;
+        do {
+            z->zs.next_out = z->comp;
+            z->zs.avail_out = LI_LZ_BLOCK_SIZE;
+            if( deflate( &z->zs, Z_NO_FLUSH ) == Z_STREAM_ERROR ) {
+                return -1;
+            }
+            have = LI_LZ_BLOCK_SIZE - z->zs.avail_out;
+            if( have && z->io->write( z->comp, have, z->f ) !=
+                    (ssize_t)have ) {
+                return -1;
+            }
+        } while( z->zs.avail_out == 0 );
+        return (ssize_t)size;
+    }
+#endif
+
+    while( left ) {
+        n = left < LI_LZ_BLOCK_SIZE ? left : LI_LZ_BLOCK_SIZE;
+        c = LiLzCompress( in, n, z->comp + ZIP_HEADER_LEN, n - 1 );
+        PutU32( z->comp, (uint32_t)n );
+        if( c ) {
+            PutU32( z->comp + 4, (uint32_t)c );
+            c += ZIP_HEADER_LEN;
+            if( z->io->write( z->comp, c, z->f ) != (ssize_t)c ) {
+                return -1;
+            }
+        } else {
+            /* does not compress, store */
+            PutU32( z->comp + 4, (uint32_t)n );
+            if( z->io->write( z->comp, ZIP_HEADER_LEN, z->f ) !=
+                    ZIP_HEADER_LEN ||
+                    z->io->write( in, n, z->f ) != (ssize_t)n ) {
+                return -1;
+            }
+        }
+        in += n;
+        left -= n;
+    }
+
+    return (ssize_t)size;
+}
+
+/*
+============
+LzOpen
+============
+*/
+static liFile_t LzOpen( const char *name, char mode ) {
+    return LiZipOpen( NULL, name, mode, LI_FLZ );
+}
+
+liIO_t liLzIO = {
+    LzOpen,
+    LiZipClose,
+    LiZipRead,
+    LiZipWrite,
+    LiZipAcquire,
+    LiZipRelease
+};
+
+#if defined(LI_ZLIB)
+/*
+============
+GzOpen
+============
+*/
+static liFile_t GzOpen( const char *name, char mode ) {
+    return LiZipOpen( NULL, name, mode, LI_FGZIP );
+}
+
+liIO_t liGzIO = {
+    GzOpen,
+    LiZipClose,
+    LiZipRead,
+    LiZipWrite,
+    LiZipAcquire,
+    LiZipRelease
+};
+#endif
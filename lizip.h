@@ -0,0 +1,34 @@
+#ifndef __LIZIP_H__
+#define __LIZIP_H__
+
+#include "li.h"
+
+#define LI_LZ_BLOCK_SIZE        (64 * 1024)
+
+/*
+Compressed files over a base I/O. Files are written
+with the codec selected by LI_FLZ or LI_FGZIP. Files
+opened for reading detect the codec by magic bytes,
+other files are passed through as they are.
+*/
+liFile_t    LiZipOpen( liIO_t *base, const char *name, char mode,
+                    liflag_t flags );
+void        LiZipClose( liFile_t f );
+ssize_t     LiZipRead( void *dst, size_t size, liFile_t f );
+ssize_t     LiZipWrite( const void *src, size_t size, liFile_t f );
+ssize_t     LiZipAcquire( const void **data, liFile_t f );
+void        LiZipRelease( const void *data, liFile_t f );
+
+size_t      LiLzCompress( const void *src, size_t len, void *dst,
+                    size_t dstLen );
+ssize_t     LiLzDecompress( const void *src, size_t len, void *dst,
+                    size_t dstLen );
+
+/* built-in codec over the default I/O */
+extern liIO_t   liLzIO;
+#if defined(LI_ZLIB)
+/* gzip over the default I/O */
+extern liIO_t   liGzIO;
+#endif
+
+#endif //__LIZIP_H__
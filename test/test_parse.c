@@ -0,0 +1,1480 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "../li.h"
+#include "../liimg.h"
+#include "../lidiff.h"
+#include "../lizip.h"
+#include "../lireload.h"
+#include "../liuring.h"
+#include "../liutil.h"
+
+/*
+================================================
+                li parser tests
+
+Parses text from memory and checks the trees and
+the error messages. Returns 0 when all checks pass.
+================================================
+*/
+
+static int numChecks = 0;
+static int numFailed = 0;
+
+#define CHECK(e) \
+    do { \
+        numChecks++; \
+        if( !(e) ) { \
+            numFailed++; \
+            printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, #e ); \
+        } \
+    } while( 0 )
+
+/*
+============
+Parse
+============
+*/
+static liObj_t *Parse( const char *text, licode_t *code, char *errbuf ) {
+    liObj_t *o = NULL;
+
+    errbuf[0] = 0;
+    *code = LiReadMem( &o, text, strlen( text ), 0, errbuf, 1024 );
+    return o;
+}
+
+/*
+============
+Child
+============
+*/
+static liObj_t *Child( liObj_t *o, const char *key ) {
+    for( ; o; o = o->next ) {
+        if( o->key && LiSCmp( o->key, key ) ) {
+            return o;
+        }
+    }
+    return NULL;
+}
+
+/*
+============
+TestValues
+============
+*/
+static void TestValues( void ) {
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o, *it;
+
+    o = Parse( "a = 1\n"
+               "b = \"text\"\n"
+               "c = { d = true  e = false  f = null }\n"
+               "g = {}\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    CHECK( o != NULL );
+    if( !o ) {
+        return;
+    }
+
+    it = Child( o, "a" );
+    CHECK( it && it->type == LI_VTINT && it->vint == 1 );
+    it = Child( o, "b" );
+    CHECK( it && it->type == LI_VTSTR && LiSCmp( it->vstr, "text" ) );
+    it = Child( o, "c" );
+    CHECK( it && it->type == LI_VTOBJ );
+    if( it ) {
+        CHECK( it->firstChild && it->firstChild->parent == it );
+        CHECK( it->lastChild && LiSCmp( it->lastChild->key, "f" ) );
+        it = it->firstChild;
+        CHECK( it && it->type == LI_VTBOOL && it->vint == litrue );
+        it = Child( it, "e" );
+        CHECK( it && it->type == LI_VTBOOL && it->vint == lifalse );
+        it = Child( it, "f" );
+        CHECK( it && it->type == LI_VTNULL );
+    }
+    it = Child( o, "g" );
+    CHECK( it && it->type == LI_VTOBJ && !it->firstChild );
+
+    LiFree( o );
+}
+
+/*
+============
+TestRuns
+
+The values of one line share the key
+============
+*/
+static void TestRuns( void ) {
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o;
+
+    o = Parse( "k = 1, 2, 3\nk = 4\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    CHECK( o && o->next && o->next->next && o->next->next->next );
+    if( o && o->next && o->next->next && o->next->next->next ) {
+        CHECK( o->key == o->next->key );
+        CHECK( o->next->key == o->next->next->key );
+        CHECK( o->next->next->next->key != o->key );
+        CHECK( o->next->next->vint == 3 );
+    }
+    if( o ) {
+        LiFree( o );
+    }
+
+    /* renaming a node renames its run, a clone keeps the old key */
+    o = Parse( "r = { k = 1, 2, 3  k = 4 }\n", &code, errbuf );
+    CHECK( code == LI_OK && o && o->firstChild );
+    if( o && o->firstChild ) {
+        liObj_t *c = LiClone( o );
+        liObj_t *k = c->firstChild;
+
+        LiSetKey( k->next, "renamed" );
+        CHECK( k->key == k->next->key && k->key == k->next->next->key );
+        CHECK( LiSCmp( k->key, "renamed" ) );
+        CHECK( LiSCmp( k->next->next->next->key, "k" ) );
+        k = o->firstChild;
+        CHECK( LiSCmp( k->key, "k" ) && k->key == k->next->next->key );
+
+        LiSetKey( k, "x" );
+        CHECK( LiSCmp( k->next->next->key, "x" ) );
+        CHECK( LiSCmp( c->firstChild->key, "renamed" ) );
+        LiFree( c );
+        LiFree( o );
+    }
+}
+
+/*
+============
+TestNumbers
+============
+*/
+static void TestNumbers( void ) {
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o, *it;
+
+    o = Parse( "n = 0x1f, 0b101, 017, -5, +7, 18446744073709551615, "
+               "-9223372036854775808\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    it = o;
+    CHECK( it && it->type == LI_VTUINT && it->vuint == 0x1f &&
+            (it->flags & LI_FBASE_MASK) == LI_FHEX );
+    it = it ? it->next : NULL;
+    CHECK( it && it->vuint == 5 && (it->flags & LI_FBASE_MASK) == LI_FBIN );
+    it = it ? it->next : NULL;
+    CHECK( it && it->vuint == 15 && (it->flags & LI_FBASE_MASK) == LI_FOCT );
+    it = it ? it->next : NULL;
+    CHECK( it && it->type == LI_VTINT && it->vint == -5 );
+    it = it ? it->next : NULL;
+    CHECK( it && it->vint == 7 && (it->flags & LI_FSIGN) );
+    it = it ? it->next : NULL;
+    CHECK( it && it->type == LI_VTUINT && it->vuint == UINT64_MAX );
+    it = it ? it->next : NULL;
+    CHECK( it && it->type == LI_VTINT && it->vint == INT64_MIN );
+    if( o ) {
+        LiFree( o );
+    }
+
+    o = Parse( "n = 18446744073709551616\n", &code, errbuf );
+    CHECK( code == LI_EINPDAT && !o );
+    CHECK( strstr( errbuf, "out of range" ) != NULL );
+    o = Parse( "n = 12ab\n", &code, errbuf );
+    CHECK( code == LI_EINPDAT && !o );
+}
+
+/*
+============
+RefToStr
+
+Reference conversion, one digit at a time
+============
+*/
+static void RefToStr( uint64_t val, char *str, int base ) {
+    char tmp[65];
+    int n = 0, i;
+
+    do {
+        tmp[n++] = "0123456789abcdefghijklmnopqrstuvwxyz"[val % base];
+        val /= base;
+    } while( val );
+    for( i = 0; i < n; i++ ) {
+        str[i] = tmp[n - 1 - i];
+    }
+    str[n] = 0;
+}
+
+/*
+============
+CheckNumText
+============
+*/
+static void CheckNumText( uint64_t val ) {
+    static const int bases[] = { 2, 8, 10, 16, 3, 36 };
+    char str[80], ref[80];
+    size_t len, i;
+
+    for( i = 0; i < sizeof(bases) / sizeof(bases[0]); i++ ) {
+        memset( str, '#', sizeof(str) );
+        len = UInt64ToStr( val, str, bases[i] );
+        RefToStr( val, ref, bases[i] );
+        if( strcmp( str, ref ) || len != strlen( ref ) ) {
+            printf( "base %d: \"%s\" instead of \"%s\"\n", bases[i], str, 
+                    ref );
+            CHECK( 0 );
+        }
+    }
+    sprintf( ref, "%llu", (unsigned long long)val );
+    UInt64ToStr( val, str, 10 );
+    CHECK( !strcmp( str, ref ) );
+    sprintf( ref, "%llo", (unsigned long long)val );
+    UInt64ToStr( val, str, 8 );
+    CHECK( !strcmp( str, ref ) );
+    sprintf( ref, "%llx", (unsigned long long)val );
+    UInt64ToStr( val, str, 16 );
+    CHECK( !strcmp( str, ref ) );
+    sprintf( ref, "%lld", (long long)(int64_t)val );
+    len = Int64ToStr( (int64_t)val, str, 10 );
+    CHECK( !strcmp( str, ref ) && len == strlen( ref ) );
+}
+
+/*
+============
+TestNumberText
+
+The number writers against a reference, around every
+digit count and bit length
+============
+*/
+static void TestNumberText( void ) {
+    uint64_t v, x = 1;
+    int i;
+
+    CheckNumText( 0 );
+    CheckNumText( 9 );
+    CheckNumText( 99 );
+    CheckNumText( UINT64_MAX );
+    CheckNumText( (uint64_t)INT64_MAX );
+    CheckNumText( (uint64_t)INT64_MIN );
+    for( v = 10; v; v = v <= UINT64_MAX / 10 ? v * 10 : 0 ) {
+        CheckNumText( v - 1 );
+        CheckNumText( v );
+        CheckNumText( v + 1 );
+    }
+    for( i = 1; i < 64; i++ ) {
+        CheckNumText( ((uint64_t)1 << i) - 1 );
+        CheckNumText( (uint64_t)1 << i );
+    }
+    for( i = 0; i < 1000; i++ ) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        CheckNumText( x >> (i % 64) );
+    }
+}
+
+/*
+============
+TestStrings
+============
+*/
+static void TestStrings( void ) {
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o;
+
+    o = Parse( "s = \"a\\tb\\\\c\\\"d\\n\"\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    CHECK( o && o->type == LI_VTSTR && LiSCmp( o->vstr, "a\tb\\c\"d\n" ) );
+    if( o ) {
+        LiFree( o );
+    }
+
+    o = Parse( "s = \"\"\n", &code, errbuf );
+    CHECK( code == LI_OK && o && slen(o->vstr) == 0 );
+    if( o ) {
+        LiFree( o );
+    }
+}
+
+/*
+============
+TestErrors
+============
+*/
+static void TestErrors( void ) {
+    static const struct {
+        const char  *text;
+        const char  *msg;
+    } cases[] = {
+        { "a 1\n",              "line 1, column 3: '=' expected" },
+        { "a = {\n b = 1\n",    "'}' expected" },
+        { "}\n",                "unexpected '}'" },
+        { "a = foo\n",          "unknown value" },
+        { "a = \n",             "line 2, column 1: value expected" },
+        { "a = 1\n  b = 2 c d\n", "line 2, column 11: '=' expected" },
+        { "= 1\n",              "key expected" },
+        { "a = \"open\n",       NULL },
+    };
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o;
+    size_t i;
+
+    for( i = 0; i < sizeof(cases) / sizeof(cases[0]); i++ ) {
+        o = Parse( cases[i].text, &code, errbuf );
+        CHECK( code == LI_EINPDAT );
+        CHECK( o == NULL );
+        if( cases[i].msg && !strstr( errbuf, cases[i].msg ) ) {
+            printf( "case %d: \"%s\" instead of \"%s\"\n", (int)i, errbuf,
+                    cases[i].msg );
+            CHECK( 0 );
+        }
+    }
+}
+
+/*
+============
+ListEqual
+============
+*/
+static libool_t ListEqual( liObj_t *a, liObj_t *b ) {
+    for( ; a && b; a = a->next, b = b->next ) {
+        if( !LiEqual( a, b ) ) {
+            return lifalse;
+        }
+    }
+    return a == b;
+}
+
+/*
+============
+chunked input
+
+Reads or lends the text in pieces of a few bytes, so
+tokens are cut at the end of every piece
+============
+*/
+typedef struct {
+    const char  *data;
+    size_t      len;
+    size_t      pos;
+    size_t      chunk;
+} liChunkIn_t;
+
+static liFile_t ChunkOpen( const char *name, char mode ) {
+    liChunkIn_t *c = (liChunkIn_t*)name;
+    if( mode != 'r' ) {
+        return NULL;
+    }
+    c->pos = 0;
+    return (liFile_t)c;
+}
+
+static void ChunkClose( liFile_t f ) {
+}
+
+static ssize_t ChunkRead( void *data, size_t size, liFile_t f ) {
+    liChunkIn_t *c = (liChunkIn_t*)f;
+    if( size > c->chunk ) {
+        size = c->chunk;
+    }
+    if( size > c->len - c->pos ) {
+        size = c->len - c->pos;
+    }
+    memcpy( data, c->data + c->pos, size );
+    c->pos += size;
+    return (ssize_t)size;
+}
+
+static ssize_t ChunkAcquire( const void **data, liFile_t f ) {
+    liChunkIn_t *c = (liChunkIn_t*)f;
+    size_t size = c->len - c->pos;
+    if( size > c->chunk ) {
+        size = c->chunk;
+    }
+    *data = c->data + c->pos;
+    c->pos += size;
+    return (ssize_t)size;
+}
+
+static void ChunkRelease( const void *data, liFile_t f ) {
+}
+
+static liIO_t chunkReadIO = { ChunkOpen, ChunkClose, ChunkRead, NULL, 
+    NULL, NULL };
+static liIO_t chunkLendIO = { ChunkOpen, ChunkClose, ChunkRead, NULL, 
+    ChunkAcquire, ChunkRelease };
+
+/*
+============
+TestLong
+
+Tokens cut by the end of the input pieces, read and lent
+============
+*/
+static void TestLong( void ) {
+    static const size_t chunks[] = { 1, 7, 4093 };
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o, *r, *it;
+    liChunkIn_t in;
+    char *text = (char*)malloc( 64 * 1024 );
+    size_t n = 0;
+    int i, num;
+
+    for( i = 0; i < 1000; i++ ) {
+        n += (size_t)sprintf( text + n, "key_%d = %d, \"s%d\"\n", i, i, i );
+    }
+    n += (size_t)sprintf( text + n, "long = \"" );
+    memset( text + n, 'x', 5000 );
+    n += 5000;
+    n += (size_t)sprintf( text + n, "\"\n" );
+
+    o = Parse( text, &code, errbuf );
+    CHECK( code == LI_OK );
+    for( num = 0, it = o; it && it->next; it = it->next ) {
+        num++;
+    }
+    CHECK( num == 2000 );
+    CHECK( it && LiSCmp( it->key, "long" ) && slen(it->vstr) == 5000 );
+    it = Child( o, "key_777" );
+    CHECK( it && it->vint == 777 && it->next &&
+            LiSCmp( it->next->vstr, "s777" ) );
+
+    in.data = text;
+    in.len = n;
+    for( i = 0; i < 6; i++ ) {
+        in.chunk = chunks[i / 2];
+        r = NULL;
+        code = LiReadEx( i & 1 ? &chunkLendIO : &chunkReadIO, &r, 
+                (const char*)&in, 0, errbuf, sizeof(errbuf) );
+        CHECK( code == LI_OK && in.pos == n );
+        CHECK( r && ListEqual( o, r ) );
+        if( r ) {
+            LiFree( r );
+        }
+    }
+
+    /* the position of an error is counted across the pieces */
+    in.data = "a = 1\n  b = 2 c d\n";
+    in.len = strlen( in.data );
+    in.chunk = 1;
+    r = NULL;
+    code = LiReadEx( &chunkLendIO, &r, (const char*)&in, 0, errbuf, 
+            sizeof(errbuf) );
+    CHECK( code == LI_EINPDAT && !r );
+    CHECK( strstr( errbuf, "line 2, column 11: '=' expected" ) != NULL );
+    if( o ) {
+        LiFree( o );
+    }
+    free( text );
+}
+
+/*
+============
+TestFind
+
+Keys have to match the whole pattern element, a
+key that is only a prefix of it does not
+============
+*/
+static void TestFind( void ) {
+    char errbuf[1024];
+    licode_t code;
+    liFindData_t fd;
+    liObj_t *o;
+    int num;
+
+    o = Parse( "a = 1\n"
+               "abc = { b = 2  bb = 3 }\n"
+               "ab = { b = 4 }\n", &code, errbuf );
+    CHECK( code == LI_OK && o );
+    if( !o ) {
+        return;
+    }
+
+    code = LiFindFirst( &fd, o, "ab" );
+    CHECK( code == LI_OK && fd.obj && LiSCmp( fd.obj->key, "ab" ) );
+    CHECK( LiFindNext( &fd ) == LI_FINISHED );
+    LiFindClose( &fd );
+
+    num = 0;
+    for( code = LiFindFirst( &fd, o, "abc.bbb" ); code == LI_OK;
+            code = LiFindNext( &fd ) ) {
+        num++;
+    }
+    CHECK( num == 0 );
+    LiFindClose( &fd );
+
+    code = LiFindFirst( &fd, o, "ab.b" );
+    CHECK( code == LI_OK && fd.obj && fd.obj->vint == 4 );
+    LiFindClose( &fd );
+
+    LiFree( o );
+}
+
+/*
+============
+memory output
+
+The file name passed to open is the liMemOut_t itself,
+opened for reading it gives back what was written
+============
+*/
+typedef struct {
+    char        buf[4096];
+    size_t      len;
+    size_t      pos;
+} liMemOut_t;
+
+static liFile_t OutOpen( const char *name, char mode ) {
+    liMemOut_t *m = (liMemOut_t*)name;
+    if( mode == 'w' ) {
+        m->len = 0;
+    }
+    m->pos = 0;
+    return (liFile_t)m;
+}
+
+static void OutClose( liFile_t f ) {
+}
+
+static ssize_t OutWrite( const void *data, size_t size, liFile_t f ) {
+    liMemOut_t *m = (liMemOut_t*)f;
+    if( size > sizeof(m->buf) - m->len ) {
+        return -1;
+    }
+    memcpy( m->buf + m->len, data, size );
+    m->len += size;
+    return (ssize_t)size;
+}
+
+static ssize_t OutRead( void *data, size_t size, liFile_t f ) {
+    liMemOut_t *m = (liMemOut_t*)f;
+    if( size > m->len - m->pos ) {
+        size = m->len - m->pos;
+    }
+    memcpy( data, m->buf + m->pos, size );
+    m->pos += size;
+    return (ssize_t)size;
+}
+
+static liIO_t memOutIO = { OutOpen, OutClose, OutRead, OutWrite, NULL, NULL };
+
+/*
+============
+TestRoundTrip
+
+Strings with quotes, backslashes and control characters
+are written with escapes and read back unchanged
+============
+*/
+static void TestRoundTrip( void ) {
+    static const char str[] = "q\"b\\n\n\t\r\x01\x1f\x7f\0e\\";
+    static const liflag_t flags[] = { 0, LI_FMINIFY };
+    liMemOut_t m;
+    liWriter_t *w;
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o, *r;
+    size_t i;
+
+    o = LiStrL( str, sizeof(str) - 1 );
+    LiSetKey( o, "s" );
+    LiInsertAfter( o, LiStrL( "", 0 ) );
+    LiSetKey( o->next, "e" );
+
+    for( i = 0; i < sizeof(flags) / sizeof(flags[0]); i++ ) {
+        code = LiWriteEx( &memOutIO, o, (const char*)&m, flags[i] );
+        CHECK( code == LI_OK );
+        r = NULL;
+        code = LiReadMem( &r, m.buf, m.len, 0, errbuf, sizeof(errbuf) );
+        CHECK( code == LI_OK );
+        CHECK( r && LiSCmpL( r->vstr, str, sizeof(str) - 1 ) &&
+                slen(r->vstr) == sizeof(str) - 1 );
+        CHECK( r && r->next && slen(r->next->vstr) == 0 );
+        if( r ) {
+            LiFree( r );
+        }
+    }
+
+    code = LiWriterOpen( &w, &memOutIO, (const char*)&m );
+    CHECK( code == LI_OK );
+    LiWriterString( w, "s", str, sizeof(str) - 1 );
+    code = LiWriterClose( w );
+    CHECK( code == LI_OK );
+    r = NULL;
+    code = LiReadMem( &r, m.buf, m.len, 0, errbuf, sizeof(errbuf) );
+    CHECK( code == LI_OK );
+    CHECK( r && LiSCmpL( r->vstr, str, sizeof(str) - 1 ) &&
+            slen(r->vstr) == sizeof(str) - 1 );
+    if( r ) {
+        LiFree( r );
+    }
+
+    LiFree( o );
+}
+
+static int numAllocs = 0;
+static size_t maxAlloc = 0;
+
+static void *CountAlloc( size_t size, lityid_t type ) {
+    numAllocs++;
+    if( size > maxAlloc ) {
+        maxAlloc = size;
+    }
+    return malloc( size );
+}
+
+static void *CountRealloc( void *ptr, size_t size, lityid_t type ) {
+    if( size > maxAlloc ) {
+        maxAlloc = size;
+    }
+    return realloc( ptr, size );
+}
+
+static void CountFree( void *ptr ) {
+    free( ptr );
+}
+
+/*
+============
+TestContext
+
+Nested context sections restore the allocator of the
+enclosing section
+============
+*/
+static void TestContext( void ) {
+    liAlloc_t countAlc = { CountAlloc, CountRealloc, CountFree };
+    liAlloc_t *outer = LiGetAllocator();
+    liContext_t a, b;
+    liAlloc_t *prevA, *prevB;
+    liObj_t *o;
+
+    LiContextInit( &a, &countAlc, NULL );
+    LiContextInit( &b, NULL, NULL );
+
+    prevA = LiContextEnter( &a );
+    CHECK( LiGetAllocator() == &countAlc );
+    prevB = LiContextEnter( &b );
+    CHECK( LiGetAllocator() == outer );
+    LiContextLeave( &b, prevB );
+    CHECK( LiGetAllocator() == &countAlc );
+    o = LiStr( "counted" );
+    CHECK( numAllocs > 0 );
+    LiFree( o );
+    LiContextLeave( &a, prevA );
+    CHECK( LiGetAllocator() == outer );
+
+    numAllocs = 0;
+    o = LiStrCtx( &a, "counted" );
+    CHECK( numAllocs > 0 );
+    LiFreeCtx( &a, o );
+    CHECK( LiGetAllocator() == outer );
+}
+
+/*
+============
+ReadForged
+
+Reads the bytes as a binary file and returns the
+largest allocation made while reading
+============
+*/
+static size_t ReadForged( const char *data, size_t len, licode_t *code ) {
+    liAlloc_t countAlc = { CountAlloc, CountRealloc, CountFree };
+    liContext_t ctx;
+    liAlloc_t *prev;
+    liMemOut_t m;
+    liObj_t *o = NULL;
+
+    memcpy( m.buf, data, len );
+    m.len = len;
+    LiContextInit( &ctx, &countAlc, NULL );
+    maxAlloc = 0;
+    prev = LiContextEnter( &ctx );
+    *code = LiReadBinary( &memOutIO, &o, (const char*)&m, 0 );
+    if( o ) {
+        LiFree( o );
+    }
+    LiContextLeave( &ctx, prev );
+    return maxAlloc;
+}
+
+/*
+============
+TestBinary
+
+Lengths and key counts beyond the end of the input
+fail without allocating for them
+============
+*/
+static void TestBinary( void ) {
+    /* 2^28 - 1 keys, none follow */
+    static const char manyKeys[] = "LIB\1\xff\xff\xff\x7f";
+    /* one key of 2^31 bytes, two follow */
+    static const char longKey[] = "LIB\1\x01\x80\x80\x80\x80\x08" "ab";
+    /* a string value of 2^31 bytes, two follow */
+    static const char longStr[] = "LIB\1\x00\x04\x80\x80\x80\x80\x08" "ab";
+    /* the input buffer of the reader and a few nodes */
+    const size_t LIMIT = 1024 * 1024;
+    char errbuf[1024];
+    liMemOut_t m;
+    licode_t code;
+    liObj_t *o, *r;
+
+    CHECK( ReadForged( manyKeys, sizeof(manyKeys) - 1, &code ) < LIMIT );
+    CHECK( code == LI_EINPDAT );
+    CHECK( ReadForged( longKey, sizeof(longKey) - 1, &code ) < LIMIT );
+    CHECK( code == LI_EINPDAT );
+    CHECK( ReadForged( longStr, sizeof(longStr) - 1, &code ) < LIMIT );
+    CHECK( code == LI_EINPDAT );
+
+    o = Parse( "a = 1\nb = \"text\"\nc = { d = -2 }\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    code = LiWriteBinary( &memOutIO, o, (const char*)&m, 0 );
+    CHECK( code == LI_OK );
+    r = NULL;
+    code = LiReadBinary( &memOutIO, &r, (const char*)&m, 0 );
+    CHECK( code == LI_OK );
+    CHECK( r && LiEqual( o, r ) && LiEqual( o->next, r->next ) &&
+            LiEqual( o->next->next, r->next->next ) );
+    if( r ) {
+        LiFree( r );
+    }
+    LiFree( o );
+}
+
+/*
+============
+TestImage
+
+Images whose links loop are refused on open. The
+test knows the layout: a 32-byte header followed by
+40-byte nodes that start with the parent, next and
+prev links.
+============
+*/
+static void TestImage( void ) {
+    static uint64_t data[4096 / sizeof(uint64_t)];
+    char errbuf[1024];
+    liViewFindData_t vfd;
+    liImage_t *img;
+    liMemOut_t m;
+    licode_t code;
+    liObj_t *o;
+    uint32_t link;
+    int num = 0;
+
+    o = Parse( "a = { b = 1  b = 2 }\nc = 3\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    code = LiImageWrite( &memOutIO, o, (const char*)&m );
+    CHECK( code == LI_OK );
+    LiFree( o );
+
+    memcpy( data, m.buf, m.len );
+    CHECK( LiImageFromMem( &img, data, m.len ) == LI_OK );
+    for( code = LiViewFindFirst( &vfd, LiImageRoot( img ), "a.b" );
+            code == LI_OK; code = LiViewFindNext( &vfd ) ) {
+        num++;
+    }
+    CHECK( num == 2 );
+    LiImageClose( img );
+
+    /* the last b links back to the first as its next */
+    link = 2;
+    memcpy( (char*)data + 32 + 40 * 2 + 4, &link, sizeof(link) );
+    CHECK( LiImageFromMem( &img, data, m.len ) == LI_EINPDAT );
+
+    /* the second b is its own parent */
+    memcpy( data, m.buf, m.len );
+    link = 3;
+    memcpy( (char*)data + 32 + 40 * 2, &link, sizeof(link) );
+    CHECK( LiImageFromMem( &img, data, m.len ) == LI_EINPDAT );
+
+    /* c names a as its parent but is its next sibling */
+    memcpy( data, m.buf, m.len );
+    link = 1;
+    memcpy( (char*)data + 32 + 40 * 3, &link, sizeof(link) );
+    CHECK( LiImageFromMem( &img, data, m.len ) == LI_EINPDAT );
+
+    /* an image that starts in the middle of a run writes its key */
+    o = Parse( "k = 1, 2, 3\n", &code, errbuf );
+    CHECK( code == LI_OK && o && o->next );
+    code = LiImageWrite( &memOutIO, o->next, (const char*)&m );
+    CHECK( code == LI_OK );
+    LiFree( o );
+    memcpy( data, m.buf, m.len );
+    code = LiImageFromMem( &img, data, m.len );
+    CHECK( code == LI_OK );
+    if( code == LI_OK ) {
+        liView_t v = LiImageRoot( img );
+        lisize_t len = 0;
+        const char *key = LiViewKey( v, &len );
+        CHECK( key && len == 1 && key[0] == 'k' && LiViewInt( v ) == 2 );
+        v = LiViewNext( v );
+        key = LiViewKey( v, &len );
+        CHECK( key && len == 1 && key[0] == 'k' && LiViewInt( v ) == 3 );
+        CHECK( LiViewIsNull( LiViewNext( v ) ) );
+        LiImageClose( img );
+    }
+}
+
+/*
+============
+TestStats
+
+Every block of a tree parsed with the statistics
+allocator is given back to it, keys and string values
+are counted apart
+============
+*/
+static void TestStats( void ) {
+    liContext_t ctx;
+    liMemStats_t st;
+    liAlloc_t *prev;
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o;
+
+    LiContextInit( &ctx, LiMemStatsAllocator( NULL ), NULL );
+    LiMemStatsReset();
+    prev = LiContextEnter( &ctx );
+    o = Parse( "a = { b = \"text\"  c = 1, 2, 3 }\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    LiMemStats( &st );
+    CHECK( st.total.live > 0 && st.total.allocs > 0 );
+    CHECK( st.types[LI_TYID_KEY].live > 0 && st.types[LI_TYID_STR].live > 0 );
+    LiSetKey( o->firstChild, "renamed" );
+    LiFree( o );
+    LiMemStats( &st );
+    CHECK( st.total.live == 0 );
+
+    /* keys are not counted as string values */
+    o = Parse( "a = 1\nb = { c = 2 }\n", &code, errbuf );
+    CHECK( code == LI_OK );
+    LiMemStats( &st );
+    CHECK( st.types[LI_TYID_KEY].live > 0 && st.types[LI_TYID_STR].live == 0 );
+    LiFree( o );
+    LiContextLeave( &ctx, prev );
+    LiMemStats( &st );
+    CHECK( st.total.live == 0 && st.total.frees > 0 );
+}
+
+/*
+============
+TestHash
+
+A value changed in place gives another hash once
+LiHashInvalidate is called, the API setters invalidate
+on their own
+============
+*/
+static void TestHash( void ) {
+    static const char *text = 
+        "a = { b = 1  c = { d = \"x\" } }\n"
+        "e = 2\n";
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o, *r, *b, *d;
+    liStr_t *s;
+    uint64_t h, hd;
+
+    o = Parse( text, &code, errbuf );
+    CHECK( code == LI_OK );
+    r = Parse( text, &code, errbuf );
+    CHECK( code == LI_OK );
+    if( !o || !r ) {
+        return;
+    }
+    h = LiHash( o );
+    CHECK( h == LiHash( r ) && LiEqual( o, r ) );
+    b = o->firstChild;
+    d = b->next->firstChild;
+    hd = LiHash( d );
+
+    /* a string value three levels down */
+    s = d->vstr;
+    d->vstr = LiSNew( "y" );
+    LiHashInvalidate( d );
+    CHECK( LiHash( d ) != hd && LiHash( o ) != h );
+    CHECK( !LiEqual( o, r ) );
+    LiSFree( d->vstr );
+    d->vstr = s;
+    LiHashInvalidate( d );
+    CHECK( LiHash( d ) == hd && LiHash( o ) == h && LiEqual( o, r ) );
+
+    /* an integer, the parent was hashed last */
+    b->vint = 5;
+    LiHashInvalidate( b );
+    CHECK( LiHash( o ) != h && !LiEqual( o, r ) );
+    CHECK( LiHash( d ) == hd );
+    b->vint = 1;
+    LiHashInvalidate( b );
+    CHECK( LiHash( o ) == h && LiEqual( o, r ) );
+
+    /* the setters */
+    LiSetKey( b, "bb" );
+    CHECK( LiHash( o ) != h && !LiEqual( o, r ) );
+    LiSetKey( b, "b" );
+    CHECK( LiHash( o ) == h && LiEqual( o, r ) );
+    LiFree( LiExtract( d ) );
+    CHECK( LiHash( o ) != h && !LiEqual( o, r ) );
+
+    LiFree( o );
+    LiFree( r );
+}
+
+/*
+============
+KeyStrLive
+============
+*/
+static size_t KeyStrLive( void ) {
+    liMemStats_t st;
+
+    LiMemStats( &st );
+    return st.types[LI_TYID_KEY].live + st.types[LI_TYID_STR].live;
+}
+
+/*
+============
+TestDedup
+
+LiDedup returns the bytes it frees, a tree read with
+LI_FDEDUP and a deduplicated tree stay equal to the
+original
+============
+*/
+static void TestDedup( void ) {
+    liContext_t ctx;
+    liAlloc_t *prev;
+    char *text = (char*)malloc( 64 * 1024 );
+    liObj_t *o = NULL, *r = NULL, *p = NULL;
+    size_t n = 0, live, plain, saved;
+    int i;
+
+    for( i = 0; i < 200; i++ ) {
+        n += (size_t)sprintf( text + n, 
+                "item = { name = \"n%d\"  kind = \"common\"  "
+                "pos = { x = %d  y = 0 } }\n", i % 10, i % 3 );
+    }
+
+    LiContextInit( &ctx, LiMemStatsAllocator( NULL ), NULL );
+    LiMemStatsReset();
+    prev = LiContextEnter( &ctx );
+
+    CHECK( LiReadMem( &o, text, n, 0, NULL, 0 ) == LI_OK );
+    plain = KeyStrLive();
+    CHECK( LiReadMem( &r, text, n, 0, NULL, 0 ) == LI_OK );
+    if( o && r ) {
+        live = KeyStrLive();
+        CHECK( live == plain * 2 );
+        saved = LiDedup( o );
+        CHECK( saved > 0 && KeyStrLive() == live - saved );
+        CHECK( ListEqual( o, r ) );
+        /* nothing is left to share */
+        CHECK( LiDedup( o ) == 0 && ListEqual( o, r ) );
+        LiFree( r );
+        r = NULL;
+
+        live = KeyStrLive();
+        CHECK( LiReadMem( &p, text, n, LI_FDEDUP, NULL, 0 ) == LI_OK );
+        CHECK( p && ListEqual( o, p ) );
+        CHECK( KeyStrLive() - live < plain );
+        if( p ) {
+            saved = KeyStrLive();
+            CHECK( LiDedup( p ) == saved - KeyStrLive() );
+            CHECK( ListEqual( o, p ) );
+            LiFree( p );
+        }
+    }
+    if( o ) {
+        LiFree( o );
+    }
+    if( r ) {
+        LiFree( r );
+    }
+    LiContextLeave( &ctx, prev );
+    CHECK( KeyStrLive() == 0 );
+    free( text );
+}
+
+/*
+============
+CheckPatch
+
+Diffs the texts, patches a copy of a and compares it
+with b
+============
+*/
+static void CheckPatch( const char *textA, const char *textB ) {
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *a, *b, *script;
+
+    a = Parse( textA, &code, errbuf );
+    CHECK( code == LI_OK );
+    b = Parse( textB, &code, errbuf );
+    CHECK( code == LI_OK );
+
+    script = LiDiff( a, b );
+    CHECK( (script == NULL) == ListEqual( a, b ) );
+    code = LiPatch( &a, script );
+    CHECK( code == LI_OK );
+    CHECK( ListEqual( a, b ) );
+    if( code != LI_OK || !ListEqual( a, b ) ) {
+        printf( "patch of \"%.40s\" to \"%.40s\" failed\n", textA, textB );
+    }
+
+    if( script ) {
+        LiFree( script );
+    }
+    if( a ) {
+        LiFree( a );
+    }
+    if( b ) {
+        LiFree( b );
+    }
+}
+
+/*
+============
+TestDiff
+============
+*/
+static void TestDiff( void ) {
+    const int num = 20000;
+    char *textA, *textB;
+    size_t lenA = 0, lenB = 0;
+    int i;
+
+    CheckPatch( "a = 1\nb = 2\n", "a = 1\nb = 2\n" );
+    CheckPatch( "", "a = 1\nb = { c = 2 }\n" );
+    CheckPatch( "a = 1\nb = { c = 2 }\n", "" );
+    /* runs */
+    CheckPatch( "k = 1, 2\n", "k = 1\nj = 2\n" );
+    CheckPatch( "k = 1, 2, 3\n", "k = 1\nj = 2\nk = 3\n" );
+    CheckPatch( "k = 1, 2, 3\n", "k = 3, 1, 2\n" );
+    CheckPatch( "k = 1, 2, 3\n", "k = 1, 4, 2, 3, 5\n" );
+    CheckPatch( "k = 1, 2, 3\nj = 4\n", "k = 1\nj = 4\n" );
+    /* nested objects */
+    CheckPatch( "a = { x = 1  y = { z = 2 } }\nb = 3\n",
+            "a = { x = 1  y = { z = 4  w = 5 } }\nb = 3\n" );
+    CheckPatch( "a = { x = { y = { z = 1 } } }\n",
+            "a = { x = { y = 1 } }\n" );
+    /* reorders, inserts, deletes and rekeys */
+    CheckPatch( "a = 1\nb = 2\nc = 3\n", "c = 3\na = 1\nb = 2\n" );
+    CheckPatch( "a = 1\nb = 2\nc = 3\n", "b = 2\nd = 4\nc = 3\n" );
+    CheckPatch( "a = 1\nb = 2\n", "a = 1\nc = 2\n" );
+    CheckPatch( "a = { x = 1 }\nb = \"s\"\n",
+            "b = \"t\"\nc = { x = 1 }\nd = null\n" );
+
+    /* long runs are paired in linear time */
+    textA = (char*)malloc( (size_t)num * 24 );
+    textB = (char*)malloc( (size_t)num * 24 );
+    lenA += (size_t)sprintf( textA, "k = 0" );
+    lenB += (size_t)sprintf( textB, "k = %d", num );
+    for( i = 1; i <= num; i++ ) {
+        lenA += (size_t)sprintf( textA + lenA, ", %d", i );
+        lenB += (size_t)sprintf( textB + lenB, ", %d", num + i );
+    }
+    sprintf( textA + lenA, "\n" );
+    sprintf( textB + lenB, "\n" );
+    CheckPatch( textA, textB );
+    free( textB );
+    free( textA );
+}
+
+/*
+============
+TestDeepClone
+
+A deep clone equals its source, shares nothing with it
+and frees its whole block with the root
+============
+*/
+static void TestDeepClone( void ) {
+    liContext_t ctx;
+    liMemStats_t st, end;
+    liAlloc_t *prev;
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *o, *c, *it;
+
+    LiContextInit( &ctx, LiMemStatsAllocator( NULL ), NULL );
+    prev = LiContextEnter( &ctx );
+    o = Parse( "a = { k = 1, 2, 3  s = \"text\"  n = { x = -1  y = null } }\n"
+            "b = \"top\"\n", &code, errbuf );
+    CHECK( code == LI_OK && o );
+
+    LiMemStats( &st );
+    c = LiDeepClone( o );
+    CHECK( LiEqual( c, o ) );
+    CHECK( !c->next && !c->parent );
+    CHECK( c->key != o->key && c->firstChild->vint == 1 );
+    /* the run keeps one key */
+    it = c->firstChild;
+    CHECK( it->key == it->next->key && it->key == it->next->next->key );
+    CHECK( it->next->next->next->vstr != o->firstChild->next->next->next->vstr );
+    /* values of the clone change alone */
+    it->vint = 5;
+    LiHashInvalidate( it );
+    CHECK( !LiEqual( c, o ) && o->firstChild->vint == 1 );
+    LiFree( c );
+
+    c = LiDeepClone( o->firstChild->next->next->next->next );
+    CHECK( LiEqual( c, o->firstChild->next->next->next->next ) );
+    LiFree( c );
+    LiMemStats( &end );
+    CHECK( end.total.live == st.total.live );
+
+    LiFree( o );
+    LiContextLeave( &ctx, prev );
+}
+
+/*
+============
+CheckZipFile
+
+Writes the tree with the codec flag, reads it back and
+reads it again without its last 4 bytes, which hold
+all of the text for gzip (only the trailer is cut)
+============
+*/
+static void CheckZipFile( liObj_t *o, liflag_t flags ) {
+    char path[] = "/tmp/li_test_XXXXXX";
+    liObj_t *r = NULL;
+    licode_t code;
+    FILE *fp;
+    long size;
+    int fd;
+
+    fd = mkstemp( path );
+    CHECK( fd >= 0 );
+    if( fd < 0 ) {
+        return;
+    }
+    close( fd );
+
+    code = LiWriteEx( NULL, o, path, flags );
+    CHECK( code == LI_OK );
+    code = LiRead( &r, path );
+    CHECK( code == LI_OK );
+    CHECK( r && ListEqual( o, r ) );
+    if( r ) {
+        LiFree( r );
+    }
+
+    fp = fopen( path, "rb" );
+    fseek( fp, 0, SEEK_END );
+    size = ftell( fp );
+    fclose( fp );
+    CHECK( size > 64 && truncate( path, size - 4 ) == 0 );
+    r = NULL;
+    code = LiRead( &r, path );
+    CHECK( code != LI_OK );
+    if( r ) {
+        LiFree( r );
+    }
+    remove( path );
+}
+
+/*
+============
+TestZip
+============
+*/
+static void TestZip( void ) {
+    static uint8_t src[3 * LI_LZ_BLOCK_SIZE], comp[3 * LI_LZ_BLOCK_SIZE];
+    static uint8_t dst[3 * LI_LZ_BLOCK_SIZE];
+    liObj_t *o = NULL;
+    char *text;
+    size_t len = 0, c;
+    uint32_t x = 1;
+    int i;
+
+    /* compressible and random blocks */
+    for( i = 0; i < LI_LZ_BLOCK_SIZE; i++ ) {
+        src[i] = (uint8_t)"section = { value = 1 }\n"[i % 24];
+    }
+    c = LiLzCompress( src, LI_LZ_BLOCK_SIZE, comp, LI_LZ_BLOCK_SIZE - 1 );
+    CHECK( c > 0 && c < LI_LZ_BLOCK_SIZE / 4 );
+    CHECK( LiLzDecompress( comp, c, dst, LI_LZ_BLOCK_SIZE ) ==
+            LI_LZ_BLOCK_SIZE && !memcmp( src, dst, LI_LZ_BLOCK_SIZE ) );
+    CHECK( LiLzDecompress( comp, c - 1, dst, LI_LZ_BLOCK_SIZE ) !=
+            LI_LZ_BLOCK_SIZE );
+    for( i = 0; i < LI_LZ_BLOCK_SIZE; i++ ) {
+        x = x * 1103515245 + 12345;
+        src[i] = (uint8_t)(x >> 16);
+    }
+    c = LiLzCompress( src, LI_LZ_BLOCK_SIZE, comp, LI_LZ_BLOCK_SIZE - 1 );
+    CHECK( c == 0 || (LiLzDecompress( comp, c, dst, LI_LZ_BLOCK_SIZE ) ==
+            LI_LZ_BLOCK_SIZE && !memcmp( src, dst, LI_LZ_BLOCK_SIZE )) );
+
+    /* files of several blocks */
+    text = (char*)malloc( 4000 * 64 );
+    for( i = 0; i < 4000; i++ ) {
+        len += (size_t)sprintf( text + len,
+                "item = { id = %d  name = \"n%d\"  v = 1, 2 }\n", i, i % 7 );
+    }
+    CHECK( LiReadMem( &o, text, len, 0, NULL, 0 ) == LI_OK );
+    free( text );
+    if( !o ) {
+        return;
+    }
+    CheckZipFile( o, LI_FLZ );
+#if defined(LI_ZLIB)
+    CheckZipFile( o, LI_FGZIP );
+#endif
+    LiFree( o );
+}
+
+/*
+============
+WriteText
+============
+*/
+static void WriteText( const char *path, const char *text ) {
+    FILE *fp = fopen( path, "wb" );
+
+    CHECK( fp != NULL );
+    if( fp ) {
+        fputs( text, fp );
+        fclose( fp );
+    }
+}
+
+/*
+============
+CheckReload
+
+Checks the reloaded tree against a full parse of the text
+============
+*/
+static void CheckReload( liObj_t *root, const char *text ) {
+    liObj_t *o = NULL;
+
+    CHECK( LiReadMem( &o, text, strlen( text ), 0, NULL, 0 ) == LI_OK );
+    CHECK( o && ListEqual( root, o ) );
+    if( o ) {
+        LiFree( o );
+    }
+}
+
+/*
+============
+TestReload
+
+Only the edited section is parsed again, the other
+sections keep their nodes and a broken file keeps the
+old tree
+============
+*/
+static void TestReload( void ) {
+    static const char *text1 =
+        "a = 1, 2\n"
+        "b = { x = \"}\"  y = { z = \"{\" } }\n"
+        "c = 3\n"
+        "d = \"}\", \"\\\"}\"\n";
+    static const char *text2 =
+        "a = 1, 2\n"
+        "b = { x = \"}\"  y = { z = \"{\" } }\n"
+        "c = 4\n"
+        "d = \"}\", \"\\\"}\"\n";
+    static const char *text3 =
+        "a = 1, 2\n"
+        "b = { x = \"}}\"  y = { z = \"{\" } }\n"
+        "c = 4\n"
+        "d = \"}\", \"\\\"}\"\n";
+    char path[] = "/tmp/li_test_XXXXXX";
+    char errbuf[1024];
+    liObj_t *nodes[6], *root, *c, *o;
+    liReload_t *rl;
+    lisize_t num;
+    licode_t code;
+    int fd, i;
+
+    fd = mkstemp( path );
+    CHECK( fd >= 0 );
+    if( fd < 0 ) {
+        return;
+    }
+    close( fd );
+
+    WriteText( path, text1 );
+    code = LiReloadOpen( &rl, NULL, path, &root, errbuf, sizeof(errbuf) );
+    CHECK( code == LI_OK );
+    if( code != LI_OK ) {
+        remove( path );
+        return;
+    }
+    CheckReload( root, text1 );
+    for( i = 0, o = root; i < 6 && o; i++, o = o->next ) {
+        nodes[i] = o;
+    }
+    CHECK( i == 6 && !o );
+
+    /* not changed */
+    code = LiReloadCheck( rl, &root, &num, errbuf, sizeof(errbuf) );
+    CHECK( code == LI_OK && num == 0 && root == nodes[0] );
+
+    /* one section edited */
+    WriteText( path, text2 );
+    code = LiReloadCheck( rl, &root, &num, errbuf, sizeof(errbuf) );
+    CHECK( code == LI_OK && num == 1 );
+    CheckReload( root, text2 );
+    CHECK( root == nodes[0] && nodes[0]->next == nodes[1] &&
+            nodes[1]->next == nodes[2] );
+    c = nodes[2]->next;
+    CHECK( c && c != nodes[3] && c->vint == 4 );
+    CHECK( c && c->next == nodes[4] && nodes[4]->next == nodes[5] &&
+            !nodes[5]->next );
+
+    /* a broken file keeps the old tree */
+    WriteText( path, "a = 1, 2\nb = { x = \"}\"\nc = 4\n" );
+    code = LiReloadCheck( rl, &root, &num, errbuf, sizeof(errbuf) );
+    CHECK( code != LI_OK && num == 0 && errbuf[0] );
+    CheckReload( root, text2 );
+    WriteText( path, "a = 1, 2\nb = }\n" );
+    code = LiReloadCheck( rl, &root, &num, errbuf, sizeof(errbuf) );
+    CHECK( code != LI_OK && num == 0 );
+    CheckReload( root, text2 );
+
+    /* '}' in a string of a nested section */
+    WriteText( path, text3 );
+    code = LiReloadCheck( rl, &root, &num, errbuf, sizeof(errbuf) );
+    CHECK( code == LI_OK && num == 1 );
+    CheckReload( root, text3 );
+    CHECK( root == nodes[0] && nodes[0]->next == nodes[1] );
+    o = nodes[1]->next;
+    CHECK( o && o != nodes[2] && o->firstChild &&
+            LiSCmp( o->firstChild->vstr, "}}" ) );
+    CHECK( o && o->next == c && c->next == nodes[4] );
+
+    LiReloadClose( rl, litrue );
+    remove( path );
+}
+
+/*
+============
+TestUring
+
+Writes and reads a file of more blocks than the ring
+holds through liUringIO and liMapIO, and a pipe, which
+is read and written in order. Built with LI_NO_URING
+the files go through pread/pwrite.
+============
+*/
+static void TestUring( void ) {
+    char path[] = "/tmp/li_test_XXXXXX";
+    char name[32];
+    char *text;
+    liObj_t *o = NULL, *r;
+    licode_t code;
+    size_t len = 0;
+    int fds[2];
+    int fd, i, status;
+    pid_t pid;
+
+#if defined(LI_NO_URING)
+    CHECK( !LiUringAvailable() );
+#endif
+    text = (char*)malloc( 30000 * 64 );
+    for( i = 0; i < 30000; i++ ) {
+        len += (size_t)sprintf( text + len,
+                "item = { id = %d  name = \"n%d\"  v = 1, 2 }\n", i, i % 7 );
+    }
+    CHECK( len > 2 * LI_URING_DEPTH * LI_URING_BLOCK_SIZE );
+    CHECK( LiReadMem( &o, text, len, 0, NULL, 0 ) == LI_OK );
+    free( text );
+    if( !o ) {
+        return;
+    }
+
+    fd = mkstemp( path );
+    CHECK( fd >= 0 );
+    if( fd >= 0 ) {
+        close( fd );
+        code = LiWriteEx( &liUringIO, o, path, 0 );
+        CHECK( code == LI_OK );
+        r = NULL;
+        code = LiRead( &r, path );
+        CHECK( code == LI_OK && r && ListEqual( o, r ) );
+        if( r ) {
+            LiFree( r );
+        }
+        r = NULL;
+        code = LiReadEx( &liUringIO, &r, path, 0, NULL, 0 );
+        CHECK( code == LI_OK && r && ListEqual( o, r ) );
+        if( r ) {
+            LiFree( r );
+        }
+        r = NULL;
+        code = LiReadEx( &liMapIO, &r, path, 0, NULL, 0 );
+        CHECK( code == LI_OK && r && ListEqual( o, r ) );
+        if( r ) {
+            LiFree( r );
+        }
+        remove( path );
+    }
+
+    /* a pipe, the writer is a child process */
+    CHECK( pipe( fds ) == 0 );
+    pid = fork();
+    CHECK( pid >= 0 );
+    if( pid == 0 ) {
+        close( fds[0] );
+        sprintf( name, "/dev/fd/%d", fds[1] );
+        code = LiWriteEx( &liUringIO, o, name, 0 );
+        _exit( code == LI_OK ? 0 : 1 );
+    }
+    close( fds[1] );
+    if( pid > 0 ) {
+        sprintf( name, "/dev/fd/%d", fds[0] );
+        r = NULL;
+        code = LiReadEx( &liUringIO, &r, name, 0, NULL, 0 );
+        CHECK( code == LI_OK && r && ListEqual( o, r ) );
+        if( r ) {
+            LiFree( r );
+        }
+        CHECK( waitpid( pid, &status, 0 ) == pid && WIFEXITED( status ) &&
+                WEXITSTATUS( status ) == 0 );
+    }
+    close( fds[0] );
+
+    LiFree( o );
+}
+
+int main( void ) {
+    TestValues();
+    TestRuns();
+    TestNumbers();
+    TestNumberText();
+    TestStrings();
+    TestErrors();
+    TestLong();
+    TestRoundTrip();
+    TestFind();
+    TestContext();
+    TestBinary();
+    TestImage();
+    TestStats();
+    TestHash();
+    TestDedup();
+    TestDiff();
+    TestDeepClone();
+    TestZip();
+    TestReload();
+    TestUring();
+
+    printf( "%d checks, %d failed\n", numChecks, numFailed );
+    return numFailed ? 1 : 0;
+}
@@ -0,0 +1,388 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+#include "../li.h"
+#include "../lidoc.h"
+
+/*
+================================================
+                li thread stress test
+
+Worker threads search, clone and parse while they
+share one tree, then read a document while one
+thread publishes new versions of it. Clones share
+the keys and strings of the tree, so the reference
+counters are changed from all threads at once. Build
+with LI_ATOMIC_REFS, 'make test-threads' runs it
+under ThreadSanitizer.
+================================================
+*/
+
+#define NUM_THREADS     8
+#define NUM_ITERATIONS  200
+#define NUM_SECTIONS    64
+
+static int numChecks = 0;
+static int numFailed = 0;
+static pthread_mutex_t checkLock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CHECK(e) \
+    do { \
+        pthread_mutex_lock( &checkLock ); \
+        numChecks++; \
+        if( !(e) ) { \
+            numFailed++; \
+            printf( "%s:%d: check failed: %s\n", __FILE__, __LINE__, #e ); \
+        } \
+        pthread_mutex_unlock( &checkLock ); \
+    } while( 0 )
+
+static char     *text;
+static size_t   textLen;
+static liObj_t  *shared;
+static liDoc_t  *doc;
+static atomic_int docDone;
+
+/*
+============
+MakeText
+============
+*/
+static void MakeText( void ) {
+    size_t n = 0;
+    int i;
+
+    text = (char*)malloc( NUM_SECTIONS * 256 );
+    for( i = 0; i < NUM_SECTIONS; i++ ) {
+        n += (size_t)sprintf( text + n,
+                "section = {\n"
+                "    name = \"s%d\"\n"
+                "    values = %d, %d, %d\n"
+                "    item = { id = %d  tag = \"t\\n%d\" }\n"
+                "}\n", i, i, i + 1, i + 2, i, i );
+    }
+    textLen = n;
+}
+
+/*
+============
+CountFound
+============
+*/
+static int CountFound( liObj_t *o, const char *pattern ) {
+    liFindData_t fd;
+    licode_t code;
+    int num = 0;
+
+    for( code = LiFindFirst( &fd, o, pattern ); code == LI_OK;
+            code = LiFindNext( &fd ) ) {
+        num++;
+    }
+    LiFindClose( &fd );
+    return num;
+}
+
+/*
+============
+Worker
+============
+*/
+static void *Worker( void *arg ) {
+    int id = (int)(size_t)arg;
+    char errbuf[1024];
+    liObj_t *it, *clone, *deep, *parsed;
+    licode_t code;
+    int i, num;
+
+    for( i = 0; i < NUM_ITERATIONS; i++ ) {
+        CHECK( CountFound( shared, "section.item.tag" ) == NUM_SECTIONS );
+        CHECK( CountFound( shared, "section.values" ) == NUM_SECTIONS * 3 );
+
+        /* clones share the strings of the tree */
+        it = shared;
+        for( num = (i + id) % NUM_SECTIONS; num; num-- ) {
+            it = it->next;
+        }
+        clone = LiClone( it );
+        deep = LiDeepClone( it );
+        CHECK( clone->firstChild->vstr == it->firstChild->vstr );
+        CHECK( CountFound( clone->firstChild, "item.id" ) == 1 );
+        /* a renamed key is copied, the tree keeps its key */
+        LiSetKey( clone->firstChild, "renamed" );
+        CHECK( LiSCmp( it->firstChild->key, "name" ) );
+        LiFree( clone );
+        LiFree( deep );
+
+        if( i % 20 == 0 ) {
+            parsed = NULL;
+            code = LiReadMem( &parsed, text, textLen, 0, errbuf,
+                    sizeof(errbuf) );
+            CHECK( code == LI_OK );
+            CHECK( CountFound( parsed, "section.name" ) == NUM_SECTIONS );
+            if( parsed ) {
+                LiFree( parsed );
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+============
+DocReader
+
+Hashes, compares and searches the published versions
+while the writer replaces them
+============
+*/
+static void *DocReader( void *arg ) {
+    liDocReader_t rd;
+    liObj_t *root;
+    int num = 0;
+
+    CHECK( LiDocReaderOpen( doc, &rd ) == LI_OK );
+    while( !atomic_load( &docDone ) || num < 10 ) {
+        root = LiDocReadBegin( &rd );
+        CHECK( LiHash( root ) != 0 );
+        CHECK( !LiEqual( root, root->next ) );
+        CHECK( CountFound( root, "section.item.id" ) == NUM_SECTIONS );
+        LiDocReadEnd( &rd );
+        num++;
+    }
+    LiDocReaderClose( &rd );
+    return NULL;
+}
+
+/*
+============
+DocWriter
+============
+*/
+static void *DocWriter( void *arg ) {
+    liObj_t *root, *it;
+    int i;
+
+    for( i = 0; i < NUM_ITERATIONS; i++ ) {
+        root = LiDocWriteBegin( doc );
+        it = root->firstChild->next;
+        it->vint++;
+        LiHashInvalidate( it );
+        LiDocPublish( doc, root );
+    }
+    atomic_store( &docDone, 1 );
+    return NULL;
+}
+
+/*
+============
+TestDoc
+============
+*/
+static void TestDoc( void ) {
+    pthread_t threads[NUM_THREADS];
+    char errbuf[1024];
+    liObj_t *root = NULL;
+    int i;
+
+    CHECK( LiReadMem( &root, text, textLen, 0, errbuf,
+            sizeof(errbuf) ) == LI_OK );
+    doc = LiDocNew( root );
+    atomic_init( &docDone, 0 );
+    for( i = 0; i < NUM_THREADS - 1; i++ ) {
+        pthread_create( &threads[i], NULL, DocReader, NULL );
+    }
+    pthread_create( &threads[i], NULL, DocWriter, NULL );
+    for( i = 0; i < NUM_THREADS; i++ ) {
+        pthread_join( threads[i], NULL );
+    }
+    LiDocFree( doc );
+}
+
+/*
+============
+TestReadMany
+
+Reads the same file on all workers with the global
+allocator
+============
+*/
+static void TestReadMany( void ) {
+    char path[] = "/tmp/li_test_XXXXXX";
+    const char *paths[NUM_THREADS];
+    liObj_t *results[NUM_THREADS];
+    licode_t codes[NUM_THREADS];
+    liReadOpts_t opts = { NULL, NULL, 0, NUM_THREADS };
+    FILE *fp;
+    int fd, i;
+
+    fd = mkstemp( path );
+    CHECK( fd >= 0 );
+    if( fd < 0 ) {
+        return;
+    }
+    fp = fdopen( fd, "w" );
+    fwrite( text, 1, textLen, fp );
+    fclose( fp );
+
+    for( i = 0; i < NUM_THREADS; i++ ) {
+        paths[i] = path;
+    }
+    CHECK( LiReadMany( paths, NUM_THREADS, results, codes, &opts ) == LI_OK );
+    for( i = 0; i < NUM_THREADS; i++ ) {
+        CHECK( codes[i] == LI_OK );
+        CHECK( CountFound( results[i], "section.name" ) == NUM_SECTIONS );
+        if( results[i] ) {
+            LiFree( results[i] );
+        }
+    }
+    remove( path );
+}
+
+/*
+============
+growing memory output
+
+The file name passed to open is the liGrowOut_t itself
+============
+*/
+typedef struct {
+    char        *buf;
+    size_t      len;
+    size_t      size;
+} liGrowOut_t;
+
+static liFile_t GrowOpen( const char *name, char mode ) {
+    liGrowOut_t *g = (liGrowOut_t*)name;
+    g->len = 0;
+    return (liFile_t)g;
+}
+
+static void GrowClose( liFile_t f ) {
+}
+
+static ssize_t GrowWrite( const void *data, size_t size, liFile_t f ) {
+    liGrowOut_t *g = (liGrowOut_t*)f;
+    if( g->len + size > g->size ) {
+        g->size = (g->len + size) * 2;
+        g->buf = (char*)realloc( g->buf, g->size );
+    }
+    memcpy( g->buf + g->len, data, size );
+    g->len += size;
+    return (ssize_t)size;
+}
+
+static liIO_t growIO = { GrowOpen, GrowClose, NULL, GrowWrite, NULL, NULL };
+
+/* allocator that is not thread-safe, like an arena */
+static size_t numArenaAllocs = 0;
+
+static void *ArenaAlloc( size_t size, lityid_t type ) {
+    numArenaAllocs++;
+    return malloc( size );
+}
+
+static void *ArenaRealloc( void *ptr, size_t size, lityid_t type ) {
+    numArenaAllocs++;
+    return realloc( ptr, size );
+}
+
+static void ArenaFree( void *ptr ) {
+    numArenaAllocs++;
+    free( ptr );
+}
+
+/*
+============
+TestParallelWrite
+
+LI_FPARALLEL writes the same bytes as a sequential write,
+also from a context whose allocator is not thread-safe
+============
+*/
+static void TestParallelWrite( void ) {
+    static const liflag_t modes[] = { 0, LI_FMINIFY };
+    liAlloc_t arena = { ArenaAlloc, ArenaRealloc, ArenaFree };
+    liGrowOut_t seq = { NULL, 0, 0 }, par = { NULL, 0, 0 };
+    liContext_t ctx;
+    liObj_t *root = NULL;
+    char *big;
+    size_t len = 0;
+    int i, g;
+
+    /* two split objects with many segments and a small node */
+    big = (char*)malloc( 2 * 8000 * 96 + 64 );
+    for( g = 0; g < 2; g++ ) {
+        len += (size_t)sprintf( big + len, "group = {\n" );
+        for( i = 0; i < 8000; i++ ) {
+            len += (size_t)sprintf( big + len,
+                    "item = { id = %d  name = \"n%d\"  v = 1, 2, 3 }\n",
+                    i, g );
+        }
+        len += (size_t)sprintf( big + len, "}\nx = %d\n", g );
+    }
+    CHECK( LiReadMem( &root, big, len, 0, NULL, 0 ) == LI_OK );
+    free( big );
+    if( !root ) {
+        return;
+    }
+
+    LiContextInit( &ctx, &arena, &growIO );
+    ctx.numThreads = 4;
+    for( i = 0; i < 2; i++ ) {
+        CHECK( LiWriteEx( &growIO, root, (const char*)&seq, modes[i] ) ==
+                LI_OK );
+        CHECK( LiWriteCtx( &ctx, root, (const char*)&par,
+                modes[i] | LI_FPARALLEL ) == LI_OK );
+        CHECK( seq.len == par.len && !memcmp( seq.buf, par.buf, seq.len ) );
+    }
+    CHECK( numArenaAllocs > 0 );
+
+    free( seq.buf );
+    free( par.buf );
+    LiFree( root );
+}
+
+int main( void ) {
+    pthread_t threads[NUM_THREADS];
+    char errbuf[1024];
+    licode_t code;
+    liObj_t *it;
+    int i;
+
+    MakeText();
+    shared = NULL;
+    code = LiReadMem( &shared, text, textLen, 0, errbuf, sizeof(errbuf) );
+    CHECK( code == LI_OK );
+    if( code != LI_OK ) {
+        printf( "%s\n", errbuf );
+        return 1;
+    }
+
+    for( i = 0; i < NUM_THREADS; i++ ) {
+        pthread_create( &threads[i], NULL, Worker, (void*)(size_t)i );
+    }
+    for( i = 0; i < NUM_THREADS; i++ ) {
+        pthread_join( threads[i], NULL );
+    }
+
+    /* every clone gave its references back */
+    for( it = shared; it; it = it->next ) {
+        CHECK( snref(it->firstChild->key) == 0 );
+        CHECK( snref(it->firstChild->vstr) == 0 );
+    }
+    LiFree( shared );
+
+    TestDoc();
+    TestReadMany();
+    TestParallelWrite();
+    free( text );
+
+    printf( "%d checks, %d failed\n", numChecks, numFailed );
+    return numFailed ? 1 : 0;
+}